@@ -1,3 +1,7 @@
 C:\VulkanSDK\1.2.176.1\Bin32\glslc.exe shaders\shader.vert -o shaders\shader.vert.spv
 C:\VulkanSDK\1.2.176.1\Bin32\glslc.exe shaders\shader.frag -o shaders\shader.frag.spv
+C:\VulkanSDK\1.2.176.1\Bin32\glslc.exe shaders\mesh.vert -o shaders\mesh.vert.spv
+C:\VulkanSDK\1.2.176.1\Bin32\glslc.exe shaders\mesh_packed.vert -o shaders\mesh_packed.vert.spv
+C:\VulkanSDK\1.2.176.1\Bin32\glslc.exe shaders\cull.comp -o shaders\cull.comp.spv
+C:\VulkanSDK\1.2.176.1\Bin32\glslc.exe shaders\depth_reduce.comp -o shaders\depth_reduce.comp.spv
 pause
\ No newline at end of file
@@ -0,0 +1,37 @@
+#version 450
+// vertex attributes, matching PackedVertex::getVertexDescription
+// position comes in as 0-1 across the mesh's bounds, the model matrix scales it back
+layout(location = 0) in vec4 vPosition;
+// octahedral-encoded normal, nothing lights with it yet
+layout(location = 1) in vec2 vNormal;
+layout(location = 2) in vec4 vColor;
+
+// output variable to the fragment shader
+layout(location = 0) out vec3 outColor;
+
+// the camera, shared by every draw
+layout(push_constant) uniform constants {
+  mat4 viewProj;
+} PushConstants;
+
+// every object's model matrix (with dequantize folded in), matching ObjectData.
+// Draws find theirs through the instance buffer.
+struct ObjectData {
+  mat4 model;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer ObjectBuffer {
+  ObjectData objects[];
+} objectBuffer;
+
+// which object each instance is. A batch's instances start at its firstInstance.
+layout(std430, set = 0, binding = 1) readonly buffer InstanceBuffer {
+  uint objects[];
+} instanceBuffer;
+
+void main() {
+  uint object = instanceBuffer.objects[gl_InstanceIndex];
+  mat4 model  = objectBuffer.objects[object].model;
+  gl_Position = PushConstants.viewProj * model * vec4(vPosition.xyz, 1.f);
+  outColor    = vColor.rgb;
+}
\ No newline at end of file
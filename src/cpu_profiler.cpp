@@ -0,0 +1,117 @@
+#include "cpu_profiler.h"
+
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+std::atomic<bool> CpuProfiler::enabled{true};
+
+namespace {
+// every thread's ring, so the dump can find them. Rings are never freed, since a thread
+// that has exited can still have zones worth looking at.
+std::mutex registryMutex;
+std::vector<std::unique_ptr<CpuTraceBuffer>> registry;
+
+// escape a string for use inside a json string literal
+std::string jsonEscape(const char *text) {
+  std::string escaped;
+  for (const char *c = text; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\') {
+      escaped += '\\';
+    }
+    escaped += *c;
+  }
+  return escaped;
+}
+} // namespace
+
+// Find (or make) the calling thread's ring. Only the first call on each thread locks.
+CpuTraceBuffer &CpuProfiler::threadBuffer() {
+  thread_local CpuTraceBuffer *buffer = nullptr;
+
+  if (buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.push_back(std::make_unique<CpuTraceBuffer>());
+
+    buffer             = registry.back().get();
+    buffer->threadId   = static_cast<uint32_t>(registry.size());
+    buffer->threadName = "thread " + std::to_string(buffer->threadId);
+  }
+  return *buffer;
+}
+
+void CpuProfiler::setThreadName(const char *name) {
+  CpuTraceBuffer &buffer = threadBuffer();
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+  buffer.threadName = name;
+}
+
+uint64_t CpuProfiler::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void CpuProfiler::record(const char *name, uint64_t start, uint64_t end) {
+  CpuTraceBuffer &buffer = threadBuffer();
+
+  // we're the only writer, so a relaxed load of our own head is fine
+  uint64_t head = buffer.head.load(std::memory_order_relaxed);
+  buffer.events[head % CPU_TRACE_CAPACITY] = {name, start, end};
+  // publish the event to whoever is dumping
+  buffer.head.store(head + 1, std::memory_order_release);
+}
+
+bool CpuProfiler::writeChromeTrace(const std::string &path) {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Couldn't open " << path << " to write the cpu trace!" << std::endl;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+
+  // steady clock timestamps are big numbers, keep the sub-microsecond digits
+  file << std::fixed << std::setprecision(3);
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+
+  for (auto &buffer : registry) {
+    // name the thread's row in the viewer
+    file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+         << "\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\""
+         << jsonEscape(buffer->threadName.c_str()) << "\"}}";
+    first = false;
+
+    // copy out whatever the ring holds right now
+    uint64_t head  = buffer->head.load(std::memory_order_acquire);
+    uint64_t begin = head > CPU_TRACE_CAPACITY ? head - CPU_TRACE_CAPACITY : 0;
+
+    std::vector<CpuZoneEvent> events;
+    events.reserve(head - begin);
+    for (uint64_t i = begin; i < head; ++i) {
+      events.push_back(buffer->events[i % CPU_TRACE_CAPACITY]);
+    }
+
+    // the owner may have lapped us while we were copying. Anything it could have
+    // overwritten in the meantime is torn, so drop it.
+    uint64_t headAfter = buffer->head.load(std::memory_order_acquire);
+    size_t skip        = 0;
+    if (headAfter - begin > CPU_TRACE_CAPACITY) {
+      skip = std::min<uint64_t>(events.size(), headAfter - begin - CPU_TRACE_CAPACITY);
+    }
+
+    // chrome wants microseconds
+    for (size_t i = skip; i < events.size(); ++i) {
+      file << ",\n{\"name\":\"" << jsonEscape(events[i].name)
+           << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+           << ",\"ts\":" << events[i].start / 1000.0
+           << ",\"dur\":" << (events[i].end - events[i].start) / 1000.0 << "}";
+    }
+  }
+
+  file << "\n]}\n";
+  std::cout << "wrote cpu trace to " << path << std::endl;
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+#include "vk_types.h"
+
+#include <atomic>
+
+// how many zones each thread remembers before it starts overwriting the oldest ones
+constexpr uint32_t CPU_TRACE_CAPACITY = 1 << 16;
+
+// one finished zone, timestamps in nanoseconds on the steady clock
+struct CpuZoneEvent {
+  const char *name;
+  uint64_t start;
+  uint64_t end;
+};
+
+// Ring of finished zones belonging to a single thread. Only the owning thread ever
+// writes to it, so recording a zone is a couple of plain stores and one atomic bump.
+struct CpuTraceBuffer {
+  CpuZoneEvent events[CPU_TRACE_CAPACITY];
+  // total number of zones ever written. The newest one lives at (head - 1) % capacity.
+  std::atomic<uint64_t> head{0};
+
+  uint32_t threadId;
+  std::string threadName;
+};
+
+// Collects scoped cpu zones from every thread, and writes them out as a chrome trace
+// (load it in chrome://tracing or ui.perfetto.dev).
+class CpuProfiler {
+public:
+  // zones are cheap, but this turns them into a single branch
+  static std::atomic<bool> enabled;
+
+  // label the calling thread in the trace
+  static void setThreadName(const char *name);
+
+  static void record(const char *name, uint64_t start, uint64_t end);
+  static uint64_t now();
+
+  // dump everything still in the rings. Safe to call while other threads keep recording.
+  static bool writeChromeTrace(const std::string &path);
+
+private:
+  static CpuTraceBuffer &threadBuffer();
+};
+
+// Times the scope it lives in
+class CpuZone {
+public:
+  explicit CpuZone(const char *name)
+      : name(name), start(CpuProfiler::enabled ? CpuProfiler::now() : 0) {}
+  ~CpuZone() {
+    if (start != 0) {
+      CpuProfiler::record(name, start, CpuProfiler::now());
+    }
+  }
+
+  CpuZone(const CpuZone &)            = delete;
+  CpuZone &operator=(const CpuZone &) = delete;
+
+private:
+  const char *name;
+  uint64_t start;
+};
+
+#define CPU_ZONE_JOIN2(a, b) a##b
+#define CPU_ZONE_JOIN(a, b) CPU_ZONE_JOIN2(a, b)
+// time the rest of the enclosing scope under a name. The name must be a string literal
+// (or otherwise live forever), since only the pointer is stored.
+#define CPU_ZONE(name) CpuZone CPU_ZONE_JOIN(cpuZone, __LINE__)(name)
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "depth_pyramid.h"
+#include "vk_initializers.h"
+
+// how many texels each reduce workgroup covers in x and y, matching depth_reduce.comp
+constexpr uint32_t REDUCE_GROUP_SIZE = 8;
+
+void DepthPyramid::init(VkDevice device, VmaAllocator allocator,
+                        VkPipelineCache pipelineCache, VkShaderModule reduceShader) {
+  this->device    = device;
+  this->allocator = allocator;
+
+  // the level being read, and the level being written
+  VkDescriptorSetLayoutBinding bindings[2] = {
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 0),
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 1)};
+
+  VkDescriptorSetLayoutCreateInfo setInfo{};
+  setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  setInfo.pNext = nullptr;
+
+  setInfo.flags        = 0;
+  setInfo.bindingCount = 2;
+  setInfo.pBindings    = bindings;
+
+  if (vkCreateDescriptorSetLayout(device, &setInfo, nullptr, &setLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the depth pyramid set layout!");
+  }
+
+  VkPipelineLayoutCreateInfo layoutInfo = vkinit::pipelineLayoutCreateInfo();
+  layoutInfo.setLayoutCount             = 1;
+  layoutInfo.pSetLayouts                = &setLayout;
+
+  if (vkCreatePipelineLayout(device, &layoutInfo, nullptr, &pipelineLayout) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the depth pyramid pipeline layout!");
+  }
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.pNext = nullptr;
+
+  pipelineInfo.stage =
+      vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, reduceShader);
+  pipelineInfo.layout = pipelineLayout;
+
+  if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr,
+                               &pipeline) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the depth pyramid pipeline!");
+  }
+
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.pNext = nullptr;
+
+  samplerInfo.magFilter    = VK_FILTER_NEAREST;
+  samplerInfo.minFilter    = VK_FILTER_NEAREST;
+  samplerInfo.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.minLod       = 0.f;
+  samplerInfo.maxLod       = VK_LOD_CLAMP_NONE;
+
+  if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the depth pyramid sampler!");
+  }
+}
+
+void DepthPyramid::cleanup() {
+  destroy();
+  vkDestroySampler(device, sampler, nullptr);
+  vkDestroyPipeline(device, pipeline, nullptr);
+  vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+  vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+}
+
+void DepthPyramid::create(VkExtent2D depthExtent, VkImageView depthView,
+                          const std::vector<uint32_t> &queueFamilies) {
+  destroy();
+  this->depthExtent = depthExtent;
+
+  // halve (rounding up) until we're down to a single texel
+  VkExtent2D extent = {(depthExtent.width + 1) / 2, (depthExtent.height + 1) / 2};
+  while (true) {
+    levelExtents.push_back(extent);
+    if (extent.width == 1 && extent.height == 1) {
+      break;
+    }
+    extent = {(extent.width + 1) / 2, (extent.height + 1) / 2};
+  }
+  const uint32_t levelCount = static_cast<uint32_t>(levelExtents.size());
+
+  VkImageCreateInfo imageInfo = vkinit::imageCreateInfo(
+      VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      {levelExtents[0].width, levelExtents[0].height, 1});
+  imageInfo.mipLevels = levelCount;
+  // written on one queue and read on another, sharing saves the ownership dance
+  if (queueFamilies.size() > 1) {
+    imageInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+    imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+    imageInfo.pQueueFamilyIndices   = queueFamilies.data();
+  }
+
+  VmaAllocationCreateInfo allocInfo{};
+  allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+  if (vmaCreateImage(allocator, &imageInfo, &allocInfo, &image.memImage,
+                     &image.allocation, nullptr) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the depth pyramid image!");
+  }
+
+  VkImageViewCreateInfo viewInfo = vkinit::imageViewCreateInfo(
+      VK_FORMAT_R32_SFLOAT, image.memImage, VK_IMAGE_ASPECT_COLOR_BIT);
+  viewInfo.subresourceRange.levelCount = levelCount;
+  if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the depth pyramid view!");
+  }
+
+  levelViews.resize(levelCount);
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    viewInfo.subresourceRange.baseMipLevel = level;
+    viewInfo.subresourceRange.levelCount   = 1;
+    if (vkCreateImageView(device, &viewInfo, nullptr, &levelViews[level]) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("Failed to create a depth pyramid level view!");
+    }
+  }
+
+  // every level reads the one below it, and the first one reads the depth buffer
+  std::vector<VkDescriptorPoolSize> poolSizes = {
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelCount},
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelCount}};
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.pNext = nullptr;
+
+  poolInfo.flags         = 0;
+  poolInfo.maxSets       = levelCount;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes    = poolSizes.data();
+
+  if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the depth pyramid descriptor pool!");
+  }
+
+  std::vector<VkDescriptorSetLayout> setLayouts(levelCount, setLayout);
+  levelSets.resize(levelCount);
+
+  VkDescriptorSetAllocateInfo setAllocInfo{};
+  setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  setAllocInfo.pNext = nullptr;
+
+  setAllocInfo.descriptorPool     = descriptorPool;
+  setAllocInfo.descriptorSetCount = levelCount;
+  setAllocInfo.pSetLayouts        = setLayouts.data();
+
+  if (vkAllocateDescriptorSets(device, &setAllocInfo, levelSets.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate the depth pyramid descriptor sets!");
+  }
+
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    VkDescriptorImageInfo sourceInfo{};
+    sourceInfo.sampler     = sampler;
+    sourceInfo.imageView   = level == 0 ? depthView : levelViews[level - 1];
+    sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                        : VK_IMAGE_LAYOUT_GENERAL;
+
+    VkDescriptorImageInfo targetInfo{};
+    targetInfo.sampler     = VK_NULL_HANDLE;
+    targetInfo.imageView   = levelViews[level];
+    targetInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet writes[2] = {
+        vkinit::writeDescriptorImage(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                     levelSets[level], &sourceInfo, 0),
+        vkinit::writeDescriptorImage(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelSets[level],
+                                     &targetInfo, 1)};
+    vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+  }
+}
+
+void DepthPyramid::destroy() {
+  if (view == VK_NULL_HANDLE) {
+    return;
+  }
+
+  // destroying the pool frees the sets along with it
+  vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+  for (VkImageView levelView : levelViews) {
+    vkDestroyImageView(device, levelView, nullptr);
+  }
+  vkDestroyImageView(device, view, nullptr);
+  vmaDestroyImage(allocator, image.memImage, image.allocation);
+
+  levelViews.clear();
+  levelExtents.clear();
+  levelSets.clear();
+  view           = VK_NULL_HANDLE;
+  descriptorPool = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::recordInitialLayout(VkCommandBuffer cmd) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+
+  // there's nothing in it yet, so nothing to wait on or keep
+  barrier.srcAccessMask       = 0;
+  barrier.dstAccessMask       = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout           = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image               = image.memImage;
+
+  barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel   = 0;
+  barrier.subresourceRange.levelCount     = static_cast<uint32_t>(levelViews.size());
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount     = 1;
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+                       1, &barrier);
+}
+
+void DepthPyramid::record(VkCommandBuffer cmd) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+
+  // Every level gets rewritten from scratch, so what was in it before doesn't matter,
+  // only that last frame's build is done with it. It never leaves GENERAL, culling
+  // reads it in that layout too.
+  barrier.srcAccessMask       = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask       = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.oldLayout           = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.newLayout           = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image               = image.memImage;
+
+  barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel   = 0;
+  barrier.subresourceRange.levelCount     = static_cast<uint32_t>(levelViews.size());
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount     = 1;
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+                       1, &barrier);
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+  // each level waits on the one before it, so it's a dispatch and a barrier per level
+  barrier.srcAccessMask               = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask               = VK_ACCESS_SHADER_READ_BIT;
+  barrier.oldLayout                   = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.subresourceRange.levelCount = 1;
+
+  for (uint32_t level = 0; level < levelViews.size(); ++level) {
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+                            &levelSets[level], 0, nullptr);
+
+    const VkExtent2D &extent = levelExtents[level];
+    vkCmdDispatch(cmd, (extent.width + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+                  (extent.height + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, 1);
+
+    barrier.subresourceRange.baseMipLevel = level;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+#include "vk_types.h"
+
+// A hierarchical z buffer. Every texel holds the farthest depth of the 2x2 texels under
+// it in the level below, with level 0 at half the depth buffer's size. Sizes round up,
+// so the last row and column of every level still get covered. Anything on screen whose
+// nearest point is behind the pyramid, at a level where it spans at most 2x2 texels, is
+// hidden.
+class DepthPyramid {
+public:
+  // make the reduce pipeline. reduceShader can be destroyed once this returns.
+  void init(VkDevice device, VmaAllocator allocator, VkPipelineCache pipelineCache,
+            VkShaderModule reduceShader);
+  void cleanup();
+
+  // Make the pyramid for a depth buffer of the given size, reading from depthView. Every
+  // family in queueFamilies can read it without an ownership transfer.
+  void create(VkExtent2D depthExtent, VkImageView depthView,
+              const std::vector<uint32_t> &queueFamilies);
+  // get rid of everything create() made, e.g. because the window changed size
+  void destroy();
+
+  // Record moving every level of a freshly created pyramid into GENERAL, which is where
+  // it stays from then on. Has to run once after create(), before anything reads it.
+  void recordInitialLayout(VkCommandBuffer cmd);
+
+  // Record rebuilding the pyramid. The depth buffer has to be in
+  // SHADER_READ_ONLY_OPTIMAL, with its writes visible to compute shaders. Every level is
+  // left in GENERAL.
+  void record(VkCommandBuffer cmd);
+
+  // every level at once, for texelFetch-ing with getSampler()
+  VkImageView getView() const { return view; }
+  VkSampler getSampler() const { return sampler; }
+  VkExtent2D getDepthExtent() const { return depthExtent; }
+
+private:
+  VkDevice device;
+  VmaAllocator allocator;
+
+  VkDescriptorSetLayout setLayout;
+  VkPipelineLayout pipelineLayout;
+  VkPipeline pipeline;
+  // nearest filtering, the pyramid only ever gets read texel by texel
+  VkSampler sampler;
+
+  VkExtent2D depthExtent{0, 0};
+  AllocatedImage image{};
+  VkImageView view{VK_NULL_HANDLE};
+  // one view and size per level, and the set that writes it from the level below
+  std::vector<VkImageView> levelViews;
+  std::vector<VkExtent2D> levelExtents;
+  std::vector<VkDescriptorSet> levelSets;
+  VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
+};
\ No newline at end of file
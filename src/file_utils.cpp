@@ -0,0 +1,164 @@
+#include "file_utils.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool readFile(const std::string &path, std::vector<char> &outData) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+  if (!file.is_open()) {
+    return false;
+  }
+
+  // same trick as the shader loader: start at the end to get the size
+  size_t fileSize = (size_t)file.tellg();
+  outData.resize(fileSize);
+
+  file.seekg(0);
+  file.read(outData.data(), fileSize);
+
+  return file.good();
+}
+
+bool writeFileAtomic(const std::string &path, const void *data, size_t size) {
+  std::string tempPath = path + ".tmp";
+
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      return false;
+    }
+
+    file.write(static_cast<const char *>(data), size);
+    file.flush();
+    if (!file.good()) {
+      std::remove(tempPath.c_str());
+      return false;
+    }
+  }
+
+  // windows won't rename over an existing file unless you ask it nicely
+#ifdef _WIN32
+  bool renamed = MoveFileExA(tempPath.c_str(), path.c_str(),
+                             MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  bool renamed = std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+
+  if (!renamed) {
+    std::remove(tempPath.c_str());
+  }
+  return renamed;
+}
+
+uint64_t hashBytes(const void *data, size_t size) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+bool MappedFile::open(const std::string &path) {
+  close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  fileHandle = file;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize)) {
+    close();
+    return false;
+  }
+  mappedSize = static_cast<size_t>(fileSize.QuadPart);
+
+  // an empty file can't be mapped, but there's nothing to read anyway
+  if (mappedSize == 0) {
+    return true;
+  }
+
+  mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mappingHandle == nullptr) {
+    close();
+    return false;
+  }
+
+  mapping = static_cast<const char *>(
+      MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat fileInfo;
+  if (fstat(fd, &fileInfo) != 0) {
+    ::close(fd);
+    return false;
+  }
+  mappedSize = static_cast<size_t>(fileInfo.st_size);
+
+  if (mappedSize == 0) {
+    ::close(fd);
+    return true;
+  }
+
+  void *view = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file alive on its own
+  ::close(fd);
+
+  if (view == MAP_FAILED) {
+    mappedSize = 0;
+    return false;
+  }
+  // we read it front to back, so let the kernel read ahead aggressively
+  madvise(view, mappedSize, MADV_SEQUENTIAL);
+  mapping = static_cast<const char *>(view);
+#endif
+
+  if (mapping == nullptr) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+  if (mapping != nullptr) {
+    UnmapViewOfFile(mapping);
+  }
+  if (mappingHandle != nullptr) {
+    CloseHandle(mappingHandle);
+  }
+  if (fileHandle != nullptr) {
+    CloseHandle(fileHandle);
+  }
+  fileHandle    = nullptr;
+  mappingHandle = nullptr;
+#else
+  if (mapping != nullptr) {
+    munmap(const_cast<char *>(mapping), mappedSize);
+  }
+#endif
+  mapping    = nullptr;
+  mappedSize = 0;
+}
\ No newline at end of file
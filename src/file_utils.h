@@ -0,0 +1,38 @@
+#pragma once
+#include "vk_types.h"
+
+// read a whole file into memory. Returns false if it can't be opened.
+bool readFile(const std::string &path, std::vector<char> &outData);
+
+// Write a file so that readers only ever see the old contents or the complete new ones:
+// the data goes to a temporary file next to it, which is then renamed over the target.
+bool writeFileAtomic(const std::string &path, const void *data, size_t size);
+
+// cheap 64-bit FNV-1a hash, good enough to notice a truncated or corrupted file
+uint64_t hashBytes(const void *data, size_t size);
+
+// A whole file mapped read-only into memory, so big files can be read without copying
+// them into a buffer first. Unmapped when it goes out of scope.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile &)            = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // returns false if the file can't be opened or mapped
+  bool open(const std::string &path);
+  void close();
+
+  const char *data() const { return mapping; }
+  size_t size() const { return mappedSize; }
+
+private:
+  const char *mapping{nullptr};
+  size_t mappedSize{0};
+#ifdef _WIN32
+  void *fileHandle{nullptr};
+  void *mappingHandle{nullptr};
+#endif
+};
\ No newline at end of file
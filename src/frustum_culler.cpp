@@ -0,0 +1,280 @@
+#include "frustum_culler.h"
+
+#include "cpu_profiler.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <random>
+
+// Pick the widest plane tests the compiler is allowed to use. Define
+// VULKAN_ENGINE_SCALAR_CULLING to force the plain loop, e.g. to compare against it.
+#if defined(VULKAN_ENGINE_SCALAR_CULLING)
+#define CULL_SCALAR
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define CULL_AVX
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CULL_SSE
+#else
+#define CULL_SCALAR
+#endif
+
+namespace {
+// whether one sphere is inside every plane
+bool sphereVisible(const Frustum &frustum, float x, float y, float z, float r) {
+  for (const glm::vec4 &plane : frustum.planes) {
+    if (plane.x * x + plane.y * y + plane.z * z + plane.w < -r) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+Frustum extractFrustum(const glm::mat4 &viewProj) {
+  // glm is column major, so these are the rows
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; ++i) {
+    rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+  }
+
+  // Gribb and Hartmann: every clip space bound -w <= x <= w etc. is a plane. Depth only
+  // goes 0 <= z <= w, so near is just the z row.
+  Frustum frustum;
+  frustum.planes[0] = rows[3] + rows[0];
+  frustum.planes[1] = rows[3] - rows[0];
+  frustum.planes[2] = rows[3] + rows[1];
+  frustum.planes[3] = rows[3] - rows[1];
+  frustum.planes[4] = rows[2];
+  frustum.planes[5] = rows[3] - rows[2];
+
+  // normalized, so plane distances are real distances that radii compare against
+  for (glm::vec4 &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+float maxScale(const glm::mat4 &transform) {
+  return std::max({glm::length(glm::vec3(transform[0])),
+                   glm::length(glm::vec3(transform[1])),
+                   glm::length(glm::vec3(transform[2]))});
+}
+
+glm::vec4 transformSphere(const glm::vec4 &sphere, const glm::mat4 &transform) {
+  float scale      = maxScale(transform);
+  glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.f));
+  return glm::vec4(center, sphere.w * scale);
+}
+
+void FrustumCuller::init(JobSystem &jobs) {
+  this->jobs = &jobs;
+  sliceCounts.resize(jobs.getThreadCount());
+}
+
+void FrustumCuller::cleanup() {
+  jobs = nullptr;
+  sliceCounts.clear();
+}
+
+void FrustumCuller::resize(size_t count) {
+  centerX.resize(count);
+  centerY.resize(count);
+  centerZ.resize(count);
+  radius.resize(count);
+}
+
+void FrustumCuller::cull(const Frustum &frustum, std::vector<uint32_t> &visible) {
+  // every slice gets room for all of its spheres, and gets packed down afterwards
+  const size_t count = size();
+  visible.resize(count);
+
+  if (count < PARALLEL_CULL_THRESHOLD || sliceCounts.size() < 2) {
+    visible.resize(cullRange(frustum, 0, count, visible.data()));
+    return;
+  }
+
+  uint32_t *out = visible.data();
+  jobs->parallelFor(sliceCounts.size(), 1, [&](size_t firstSlice, size_t endSlice) {
+    for (size_t slice = firstSlice; slice < endSlice; ++slice) {
+      CPU_ZONE("cull slice");
+      size_t begin       = sliceStart(slice, count);
+      size_t end         = sliceStart(slice + 1, count);
+      sliceCounts[slice] = cullRange(frustum, begin, end, out + begin);
+    }
+  });
+
+  // slide every slice's survivors down to the end of the ones before it
+  size_t visibleCount = sliceCounts[0];
+  for (size_t i = 1; i < sliceCounts.size(); ++i) {
+    uint32_t *slice = visible.data() + sliceStart(i, count);
+    std::copy(slice, slice + sliceCounts[i], visible.data() + visibleCount);
+    visibleCount += sliceCounts[i];
+  }
+  visible.resize(visibleCount);
+}
+
+const char *FrustumCuller::getInstructionSet() {
+#if defined(CULL_AVX)
+  return "AVX";
+#elif defined(CULL_SSE)
+  return "SSE";
+#else
+  return "scalar";
+#endif
+}
+
+size_t FrustumCuller::cullRange(const Frustum &frustum, size_t begin, size_t end,
+                                uint32_t *out) const {
+  size_t visibleCount = 0;
+  size_t i            = begin;
+
+#if defined(CULL_AVX)
+  // every plane's components, one per register lane
+  __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+  for (int p = 0; p < 6; ++p) {
+    planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+    planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+    planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+    planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+  }
+  const __m256 signBit = _mm256_set1_ps(-0.f);
+
+  for (; i + 8 <= end; i += 8) {
+    __m256 x         = _mm256_loadu_ps(&centerX[i]);
+    __m256 y         = _mm256_loadu_ps(&centerY[i]);
+    __m256 z         = _mm256_loadu_ps(&centerZ[i]);
+    __m256 negRadius = _mm256_xor_ps(_mm256_loadu_ps(&radius[i]), signBit);
+
+    // a sphere's out as soon as it's wholly behind any one plane
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; ++p) {
+      __m256 distance = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+          _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+    }
+
+    // write every index, but only step past the visible ones
+    int mask = _mm256_movemask_ps(inside);
+    for (int lane = 0; lane < 8; ++lane) {
+      out[visibleCount] = static_cast<uint32_t>(i + lane);
+      visibleCount += (mask >> lane) & 1;
+    }
+  }
+#elif defined(CULL_SSE)
+  __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+  for (int p = 0; p < 6; ++p) {
+    planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+    planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+    planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+    planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+  }
+  const __m128 signBit = _mm_set1_ps(-0.f);
+
+  for (; i + 4 <= end; i += 4) {
+    __m128 x         = _mm_loadu_ps(&centerX[i]);
+    __m128 y         = _mm_loadu_ps(&centerY[i]);
+    __m128 z         = _mm_loadu_ps(&centerZ[i]);
+    __m128 negRadius = _mm_xor_ps(_mm_loadu_ps(&radius[i]), signBit);
+
+    __m128 inside = _mm_cmpeq_ps(x, x);
+    for (int p = 0; p < 6; ++p) {
+      __m128 distance =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+                     _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+    }
+
+    int mask = _mm_movemask_ps(inside);
+    for (int lane = 0; lane < 4; ++lane) {
+      out[visibleCount] = static_cast<uint32_t>(i + lane);
+      visibleCount += (mask >> lane) & 1;
+    }
+  }
+#endif
+
+  // whatever didn't fill a whole register, or everything without simd
+  for (; i < end; ++i) {
+    if (sphereVisible(frustum, centerX[i], centerY[i], centerZ[i], radius[i])) {
+      out[visibleCount++] = static_cast<uint32_t>(i);
+    }
+  }
+  return visibleCount;
+}
+
+size_t FrustumCuller::sliceStart(size_t sliceIndex, size_t count) const {
+  // keep every slice but the last a whole number of registers long
+  size_t start = count * sliceIndex / sliceCounts.size();
+  return std::min(count, (start + 7) & ~size_t(7));
+}
+
+void benchmarkFrustumCulling(uint32_t workerCount) {
+  // a camera at the origin looking down -z, like the engine's
+  glm::mat4 projection =
+      glm::perspectiveRH_ZO(glm::radians(70.f), 16.f / 9.f, 0.1f, 200.f);
+  projection[1][1] *= -1;
+  Frustum frustum = extractFrustum(projection);
+
+  JobSystem jobs;
+  jobs.init(workerCount);
+  FrustumCuller culler;
+  culler.init(jobs);
+
+  std::cout << "frustum culling, " << FrustumCuller::getInstructionSet() << " with "
+            << workerCount + 1 << " threads" << std::endl;
+
+  std::mt19937 random(1234);
+  std::uniform_real_distribution<float> position(-200.f, 200.f);
+  std::uniform_real_distribution<float> size(0.5f, 4.f);
+
+  for (size_t count : {size_t(10000), size_t(100000), size_t(1000000)}) {
+    // the naive version gets the spheres the way a per-object loop would have them
+    std::vector<glm::vec4> spheres(count);
+    culler.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      spheres[i] = glm::vec4(position(random), position(random), position(random),
+                             size(random));
+      culler.setSphere(i, spheres[i]);
+    }
+
+    // enough runs to get past timer noise
+    const size_t runs = std::max<size_t>(10, 20000000 / count);
+    std::vector<uint32_t> naiveVisible, visible;
+    naiveVisible.reserve(count);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t run = 0; run < runs; ++run) {
+      naiveVisible.clear();
+      for (size_t i = 0; i < count; ++i) {
+        const glm::vec4 &sphere = spheres[i];
+        bool inside             = true;
+        for (const glm::vec4 &plane : frustum.planes) {
+          if (glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w < -sphere.w) {
+            inside = false;
+            break;
+          }
+        }
+        if (inside) {
+          naiveVisible.push_back(static_cast<uint32_t>(i));
+        }
+      }
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (size_t run = 0; run < runs; ++run) {
+      culler.cull(frustum, visible);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    double naiveMs     = Milliseconds(middle - start).count() / runs;
+    double soaMs       = Milliseconds(end - middle).count() / runs;
+
+    std::cout << "  " << count << " spheres, " << visible.size() << " visible: naive "
+              << naiveMs << " ms, soa " << soaMs << " ms (" << naiveMs / soaMs << "x)"
+              << (visible == naiveVisible ? "" : " RESULTS DIFFER") << std::endl;
+  }
+
+  culler.cleanup();
+  jobs.cleanup();
+}
\ No newline at end of file
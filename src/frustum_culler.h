@@ -0,0 +1,67 @@
+#pragma once
+#include "job_system.h"
+#include "vk_types.h"
+
+// The six planes of a view frustum, normalized, with their normals pointing in. A point
+// p is inside a plane when dot(plane.xyz, p) + plane.w >= 0.
+struct Frustum {
+  glm::vec4 planes[6];
+};
+
+// pull the frustum out of a view * projection matrix with vulkan's 0 to 1 depth
+Frustum extractFrustum(const glm::mat4 &viewProj);
+
+// the most a transform scales anything up by, along any of its axes
+float maxScale(const glm::mat4 &transform);
+// move a bounding sphere (radius in w) by a transform, growing it by the biggest scale
+glm::vec4 transformSphere(const glm::vec4 &sphere, const glm::mat4 &transform);
+
+// with fewer spheres than this, handing out jobs costs more than it saves
+constexpr size_t PARALLEL_CULL_THRESHOLD = 16384;
+
+// Frustum culls bounding spheres on the cpu. The spheres are kept as separate x, y, z
+// and radius arrays, so the plane tests run on 8 (AVX) or 4 (SSE) of them at a time
+// straight out of memory, with a plain loop when neither got compiled in. Big batches
+// get split up between the job system's threads.
+class FrustumCuller {
+public:
+  void init(JobSystem &jobs);
+  void cleanup();
+
+  void resize(size_t count);
+  size_t size() const { return radius.size(); }
+  void setSphere(size_t index, const glm::vec4 &sphere) {
+    centerX[index] = sphere.x;
+    centerY[index] = sphere.y;
+    centerZ[index] = sphere.z;
+    radius[index]  = sphere.w;
+  }
+
+  // Fill visible with the index of every sphere that's at least partly inside the
+  // frustum, in order. An infinite radius is always visible.
+  void cull(const Frustum &frustum, std::vector<uint32_t> &visible);
+
+  // what the plane tests were built with: "AVX", "SSE" or "scalar"
+  static const char *getInstructionSet();
+
+private:
+  // cull [begin, end) into out, returning how many made it
+  size_t cullRange(const Frustum &frustum, size_t begin, size_t end,
+                   uint32_t *out) const;
+  // where slice sliceIndex of count spheres starts
+  size_t sliceStart(size_t sliceIndex, size_t count) const;
+
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> radius;
+
+  JobSystem *jobs{nullptr};
+  // how many spheres each slice kept, at the start of its slice of the output. One
+  // slice per thread.
+  std::vector<size_t> sliceCounts;
+};
+
+// Time a naive per-object glm loop against the culler at 10k, 100k and 1M spheres, and
+// print the results
+void benchmarkFrustumCulling(uint32_t workerCount);
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "gpu_profiler.h"
+
+// Check the queue can do timestamps, and remember how to turn ticks into time
+bool GpuProfiler::init(VkDevice device, VkPhysicalDevice GPU, uint32_t queueFamily,
+                       uint32_t framesInFlight) {
+  this->device = device;
+
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(GPU, &deviceProperties);
+
+  uint32_t queueFamilyCount{0};
+  vkGetPhysicalDeviceQueueFamilyProperties(GPU, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(GPU, &queueFamilyCount, queueFamilies.data());
+
+  // zero valid bits means the queue doesn't support timestamps at all
+  uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+  if (validBits == 0) {
+    std::cout << "GPU profiler disabled: queue family " << queueFamily
+              << " doesn't support timestamps." << std::endl;
+    enabled = false;
+    return false;
+  }
+
+  timestampPeriod = deviceProperties.limits.timestampPeriod;
+  timestampMask   = validBits >= 64 ? UINT64_MAX : (uint64_t{1} << validBits) - 1;
+
+  frames.resize(framesInFlight);
+  enabled = true;
+  return true;
+}
+
+VkQueryPool GpuProfiler::createQueryPool() {
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.pNext = nullptr;
+
+  // two timestamps per scope, one for the start and one for the end
+  poolInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = MAX_GPU_SCOPES * 2;
+
+  VkQueryPool pool;
+  if (vkCreateQueryPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create timestamp query pool!");
+  }
+  return pool;
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer cmd, uint32_t frameSlot, VkQueryPool pool) {
+  if (!enabled) {
+    return;
+  }
+
+  currentFrame = &frames[frameSlot];
+
+  // whatever this slot recorded last time is finished now, so grab it
+  if (currentFrame->pool == pool) {
+    collect(*currentFrame);
+  }
+  currentFrame->pool = pool;
+  currentFrame->scopeNames.clear();
+
+  // queries have to be reset before they can be written again
+  vkCmdResetQueryPool(cmd, pool, 0, MAX_GPU_SCOPES * 2);
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer cmd, const char *name) {
+  if (!enabled || currentFrame->scopeNames.size() >= MAX_GPU_SCOPES) {
+    return UINT32_MAX;
+  }
+
+  uint32_t scope = static_cast<uint32_t>(currentFrame->scopeNames.size());
+  currentFrame->scopeNames.push_back(name);
+
+  // the start time is when everything before this point has been kicked off
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, currentFrame->pool,
+                      scope * 2);
+  return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer cmd, uint32_t scope) {
+  if (!enabled || scope == UINT32_MAX) {
+    return;
+  }
+
+  // and the end time is when all the work in between has fully finished
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, currentFrame->pool,
+                      scope * 2 + 1);
+}
+
+void GpuProfiler::discardPending() {
+  for (auto &frame : frames) {
+    frame.pool = VK_NULL_HANDLE;
+    frame.scopeNames.clear();
+  }
+}
+
+// Read a finished frame's timestamps and add them to each scope's history
+void GpuProfiler::collect(FrameQueries &frame) {
+  uint32_t queryCount = static_cast<uint32_t>(frame.scopeNames.size()) * 2;
+  if (queryCount == 0) {
+    return;
+  }
+
+  // no wait flag: the fence says these are done, and if they somehow aren't we'd
+  // rather lose a sample than stall the frame
+  std::vector<uint64_t> timestamps(queryCount);
+  VkResult result = vkGetQueryPoolResults(
+      device, frame.pool, 0, queryCount, timestamps.size() * sizeof(uint64_t),
+      timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+  if (result != VK_SUCCESS) {
+    return;
+  }
+
+  for (size_t i = 0; i < frame.scopeNames.size(); ++i) {
+    // mask off the bits the queue doesn't fill in, so wraparound still subtracts right
+    uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & timestampMask;
+    double milliseconds = static_cast<double>(ticks) * timestampPeriod / 1000000.0;
+
+    // each scope keeps a ring of its most recent samples
+    ScopeHistory &scope = history[frame.scopeNames[i]];
+    if (scope.samples.size() < GPU_PROFILER_HISTORY) {
+      scope.samples.push_back(milliseconds);
+    } else {
+      scope.samples[scope.next] = milliseconds;
+    }
+    scope.next = (scope.next + 1) % GPU_PROFILER_HISTORY;
+  }
+}
+
+std::map<std::string, GpuScopeStats> GpuProfiler::getStats() {
+  std::map<std::string, GpuScopeStats> stats;
+
+  for (auto &[name, scope] : history) {
+    if (scope.samples.empty()) {
+      continue;
+    }
+
+    GpuScopeStats scopeStats{};
+    scopeStats.samples = static_cast<uint32_t>(scope.samples.size());
+    scopeStats.last    = scope.samples[(scope.next + scopeStats.samples - 1) %
+                                    scopeStats.samples];
+
+    // sort a copy so the ring stays in order
+    std::vector<double> sorted = scope.samples;
+    std::sort(sorted.begin(), sorted.end());
+
+    double total = 0.0;
+    for (double sample : sorted) {
+      total += sample;
+    }
+
+    scopeStats.min = sorted.front();
+    scopeStats.avg = total / sorted.size();
+    scopeStats.p99 = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+
+    stats[name] = scopeStats;
+  }
+  return stats;
+}
+
+void GpuProfiler::printStats(std::ostream &out) {
+  if (!enabled) {
+    return;
+  }
+
+  out << "GPU timings (ms) over the last " << GPU_PROFILER_HISTORY << " frames:\n";
+  for (auto &[name, scopeStats] : getStats()) {
+    out << "  " << name << ": min " << scopeStats.min << ", avg " << scopeStats.avg
+        << ", p99 " << scopeStats.p99 << '\n';
+  }
+  out << std::flush;
+}
+
+void GpuProfiler::writeCsv(const std::string &path, unsigned int frameNumber) {
+  if (!enabled) {
+    return;
+  }
+
+  // only write the header if we're starting a fresh file
+  bool newFile = !std::ifstream(path).good();
+
+  std::ofstream file(path, std::ios::app);
+  if (!file.is_open()) {
+    std::cerr << "Couldn't open " << path << " to write GPU timings!" << std::endl;
+    return;
+  }
+
+  if (newFile) {
+    file << "frame,scope,last_ms,min_ms,avg_ms,p99_ms,samples\n";
+  }
+  for (auto &[name, scopeStats] : getStats()) {
+    file << frameNumber << ',' << name << ',' << scopeStats.last << ',' << scopeStats.min
+         << ',' << scopeStats.avg << ',' << scopeStats.p99 << ',' << scopeStats.samples
+         << '\n';
+  }
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+#include "vk_types.h"
+
+#include <map>
+
+// how many begin/end pairs a single frame can record
+constexpr uint32_t MAX_GPU_SCOPES = 32;
+// how many frames of history each scope keeps for its statistics
+constexpr uint32_t GPU_PROFILER_HISTORY = 256;
+
+// rolling statistics for one named scope, in milliseconds
+struct GpuScopeStats {
+  double last;
+  double min;
+  double avg;
+  double p99;
+  uint32_t samples;
+};
+
+// Times regions of a frame's command buffer on the gpu with timestamp queries. Every
+// frame in flight records into its own query pool, and the results get read back the
+// next time that frame comes around, once its fence has signalled, so nothing stalls.
+class GpuProfiler {
+public:
+  // returns false (and leaves the profiler switched off) if the queue can't do
+  // timestamps
+  bool init(VkDevice device, VkPhysicalDevice GPU, uint32_t queueFamily,
+            uint32_t framesInFlight);
+  bool isEnabled() { return enabled; }
+
+  // make a query pool big enough for one frame's worth of scopes
+  VkQueryPool createQueryPool();
+
+  // Read back the results this frame slot wrote last time around, then reset its pool.
+  // Must be called after the slot's fence has been waited on, and outside a render pass.
+  void beginFrame(VkCommandBuffer cmd, uint32_t frameSlot, VkQueryPool pool);
+
+  // write a timestamp pair around a region. beginScope returns the handle endScope needs.
+  uint32_t beginScope(VkCommandBuffer cmd, const char *name);
+  void endScope(VkCommandBuffer cmd, uint32_t scope);
+
+  // forget any queries that haven't been read yet, e.g. because their pools got rebuilt
+  void discardPending();
+
+  std::map<std::string, GpuScopeStats> getStats();
+  void printStats(std::ostream &out);
+  // append the current statistics to a csv file, one row per scope
+  void writeCsv(const std::string &path, unsigned int frameNumber);
+
+private:
+  struct FrameQueries {
+    VkQueryPool pool{VK_NULL_HANDLE};
+    std::vector<std::string> scopeNames;
+  };
+
+  struct ScopeHistory {
+    std::vector<double> samples;
+    uint32_t next{0};
+  };
+
+  void collect(FrameQueries &frame);
+
+  bool enabled{false};
+  VkDevice device;
+  // nanoseconds per timestamp tick
+  double timestampPeriod;
+  // the queue only fills in this many low bits of each timestamp
+  uint64_t timestampMask;
+
+  std::vector<FrameQueries> frames;
+  FrameQueries *currentFrame{nullptr};
+  std::map<std::string, ScopeHistory> history;
+};
\ No newline at end of file
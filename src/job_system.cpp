@@ -0,0 +1,416 @@
+#include "job_system.h"
+
+#include "cpu_profiler.h"
+
+#include <future>
+
+namespace {
+// which job system the calling thread belongs to, and which of its threads it is
+thread_local const JobSystem *currentSystem = nullptr;
+thread_local uint32_t currentIndex          = NOT_A_JOB_THREAD;
+// picks who to steal from, different on every thread
+thread_local uint32_t stealSeed = 0;
+} // namespace
+
+// DEQUE
+//-----------------------------------------------------------------------
+// Straight from "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al.),
+// minus growing the array.
+bool JobDeque::push(Job *job) {
+  int64_t b = bottom.load(std::memory_order_relaxed);
+  int64_t t = top.load(std::memory_order_acquire);
+  if (b - t >= static_cast<int64_t>(jobs.size())) {
+    return false;
+  }
+
+  jobs[b & (jobs.size() - 1)].store(job, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom.store(b + 1, std::memory_order_relaxed);
+  return true;
+}
+
+Job *JobDeque::pop() {
+  // claim the bottom job first, then see if a thief got to it
+  int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+  bottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = top.load(std::memory_order_relaxed);
+
+  if (t > b) {
+    // it was empty
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  Job *job = jobs[b & (jobs.size() - 1)].load(std::memory_order_relaxed);
+  if (t == b) {
+    // the last one, which a thief might be taking right now, so race them for it
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+      job = nullptr;
+    }
+    bottom.store(b + 1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+Job *JobDeque::steal() {
+  int64_t t = top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = bottom.load(std::memory_order_acquire);
+  if (t >= b) {
+    return nullptr;
+  }
+
+  Job *job = jobs[t & (jobs.size() - 1)].load(std::memory_order_relaxed);
+  if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                   std::memory_order_relaxed)) {
+    return nullptr;
+  }
+  return job;
+}
+
+// JOB SYSTEM
+//-----------------------------------------------------------------------
+void JobSystem::init(uint32_t workerCount) {
+  deques   = std::vector<JobDeque>(workerCount + 1);
+  quitting = false;
+
+  currentSystem = this;
+  currentIndex  = 0;
+
+  for (uint32_t i = 1; i <= workerCount; ++i) {
+    workers.emplace_back(&JobSystem::workerLoop, this, i);
+  }
+}
+
+void JobSystem::cleanup() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    quitting = true;
+  }
+  workAdded.notify_all();
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+
+  if (currentSystem == this) {
+    currentSystem = nullptr;
+    currentIndex  = NOT_A_JOB_THREAD;
+  }
+}
+
+uint32_t JobSystem::getThreadIndex() const {
+  return currentSystem == this ? currentIndex : NOT_A_JOB_THREAD;
+}
+
+void JobSystem::run(JobCounter &counter, std::function<void()> function) {
+  // with nobody else to run it, it may as well happen now
+  if (workers.empty()) {
+    function();
+    return;
+  }
+
+  Job *job      = new Job;
+  job->function = std::move(function);
+  job->counter  = &counter;
+  job->owned    = true;
+
+  counter.pending.fetch_add(1);
+  push(job);
+}
+
+void JobSystem::wait(JobCounter &counter) {
+  uint32_t index = getThreadIndex();
+
+  if (index == NOT_A_JOB_THREAD) {
+    std::unique_lock<std::mutex> lock(waitMutex);
+    ++outsideWaiters;
+    jobsDone.wait(lock, [&] { return counter.pending.load() == 0; });
+    --outsideWaiters;
+    return;
+  }
+
+  // make ourselves useful until everything's done
+  while (counter.pending.load(std::memory_order_acquire) > 0) {
+    if (Job *job = findJob(index, false)) {
+      execute(job);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::parallelFor(size_t count, size_t chunkSize,
+                            const JobRangeFunction &function) {
+  chunkSize           = std::max<size_t>(chunkSize, 1);
+  const size_t chunks = (count + chunkSize - 1) / chunkSize;
+
+  // nothing to split, or nobody to split it with
+  if (chunks < 2 || workers.empty()) {
+    if (count > 0) {
+      function(0, count);
+    }
+    return;
+  }
+
+  // The jobs live here, since this doesn't return until they're done. Our threads do
+  // the first chunk themselves, outside ones just wait.
+  const bool ourThread = getThreadIndex() != NOT_A_JOB_THREAD;
+  JobCounter counter;
+  std::vector<Job> jobs(chunks);
+  const size_t firstHandedOut = ourThread ? 1 : 0;
+  counter.pending             = static_cast<uint32_t>(chunks - firstHandedOut);
+
+  for (size_t i = firstHandedOut; i < chunks; ++i) {
+    jobs[i].range   = &function;
+    jobs[i].begin   = i * chunkSize;
+    jobs[i].end     = std::min(count, (i + 1) * chunkSize);
+    jobs[i].counter = &counter;
+    push(&jobs[i]);
+  }
+
+  if (ourThread) {
+    function(0, std::min(count, chunkSize));
+  }
+  wait(counter);
+}
+
+void JobSystem::push(Job *job) {
+  // counted before it's there to be found, so whoever takes it never counts it down
+  // first
+  ++queuedJobs;
+
+  uint32_t index = getThreadIndex();
+  if (index == NOT_A_JOB_THREAD) {
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    sharedJobs.push_back(job);
+    ++sharedJobCount;
+  } else if (!deques[index].push(job)) {
+    --queuedJobs;
+    execute(job);
+    return;
+  }
+
+  // Anyone about to sleep checks queuedJobs after saying they're sleeping, and this
+  // checks sleepingWorkers after bumping it, so one of the two always sees the other
+  if (sleepingWorkers.load() > 0) {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    workAdded.notify_one();
+  }
+}
+
+Job *JobSystem::findJob(uint32_t index, bool takeShared) {
+  Job *job = deques[index].pop();
+
+  // Outside threads' jobs tend to be long background work, like a streamed mesh's parse,
+  // so only idle workers pick them up. Anyone helping out in wait() is in the middle of
+  // something, like recording a frame, and shouldn't get stuck in one halfway through.
+  if (job == nullptr && takeShared && sharedJobCount.load() > 0) {
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    if (!sharedJobs.empty()) {
+      job = sharedJobs.front();
+      sharedJobs.pop_front();
+      --sharedJobCount;
+    }
+  }
+
+  // then go round everyone else, starting somewhere random so thieves spread out
+  if (job == nullptr) {
+    stealSeed      = stealSeed * 1664525u + 1013904223u + index;
+    uint32_t count = static_cast<uint32_t>(deques.size());
+    uint32_t start = (stealSeed >> 16) % count;
+    for (uint32_t i = 0; i < count && job == nullptr; ++i) {
+      uint32_t victim = (start + i) % count;
+      if (victim != index) {
+        job = deques[victim].steal();
+      }
+    }
+  }
+
+  if (job != nullptr) {
+    --queuedJobs;
+  }
+  return job;
+}
+
+void JobSystem::execute(Job *job) {
+  if (job->range != nullptr) {
+    (*job->range)(job->begin, job->end);
+  } else {
+    job->function();
+  }
+
+  // the counter (and, for parallelFor, the job itself) can be gone the moment it hits
+  // zero, so nothing of the job gets touched after
+  JobCounter *counter = job->counter;
+  if (job->owned) {
+    delete job;
+  }
+  if (counter->pending.fetch_sub(1) == 1 && outsideWaiters.load() > 0) {
+    std::lock_guard<std::mutex> lock(waitMutex);
+    jobsDone.notify_all();
+  }
+}
+
+// Run jobs until there aren't any, spin a little in case more are coming, then sleep
+void JobSystem::workerLoop(uint32_t index) {
+  std::string threadName = "job worker " + std::to_string(index);
+  CpuProfiler::setThreadName(threadName.c_str());
+
+  currentSystem = this;
+  currentIndex  = index;
+  stealSeed     = index;
+
+  uint32_t idleSpins = 0;
+  while (!quitting) {
+    if (Job *job = findJob(index, true)) {
+      execute(job);
+      idleSpins = 0;
+      continue;
+    }
+
+    if (++idleSpins < JOB_IDLE_SPINS) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    ++sleepingWorkers;
+    workAdded.wait(lock, [this] { return quitting || queuedJobs.load() > 0; });
+    --sleepingWorkers;
+    idleSpins = 0;
+  }
+}
+
+// BENCHMARK
+//-----------------------------------------------------------------------
+namespace {
+// a few hundred nanoseconds of something the compiler can't throw away
+uint64_t busyWork(uint64_t seed) {
+  for (int i = 0; i < 256; ++i) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+  }
+  return seed;
+}
+
+using Microseconds = std::chrono::duration<double, std::micro>;
+} // namespace
+
+void benchmarkJobSystem(uint32_t workerCount) {
+  JobSystem jobs;
+  jobs.init(workerCount);
+
+  std::cout << "job system, " << jobs.getThreadCount() << " threads" << std::endl;
+
+  // Throughput: a pile of small jobs started one at a time, then waited on. std::async
+  // makes a thread per task, so it gets fewer of them to keep the thread count sane.
+  {
+    const uint32_t jobCount   = 200000;
+    const uint32_t asyncCount = 2000;
+    std::vector<uint64_t> results(jobCount);
+
+    auto start = std::chrono::steady_clock::now();
+    JobCounter counter;
+    for (uint32_t i = 0; i < jobCount; ++i) {
+      jobs.run(counter, [&results, i] { results[i] = busyWork(i); });
+    }
+    jobs.wait(counter);
+    auto middle = std::chrono::steady_clock::now();
+
+    std::vector<std::future<uint64_t>> futures;
+    futures.reserve(asyncCount);
+    for (uint32_t i = 0; i < asyncCount; ++i) {
+      futures.push_back(std::async(std::launch::async, busyWork, i));
+    }
+    for (uint32_t i = 0; i < asyncCount; ++i) {
+      results[i] = futures[i].get();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double jobUs   = Microseconds(middle - start).count() / jobCount;
+    double asyncUs = Microseconds(end - middle).count() / asyncCount;
+    std::cout << "  throughput: jobs " << 1.0 / jobUs << " M/s, std::async "
+              << 1.0 / asyncUs << " M/s (" << asyncUs / jobUs << "x)" << std::endl;
+  }
+
+  // Latency: start one job and spin until another thread has picked it up, over and
+  // over. Waiting on it instead would just run it right here.
+  {
+    const uint32_t handoffs      = 20000;
+    const uint32_t asyncHandoffs = 2000;
+    std::atomic<bool> started{false};
+    auto start = [&started] { started = true; };
+
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < handoffs; ++i) {
+      started = false;
+      JobCounter counter;
+      jobs.run(counter, start);
+      while (!started) {
+      }
+      jobs.wait(counter);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < asyncHandoffs; ++i) {
+      started                  = false;
+      std::future<void> future = std::async(std::launch::async, start);
+      while (!started) {
+      }
+      future.get();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double jobUs   = Microseconds(middle - begin).count() / handoffs;
+    double asyncUs = Microseconds(end - middle).count() / asyncHandoffs;
+    std::cout << "  handoff: jobs " << jobUs << " us, std::async " << asyncUs << " us ("
+              << asyncUs / jobUs << "x)" << std::endl;
+  }
+
+  // Parallel for: busy work over a big range, split into lots of small chunks for the
+  // job system, and into one task per thread for std::async, which is the best it can
+  // do. Uneven work is where stealing earns its keep, so the cost grows along the range.
+  {
+    const size_t count     = 1 << 16;
+    const size_t chunkSize = 64;
+    std::vector<uint64_t> results(count);
+    auto work = [&results](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        uint64_t value = i;
+        for (size_t repeat = 0; repeat < i / 4096 + 1; ++repeat) {
+          value = busyWork(value);
+        }
+        results[i] = value;
+      }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    work(0, count);
+    auto serialEnd = std::chrono::steady_clock::now();
+    jobs.parallelFor(count, chunkSize, work);
+    auto jobsEnd = std::chrono::steady_clock::now();
+
+    std::vector<std::future<void>> futures;
+    uint32_t threadCount = jobs.getThreadCount();
+    for (uint32_t i = 0; i < threadCount; ++i) {
+      futures.push_back(std::async(std::launch::async, work, count * i / threadCount,
+                                   count * (i + 1) / threadCount));
+    }
+    for (auto &future : futures) {
+      future.get();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    double serialMs    = Milliseconds(serialEnd - start).count();
+    double jobsMs      = Milliseconds(jobsEnd - serialEnd).count();
+    double asyncMs     = Milliseconds(end - jobsEnd).count();
+    std::cout << "  parallel for: serial " << serialMs << " ms, jobs " << jobsMs
+              << " ms (" << serialMs / jobsMs << "x), std::async " << asyncMs
+              << " ms (" << serialMs / asyncMs << "x)" << std::endl;
+  }
+
+  jobs.cleanup();
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+#include "vk_types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// how many jobs each thread's deque holds, a power of two. Pushing onto a full one just
+// runs the job right there instead.
+constexpr uint32_t JOB_DEQUE_CAPACITY = 4096;
+// how many times an idle worker looks for work again before going to sleep
+constexpr uint32_t JOB_IDLE_SPINS = 64;
+// what getThreadIndex() gives threads the job system doesn't own
+constexpr uint32_t NOT_A_JOB_THREAD = UINT32_MAX;
+
+// a [begin, end) run of a parallelFor
+using JobRangeFunction = std::function<void(size_t begin, size_t end)>;
+
+// How many jobs of a group haven't finished yet. Every job gets run with one, and
+// wait() on it returns once they're all done.
+struct JobCounter {
+  std::atomic<uint32_t> pending{0};
+};
+
+// One thing to run. Either function, or range over [begin, end), which is how
+// parallelFor hands out its chunks without an allocation for each.
+struct Job {
+  std::function<void()> function;
+  const JobRangeFunction *range{nullptr};
+  size_t begin{0};
+  size_t end{0};
+  JobCounter *counter{nullptr};
+  // whether it was allocated by run(), and gets deleted once it's done
+  bool owned{false};
+};
+
+// A Chase-Lev work stealing deque of jobs, with a fixed capacity. Its owner pushes and
+// pops at the bottom, newest first, and any other thread can steal from the top, oldest
+// first, so owners and thieves only ever fight over the very last job.
+class JobDeque {
+public:
+  JobDeque() : jobs(JOB_DEQUE_CAPACITY) {}
+
+  // owner only. Returns false if it's full.
+  bool push(Job *job);
+  // owner only, nullptr if it's empty
+  Job *pop();
+  // any thread, nullptr if it's empty or someone else got there first
+  Job *steal();
+
+private:
+  std::atomic<int64_t> top{0};
+  std::atomic<int64_t> bottom{0};
+  std::vector<std::atomic<Job *>> jobs;
+};
+
+// Runs jobs across a pool of worker threads, plus the thread that called init(), each
+// with a deque of its own. Jobs a thread starts go on its own deque, and threads that
+// run out of work steal from everyone else's. Waiting on a counter keeps the thread
+// busy running other jobs until it hits zero, so jobs can start jobs of their own and
+// wait on them, without anything blocking.
+//
+// Threads the job system doesn't own can start jobs and wait on them too, but they
+// never run any: their jobs go through a shared queue, and they sleep while they wait.
+class JobSystem {
+public:
+  // workerCount is the number of extra threads. The calling thread becomes thread 0.
+  void init(uint32_t workerCount);
+  // Stop the workers. Nothing can still be waiting to run.
+  void cleanup();
+
+  // the workers plus the thread that called init(), the most a parallelFor gets split
+  // between
+  uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()) + 1; }
+  // Which of our threads is calling: 0 for the one that called init(), and 1 up to
+  // getThreadCount() - 1 for the workers. NOT_A_JOB_THREAD for anyone else.
+  uint32_t getThreadIndex() const;
+
+  // start a job, counting it in counter until it's done
+  void run(JobCounter &counter, std::function<void()> function);
+  // wait for every job counted in counter to be done
+  void wait(JobCounter &counter);
+  // Call function over [0, count) in chunks of chunkSize (the last one might be
+  // shorter) spread over every thread, including this one, and wait for them all.
+  void parallelFor(size_t count, size_t chunkSize, const JobRangeFunction &function);
+
+private:
+  // put a job where some thread will find it, waking a worker up if they're all asleep
+  void push(Job *job);
+  // The next job for thread index to run: its own newest, then the shared queue if
+  // takeShared, then someone else's oldest. Only workerLoop takes shared jobs.
+  Job *findJob(uint32_t index, bool takeShared);
+  void execute(Job *job);
+
+  void workerLoop(uint32_t index);
+
+  std::vector<std::thread> workers;
+  // one per thread, 0 belongs to the thread that called init()
+  std::vector<JobDeque> deques;
+
+  // jobs started by threads that aren't ours
+  std::mutex sharedMutex;
+  std::deque<Job *> sharedJobs;
+  // how many there are, to look at without taking the lock
+  std::atomic<uint32_t> sharedJobCount{0};
+
+  // jobs pushed and not yet picked up, which is what workers sleep until there are
+  std::atomic<uint32_t> queuedJobs{0};
+  std::atomic<uint32_t> sleepingWorkers{0};
+  std::atomic<bool> quitting{false};
+  std::mutex sleepMutex;
+  std::condition_variable workAdded;
+
+  // outside threads sleeping in wait(), and what wakes them
+  std::atomic<uint32_t> outsideWaiters{0};
+  std::mutex waitMutex;
+  std::condition_variable jobsDone;
+};
+
+// Time job throughput, handoff latency and a parallel for against std::async, and
+// print the results
+void benchmarkJobSystem(uint32_t workerCount);
\ No newline at end of file
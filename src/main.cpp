@@ -1,12 +1,104 @@
 #include "vk_engine.h"
+#include <cctype>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 
-int main() {
+int main(int argc, char *argv[]) {
   VulkanEngine engine;
+
+  // --headless [frames] renders offscreen with no window, then exits
+  // --gpu <index|name> forces a specific device instead of the best scoring one
+  // --gpu-timings <frames> [csv] prints gpu timings every so often, optionally to a csv
+  // --trace <path> writes a chrome trace of the cpu frame phases on exit
+  // --pipeline-cache <path> keeps compiled pipelines somewhere other than the default
+  // --draws <count> fills the scene with that many copies of the test triangle
+  // --job-threads <count> sets how many extra threads cull, record draws and parse
+  // meshes. --record-threads does the same.
+  // --direct-draws records a draw call per object instead of drawing indirectly
+  // --no-culling draws everything, --no-occlusion-culling only culls to the frustum
+  // --flat-culling culls direct draws object by object instead of through the scene bvh
+  // --no-meshlets culls and draws meshes whole instead of meshlet by meshlet
+  // --no-lods loads meshes without levels of detail, and only ever draws the full one
+  // --lod-error <pixels> is how far off a level of detail can look before it's swapped
+  // --mesh <path> loads an .obj or baked .tmesh into the scene. Can be given more than
+  // once, and --obj does the same. A broken .tmesh loads the .obj next to it instead.
+  // --no-streaming loads every mesh up front, instead of in the background once the
+  // camera's within --stream-distance <units> of it. Headless runs never stream.
+  // --bake <obj> <tmesh> bakes an .obj (using the options before it) and exits
+  // --no-mesh-optimize leaves loaded meshes in the order they came in
+  // --optimize-overdraw also sorts loaded meshes to cut down on overdraw
+  // --interleaved-vertices keeps every vertex attribute in one stream
+  // --bench-cull times cpu frustum culling (with the --job-threads before it), exits
+  // --bench-jobs times the job system against std::async (same threads), exits
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--headless") == 0) {
+      engine.headless = true;
+      if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+        engine.headlessFrameCount = std::atoi(argv[++i]);
+      }
+    } else if (strcmp(argv[i], "--gpu") == 0 && i + 1 < argc) {
+      engine.preferredGPU = argv[++i];
+    } else if (strcmp(argv[i], "--gpu-timings") == 0 && i + 1 < argc) {
+      engine.profileInterval = std::atoi(argv[++i]);
+      if (i + 1 < argc && argv[i + 1][0] != '-') {
+        engine.profileCsvPath = argv[++i];
+      }
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      engine.tracePath   = argv[++i];
+      engine.traceOnExit = true;
+    } else if (strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc) {
+      engine.pipelineCachePath = argv[++i];
+    } else if (strcmp(argv[i], "--draws") == 0 && i + 1 < argc) {
+      engine.sceneDrawCount = std::atoi(argv[++i]);
+    } else if ((strcmp(argv[i], "--job-threads") == 0 ||
+                strcmp(argv[i], "--record-threads") == 0) &&
+               i + 1 < argc) {
+      engine.jobThreadCount = std::atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--direct-draws") == 0) {
+      engine.indirectDraws = false;
+    } else if (strcmp(argv[i], "--no-culling") == 0) {
+      engine.frustumCulling   = false;
+      engine.occlusionCulling = false;
+    } else if (strcmp(argv[i], "--no-occlusion-culling") == 0) {
+      engine.occlusionCulling = false;
+    } else if (strcmp(argv[i], "--flat-culling") == 0) {
+      engine.bvhCulling = false;
+    } else if (strcmp(argv[i], "--no-meshlets") == 0) {
+      engine.meshletCulling = false;
+    } else if (strcmp(argv[i], "--no-lods") == 0) {
+      engine.meshLods = false;
+    } else if (strcmp(argv[i], "--lod-error") == 0 && i + 1 < argc) {
+      engine.lodErrorThreshold = static_cast<float>(std::atof(argv[++i]));
+    } else if ((strcmp(argv[i], "--mesh") == 0 || strcmp(argv[i], "--obj") == 0) &&
+               i + 1 < argc) {
+      engine.meshPaths.push_back(argv[++i]);
+    } else if (strcmp(argv[i], "--no-streaming") == 0) {
+      engine.streamMeshes = false;
+    } else if (strcmp(argv[i], "--stream-distance") == 0 && i + 1 < argc) {
+      engine.streamDistance = static_cast<float>(std::atof(argv[++i]));
+    } else if (strcmp(argv[i], "--bake") == 0 && i + 2 < argc) {
+      const char *objPath   = argv[++i];
+      const char *bakedPath = argv[++i];
+      return engine.bakeObjMesh(objPath, bakedPath) ? 0 : 1;
+    } else if (strcmp(argv[i], "--no-mesh-optimize") == 0) {
+      engine.optimizeMeshes = false;
+    } else if (strcmp(argv[i], "--optimize-overdraw") == 0) {
+      engine.optimizeMeshOverdraw = true;
+    } else if (strcmp(argv[i], "--interleaved-vertices") == 0) {
+      engine.vertexStreams = VertexStreams::Interleaved;
+    } else if (strcmp(argv[i], "--bench-cull") == 0) {
+      benchmarkFrustumCulling(engine.getJobWorkerCount());
+      return 0;
+    } else if (strcmp(argv[i], "--bench-jobs") == 0) {
+      benchmarkJobSystem(engine.getJobWorkerCount());
+      return 0;
+    }
+  }
+
   engine.init();
 
   engine.run();
 
   engine.cleanup();
-}
+}
\ No newline at end of file
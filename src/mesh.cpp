@@ -1,38 +1,652 @@
 #include "mesh.h"
-VertexInputDescription Vertex::getVertexDescription() {
-  VertexInputDescription description;
-
-  // only one vertex buffer binding
-  VkVertexInputBindingDescription mainBinding{};
-
-  mainBinding.binding = 0;
-  mainBinding.stride  = sizeof(Vertex);
-
-  description.bindings.push_back(mainBinding);
-
-  // Position will be stored at location 0
-  VkVertexInputAttributeDescription positionAttribute{};
-  positionAttribute.binding  = 0;
-  positionAttribute.location = 0;
-  positionAttribute.format   = VK_FORMAT_R32G32B32_SFLOAT;
-  positionAttribute.offset   = offsetof(Vertex, position);
-
-  // Normal will be stored at Location 1
-  VkVertexInputAttributeDescription normalAttribute{};
-  normalAttribute.binding  = 0;
-  normalAttribute.location = 1;
-  normalAttribute.format   = VK_FORMAT_R32G32B32_SFLOAT;
-  normalAttribute.offset   = offsetof(Vertex, normal);
-
-  // Color will be stored at Location 2
-  VkVertexInputAttributeDescription colorAttribute{};
-  colorAttribute.binding  = 0;
-  colorAttribute.location = 2;
-  colorAttribute.format   = VK_FORMAT_R32G32B32_SFLOAT;
-  colorAttribute.offset   = offsetof(Vertex, color);
-
-  description.attributes.push_back(positionAttribute);
-  description.attributes.push_back(normalAttribute);
-  description.attributes.push_back(colorAttribute);
-  return description;
+
+#include "file_utils.h"
+
+#include <algorithm>
+#include <climits>
+#include <glm/gtx/transform.hpp>
+#include <unordered_map>
+
+VertexInputDescription Vertex::getVertexDescription(VertexStreams streams) {
+  return describeVertex<Vertex>(streams);
+}
+
+VertexInputDescription PackedVertex::getVertexDescription(VertexStreams streams) {
+  return describeVertex<PackedVertex>(streams);
+}
+
+// VERTEX PACKING
+//-----------------------------------------------------------------------
+namespace {
+// Fold a unit vector onto an octahedron and flatten it, which spreads the precision
+// evenly over the sphere. The shader undoes it.
+glm::vec2 octahedralEncode(glm::vec3 normal) {
+  float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  if (length == 0.f) {
+    return glm::vec2(0.f);
+  }
+  normal /= length;
+
+  glm::vec2 encoded(normal.x, normal.y);
+  // the lower half gets folded out over the corners
+  if (normal.z < 0.f) {
+    encoded.x = (1.f - std::abs(normal.y)) * (normal.x >= 0.f ? 1.f : -1.f);
+    encoded.y = (1.f - std::abs(normal.x)) * (normal.y >= 0.f ? 1.f : -1.f);
+  }
+  return encoded;
+}
+
+int16_t toSnorm16(float value) {
+  return static_cast<int16_t>(std::round(glm::clamp(value, -1.f, 1.f) * 32767.f));
+}
+
+uint8_t toUnorm8(float value) {
+  return static_cast<uint8_t>(std::round(glm::clamp(value, 0.f, 1.f) * 255.f));
+}
+} // namespace
+
+void Mesh::computeBounds() {
+  if (vertices.empty()) {
+    boundsMin = boundsMax = glm::vec3(0.f);
+    return;
+  }
+
+  boundsMin = vertices[0].position;
+  boundsMax = vertices[0].position;
+  for (const Vertex &vertex : vertices) {
+    boundsMin = glm::min(boundsMin, vertex.position);
+    boundsMax = glm::max(boundsMax, vertex.position);
+  }
+}
+
+glm::vec4 Mesh::boundingSphere() const {
+  return glm::vec4((boundsMin + boundsMax) * 0.5f,
+                   glm::length(boundsMax - boundsMin) * 0.5f);
+}
+
+uint32_t Mesh::selectLod(float distance, float errorScale, uint32_t lodCount) const {
+  lodCount = std::min(lodCount, static_cast<uint32_t>(lods.size()));
+  for (uint32_t lod = lodCount; lod > 1; --lod) {
+    if (lods[lod - 1].error * errorScale <= distance) {
+      return lod - 1;
+    }
+  }
+  return 0;
+}
+
+void RangeAllocator::reset(uint64_t newCapacity) {
+  capacity = newCapacity;
+  used     = 0;
+  freeRanges.clear();
+  if (capacity > 0) {
+    freeRanges[0] = capacity;
+  }
+}
+
+std::optional<uint64_t> RangeAllocator::allocate(uint64_t size, uint64_t alignment) {
+  if (size == 0) {
+    return 0;
+  }
+
+  for (auto gap = freeRanges.begin(); gap != freeRanges.end(); ++gap) {
+    uint64_t gapStart = gap->first;
+    uint64_t gapEnd   = gap->first + gap->second;
+    uint64_t start    = (gapStart + alignment - 1) / alignment * alignment;
+    if (start + size > gapEnd) {
+      continue;
+    }
+
+    // whatever's left either side of it stays free
+    freeRanges.erase(gap);
+    if (start > gapStart) {
+      freeRanges[gapStart] = start - gapStart;
+    }
+    if (start + size < gapEnd) {
+      freeRanges[start + size] = gapEnd - start - size;
+    }
+    used += size;
+    return start;
+  }
+  return std::nullopt;
+}
+
+void RangeAllocator::free(uint64_t offset, uint64_t size) {
+  if (size == 0) {
+    return;
+  }
+  used -= size;
+
+  // swallow the gap right after it, then let the one right before swallow it
+  auto next = freeRanges.find(offset + size);
+  if (next != freeRanges.end()) {
+    size += next->second;
+    freeRanges.erase(next);
+  }
+
+  auto inserted = freeRanges.emplace(offset, size).first;
+  if (inserted != freeRanges.begin()) {
+    auto previous = std::prev(inserted);
+    if (previous->first + previous->second == offset) {
+      previous->second += size;
+      freeRanges.erase(inserted);
+    }
+  }
+}
+
+void MeshPool::clear() {
+  vertexRanges.reset(vertexCapacity);
+  indexRanges.reset(indexCapacity);
+  meshletRanges.reset(meshletCapacity);
+  lodRanges.reset(lodCapacity);
+}
+
+bool MeshPool::allocate(Mesh &mesh) {
+  // firstIndex is counted in indices of the mesh's own size, so it has to start on a
+  // multiple of that size
+  VkDeviceSize indexSize = mesh.indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4;
+
+  std::optional<uint64_t> vertexStart = vertexRanges.allocate(mesh.vertexCount);
+  std::optional<uint64_t> indexStart =
+      indexRanges.allocate(mesh.indexCount * indexSize, indexSize);
+  std::optional<uint64_t> meshletStart = meshletRanges.allocate(mesh.meshlets.size());
+  std::optional<uint64_t> lodStart     = lodRanges.allocate(mesh.lods.size());
+
+  // all or nothing, so give back whichever parts did fit
+  if (!vertexStart || !indexStart || !meshletStart || !lodStart) {
+    if (vertexStart) {
+      vertexRanges.free(*vertexStart, mesh.vertexCount);
+    }
+    if (indexStart) {
+      indexRanges.free(*indexStart, mesh.indexCount * indexSize);
+    }
+    if (meshletStart) {
+      meshletRanges.free(*meshletStart, mesh.meshlets.size());
+    }
+    if (lodStart) {
+      lodRanges.free(*lodStart, mesh.lods.size());
+    }
+    return false;
+  }
+
+  mesh.firstVertex  = static_cast<uint32_t>(*vertexStart);
+  mesh.firstIndex   = static_cast<uint32_t>(*indexStart / indexSize);
+  mesh.firstMeshlet = static_cast<uint32_t>(*meshletStart);
+  mesh.firstLod     = static_cast<uint32_t>(*lodStart);
+  return true;
+}
+
+void MeshPool::free(const Mesh &mesh) {
+  VkDeviceSize indexSize = mesh.indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4;
+
+  vertexRanges.free(mesh.firstVertex, mesh.vertexCount);
+  indexRanges.free(mesh.firstIndex * indexSize, mesh.indexCount * indexSize);
+  meshletRanges.free(mesh.firstMeshlet, mesh.meshlets.size());
+  lodRanges.free(mesh.firstLod, mesh.lods.size());
+}
+
+template <> std::vector<Vertex> convertVertices<Vertex>(Mesh &mesh) {
+  mesh.computeBounds();
+  mesh.dequantize = glm::mat4(1.f);
+  return mesh.vertices;
+}
+
+template <> std::vector<PackedVertex> convertVertices<PackedVertex>(Mesh &mesh) {
+  std::vector<PackedVertex> packed(mesh.vertices.size());
+  mesh.computeBounds();
+
+  // a flat mesh has no extent along one axis, don't divide by zero over it
+  const glm::vec3 boundsMin = mesh.boundsMin;
+  glm::vec3 extent          = glm::max(mesh.boundsMax - boundsMin, glm::vec3(1e-6f));
+
+  for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+    const Vertex &vertex = mesh.vertices[i];
+    PackedVertex &out    = packed[i];
+
+    glm::vec3 relative = (vertex.position - boundsMin) / extent;
+    for (int axis = 0; axis < 3; ++axis) {
+      out.position[axis] = static_cast<uint16_t>(
+          std::round(glm::clamp(relative[axis], 0.f, 1.f) * 65535.f));
+    }
+    out.position[3] = 0;
+
+    glm::vec2 normal = octahedralEncode(vertex.normal);
+    out.normal[0]    = toSnorm16(normal.x);
+    out.normal[1]    = toSnorm16(normal.y);
+
+    out.color[0] = toUnorm8(vertex.color.x);
+    out.color[1] = toUnorm8(vertex.color.y);
+    out.color[2] = toUnorm8(vertex.color.z);
+    out.color[3] = 255;
+  }
+
+  // the shader reads positions as 0-1 across the box, so scale and move them back out.
+  // This rides along in the model matrix for free.
+  mesh.dequantize = glm::translate(boundsMin) * glm::scale(extent);
+  return packed;
+}
+
+void packMeshData(Mesh &mesh, VertexStreams streams, MeshUploadData &data) {
+  // the gpu gets whichever layout GpuVertex picks, not the loader's full floats
+  std::vector<GpuVertex> gpuVertices = convertVertices<GpuVertex>(mesh);
+  data.vertexBytes = packVertexStreams(gpuVertices, streams, data.streamOffsets);
+  data.vertexData  = data.vertexBytes.data();
+
+  mesh.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+  mesh.indexCount  = static_cast<uint32_t>(mesh.indices.size());
+  mesh.indexType   = indexTypeFor(mesh.vertices.size());
+  if (mesh.lods.empty()) {
+    mesh.lods.push_back({0, mesh.indexCount, 0.f, 0, 0});
+  }
+
+  data.indexData = mesh.indices.data();
+  data.indexSize = mesh.indices.size() * sizeof(uint32_t);
+  if (mesh.indexType == VK_INDEX_TYPE_UINT16) {
+    data.shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+    data.indexData = data.shortIndices.data();
+    data.indexSize = data.shortIndices.size() * sizeof(uint16_t);
+  }
+}
+
+// OBJ LOADING
+//-----------------------------------------------------------------------
+namespace {
+// files smaller than this aren't worth handing out more jobs for
+constexpr size_t OBJ_BYTES_PER_THREAD = 1 << 20;
+
+// one corner of a face, before its indices have been turned into global ones
+struct ObjCorner {
+  int32_t position;
+  int32_t normal;
+  // which of the indices count back from the end of the chunk, and if there's a normal
+  uint8_t flags;
+};
+constexpr uint8_t OBJ_POSITION_RELATIVE = 1;
+constexpr uint8_t OBJ_NORMAL_RELATIVE   = 2;
+constexpr uint8_t OBJ_HAS_NORMAL        = 4;
+
+// everything one thread pulled out of its slice of the file
+struct ObjChunk {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> colors;
+  std::vector<glm::vec3> normals;
+  // already fanned out into triangles, three corners each
+  std::vector<ObjCorner> corners;
+  bool failed{false};
+};
+
+bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+const char *skipSpaces(const char *p, const char *end) {
+  while (p < end && isSpace(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+const char *skipLine(const char *p, const char *end) {
+  while (p < end && *p != '\n') {
+    ++p;
+  }
+  return p < end ? p + 1 : end;
+}
+
+// exact powers of ten, for turning the digits we read into a float in one multiply
+const double powersOfTen[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                              1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                              1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// A float parser that only handles what obj exporters actually write (no hex, inf or
+// nan), which makes it a whole lot faster than strtof and friends. Returns where it
+// stopped, which is p itself if there wasn't a number there.
+const char *parseFloat(const char *p, const char *end, float &out) {
+  const char *start = p;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  // collect up to 19 significant digits, which is all a uint64 can hold
+  uint64_t mantissa = 0;
+  int exponent      = 0;
+  int digits        = 0;
+  bool anyDigits    = false;
+
+  for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+    anyDigits = true;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += mantissa != 0;
+    } else {
+      ++exponent;
+    }
+  }
+
+  if (p < end && *p == '.') {
+    for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+      anyDigits = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa != 0;
+        --exponent;
+      }
+    }
+  }
+
+  if (!anyDigits) {
+    return start;
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *exponentStart = p;
+    ++p;
+
+    bool negativeExponent = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negativeExponent = *p == '-';
+      ++p;
+    }
+
+    if (p < end && *p >= '0' && *p <= '9') {
+      int value = 0;
+      for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        value = std::min(value * 10 + (*p - '0'), 1000);
+      }
+      exponent += negativeExponent ? -value : value;
+    } else {
+      // just an e with nothing after it, so it isn't part of the number
+      p = exponentStart;
+    }
+  }
+
+  double value = static_cast<double>(mantissa);
+  if (exponent < 0 && exponent >= -22) {
+    value /= powersOfTen[-exponent];
+  } else if (exponent > 0 && exponent <= 22) {
+    value *= powersOfTen[exponent];
+  } else if (exponent != 0) {
+    value *= std::pow(10.0, exponent);
+  }
+
+  out = static_cast<float>(negative ? -value : value);
+  return p;
+}
+
+const char *parseInt(const char *p, const char *end, int32_t &out) {
+  const char *start = p;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  const char *digitsStart = p;
+  int64_t value           = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+    value = std::min<int64_t>(value * 10 + (*p - '0'), INT32_MAX);
+  }
+
+  if (p == digitsStart) {
+    return start;
+  }
+  out = static_cast<int32_t>(negative ? -value : value);
+  return p;
+}
+
+// Read up to count floats into out. Returns how many there were.
+int parseFloats(const char *&p, const char *end, float *out, int count) {
+  int parsed = 0;
+  while (parsed < count) {
+    p                = skipSpaces(p, end);
+    const char *next = parseFloat(p, end, out[parsed]);
+    if (next == p) {
+      break;
+    }
+    p = next;
+    ++parsed;
+  }
+  return parsed;
+}
+
+// Turn an index from the file into a 0-based one. Positive indices count from the start
+// of the file. Negative ones count back from the last element read so far, which from
+// inside a chunk is only known relative to where the chunk starts.
+bool storeIndex(int32_t index, size_t countSoFar, int32_t &out, bool &relative) {
+  if (index > 0) {
+    out      = index - 1;
+    relative = false;
+    return true;
+  } else if (index < 0) {
+    out      = static_cast<int32_t>(countSoFar) + index;
+    relative = true;
+    return true;
+  }
+  // 0 isn't a valid obj index
+  return false;
+}
+
+// Parse the corners of an "f" line, fanning polygons out into triangles
+bool parseFace(const char *p, const char *end, ObjChunk &chunk) {
+  ObjCorner first{}, previous{};
+  int cornerCount = 0;
+
+  while (true) {
+    p = skipSpaces(p, end);
+    if (p == end || *p == '\n' || *p == '#') {
+      break;
+    }
+
+    ObjCorner corner{};
+    int32_t index;
+    bool relative;
+
+    const char *next = parseInt(p, end, index);
+    if (next == p ||
+        !storeIndex(index, chunk.positions.size(), corner.position, relative)) {
+      return false;
+    }
+    corner.flags |= relative ? OBJ_POSITION_RELATIVE : 0;
+    p = next;
+
+    // v/vt/vn, v//vn or v/vt. We don't use texture coordinates, so skip those.
+    if (p < end && *p == '/') {
+      ++p;
+      int32_t unused;
+      p = parseInt(p, end, unused);
+
+      if (p < end && *p == '/') {
+        ++p;
+        next = parseInt(p, end, index);
+        if (next == p ||
+            !storeIndex(index, chunk.normals.size(), corner.normal, relative)) {
+          return false;
+        }
+        corner.flags |= OBJ_HAS_NORMAL | (relative ? OBJ_NORMAL_RELATIVE : 0);
+        p = next;
+      }
+    }
+
+    // anything glued onto the end of the corner means we misread it
+    if (p < end && !isSpace(*p) && *p != '\n') {
+      return false;
+    }
+
+    if (cornerCount == 0) {
+      first = corner;
+    } else if (cornerCount >= 2) {
+      chunk.corners.push_back(first);
+      chunk.corners.push_back(previous);
+      chunk.corners.push_back(corner);
+    }
+    previous = corner;
+    ++cornerCount;
+  }
+
+  return cornerCount >= 3;
+}
+
+// Parse every line that starts inside [begin, end)
+void parseObjChunk(const char *begin, const char *end, ObjChunk &chunk) {
+  const char *p = begin;
+
+  while (p < end) {
+    p = skipSpaces(p, end);
+    if (p == end) {
+      break;
+    }
+
+    const char *lineStart = p;
+    if (p + 1 < end && p[0] == 'v' && isSpace(p[1])) {
+      // v x y z, with an optional r g b after it that some scanners write out
+      float values[6];
+      p += 2;
+      int count = parseFloats(p, end, values, 6);
+      if (count < 3) {
+        chunk.failed = true;
+        return;
+      }
+
+      chunk.positions.push_back({values[0], values[1], values[2]});
+      if (count == 6) {
+        // colors are all or nothing, so fill in any we skipped before the first one
+        chunk.colors.resize(chunk.positions.size() - 1, glm::vec3(1.f));
+        chunk.colors.push_back({values[3], values[4], values[5]});
+      } else if (!chunk.colors.empty()) {
+        chunk.colors.push_back(glm::vec3(1.f));
+      }
+    } else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+      float values[3];
+      p += 3;
+      if (parseFloats(p, end, values, 3) != 3) {
+        chunk.failed = true;
+        return;
+      }
+      chunk.normals.push_back({values[0], values[1], values[2]});
+    } else if (p + 1 < end && p[0] == 'f' && isSpace(p[1])) {
+      if (!parseFace(p + 1, end, chunk)) {
+        chunk.failed = true;
+        return;
+      }
+    }
+    // everything else (comments, texture coordinates, groups, materials) is ignored
+
+    p = skipLine(lineStart, end);
+  }
+}
+} // namespace
+
+bool Mesh::loadFromObj(const char *filename, JobSystem *jobs) {
+  vertices.clear();
+  indices.clear();
+
+  MappedFile file;
+  if (!file.open(filename)) {
+    std::cerr << "Couldn't open " << filename << std::endl;
+    return false;
+  }
+
+  const char *data = file.data();
+  const char *end  = data + file.size();
+
+  size_t threadCount = std::min<size_t>(jobs != nullptr ? jobs->getThreadCount() : 1,
+                                         file.size() / OBJ_BYTES_PER_THREAD + 1);
+
+  // cut the file into roughly even slices, with every cut moved up to the start of the
+  // next line so no line gets split between two threads
+  std::vector<const char *> cuts(threadCount + 1);
+  cuts[0]           = data;
+  cuts[threadCount] = end;
+  for (size_t i = 1; i < threadCount; ++i) {
+    cuts[i] = std::max(cuts[i - 1], skipLine(data + file.size() * i / threadCount, end));
+  }
+
+  std::vector<ObjChunk> chunks(threadCount);
+  auto parseChunks = [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      parseObjChunk(cuts[i], cuts[i + 1], chunks[i]);
+    }
+  };
+  if (jobs != nullptr) {
+    jobs->parallelFor(threadCount, 1, parseChunks);
+  } else {
+    parseChunks(0, threadCount);
+  }
+
+  // now stitch the chunks back together, in file order
+  std::vector<glm::vec3> positions, colors, normals;
+  std::vector<size_t> positionStarts(threadCount), normalStarts(threadCount);
+  size_t cornerCount = 0;
+  bool hasColors     = false;
+
+  for (size_t i = 0; i < threadCount; ++i) {
+    if (chunks[i].failed) {
+      std::cerr << "Couldn't parse " << filename << std::endl;
+      return false;
+    }
+    positionStarts[i] = positions.size();
+    normalStarts[i]   = normals.size();
+    positions.insert(positions.end(), chunks[i].positions.begin(),
+                     chunks[i].positions.end());
+    normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+    cornerCount += chunks[i].corners.size();
+    hasColors |= !chunks[i].colors.empty();
+  }
+
+  if (hasColors) {
+    for (auto &chunk : chunks) {
+      chunk.colors.resize(chunk.positions.size(), glm::vec3(1.f));
+      colors.insert(colors.end(), chunk.colors.begin(), chunk.colors.end());
+    }
+  }
+
+  // Every distinct position/normal pair becomes one vertex. Keying on the indices
+  // rather than the float data is both faster and exactly what the file means.
+  std::unordered_map<uint64_t, uint32_t> vertexLookup;
+  vertexLookup.reserve(cornerCount / 3);
+  vertices.reserve(cornerCount / 3);
+  indices.reserve(cornerCount);
+
+  for (size_t i = 0; i < threadCount; ++i) {
+    for (const ObjCorner &corner : chunks[i].corners) {
+      int64_t position = corner.position;
+      if (corner.flags & OBJ_POSITION_RELATIVE) {
+        position += positionStarts[i];
+      }
+
+      int64_t normal = -1;
+      if (corner.flags & OBJ_HAS_NORMAL) {
+        normal = corner.normal;
+        if (corner.flags & OBJ_NORMAL_RELATIVE) {
+          normal += normalStarts[i];
+        }
+      }
+
+      if (position < 0 || position >= (int64_t)positions.size() ||
+          normal >= (int64_t)normals.size() ||
+          (normal < 0 && corner.flags & OBJ_HAS_NORMAL)) {
+        std::cerr << filename << " has a face pointing outside its vertices" << std::endl;
+        vertices.clear();
+        indices.clear();
+        return false;
+      }
+
+      uint64_t key = (uint64_t)position << 32 | (uint32_t)(normal + 1);
+      auto [entry, inserted] =
+          vertexLookup.try_emplace(key, static_cast<uint32_t>(vertices.size()));
+
+      if (inserted) {
+        Vertex vertex;
+        vertex.position = positions[position];
+        vertex.normal   = normal >= 0 ? normals[normal] : glm::vec3(0.f);
+        // with no colors in the file, show the normals off instead
+        vertex.color = hasColors ? colors[position] : vertex.normal;
+        vertices.push_back(vertex);
+      }
+      indices.push_back(entry->second);
+    }
+  }
+
+  return true;
 }
\ No newline at end of file
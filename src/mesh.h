@@ -1,7 +1,11 @@
 #pragma once
 
+#include "job_system.h"
 #include "vk_types.h"
+#include <cstddef>
+#include <cstring>
 #include <glm/glm.hpp>
+#include <map>
 #include <vector>
 
 // mesh shit
@@ -12,17 +16,368 @@ struct VertexInputDescription {
   VkPipelineVertexInputStateCreateFlags flags = 0;
 };
 
+// How a mesh's vertex attributes are laid out across vertex buffer bindings
+enum class VertexStreams {
+  // everything in one buffer, one vertex after another
+  Interleaved,
+  // positions tightly packed on binding 0, everything else on binding 1
+  Split,
+};
+
+// Full precision vertex, 36 bytes. This is what loaders and the optimizer work with.
 struct Vertex {
   glm::vec3 position;
   glm::vec3 normal;
   glm::vec3 color;
 
-  static VertexInputDescription getVertexDescription();
+  static VertexInputDescription
+  getVertexDescription(VertexStreams streams = VertexStreams::Interleaved);
+};
+
+// Compact vertex for the gpu, 16 bytes. Positions are 16-bit fractions of the mesh's
+// bounding box, normals are octahedral-encoded into two 16-bit values, and color is
+// 8 bits per channel.
+struct PackedVertex {
+  // x, y, z, and w is just padding
+  uint16_t position[4];
+  int16_t normal[2];
+  uint8_t color[4];
+
+  static VertexInputDescription
+  getVertexDescription(VertexStreams streams = VertexStreams::Interleaved);
+};
+
+// One attribute: which shader location it feeds, which stream it goes in when split,
+// how it's stored, and where it sits in the interleaved vertex
+struct VertexAttribute {
+  uint32_t location;
+  uint32_t stream;
+  VkFormat format;
+  uint32_t offset;
+  uint32_t size;
+};
+
+// Per vertex type table of attributes, plus the vertex shader that knows how to read
+// them and an id for baked files to check against. Specialized for each layout below.
+template <typename VertexType> struct VertexFormat;
+
+template <> struct VertexFormat<Vertex> {
+  static constexpr VertexAttribute attributes[] = {
+      {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position), 12},
+      {1, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal), 12},
+      {2, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color), 12},
+  };
+  static constexpr const char *vertexShader = "shaders/mesh.vert.spv";
+  static constexpr uint32_t id              = 0;
+};
+
+template <> struct VertexFormat<PackedVertex> {
+  static constexpr VertexAttribute attributes[] = {
+      // unorm, so the shader sees 0-1 across the bounding box
+      {0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(PackedVertex, position), 8},
+      {1, 1, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal), 4},
+      {2, 1, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, color), 4},
+  };
+  static constexpr const char *vertexShader = "shaders/mesh_packed.vert.spv";
+  static constexpr uint32_t id              = 1;
+};
+
+// Where every attribute lands for a given streams setting: the binding it's read from,
+// its offset in that binding's vertices, and each binding's stride. Streams that end up
+// with nothing in them get a stride of 0.
+constexpr uint32_t MAX_VERTEX_STREAMS = 2;
+
+template <typename VertexType> struct VertexStreamLayout {
+  static constexpr size_t attributeCount =
+      sizeof(VertexFormat<VertexType>::attributes) / sizeof(VertexAttribute);
+
+  uint32_t binding[attributeCount];
+  uint32_t offset[attributeCount];
+  uint32_t stride[MAX_VERTEX_STREAMS];
+
+  explicit VertexStreamLayout(VertexStreams streams) {
+    for (uint32_t &streamStride : stride) {
+      streamStride = 0;
+    }
+
+    for (size_t i = 0; i < attributeCount; ++i) {
+      const VertexAttribute &attribute = VertexFormat<VertexType>::attributes[i];
+      if (streams == VertexStreams::Interleaved) {
+        binding[i] = 0;
+        offset[i]  = attribute.offset;
+      } else {
+        // split streams are packed in table order, with no gaps
+        binding[i] = attribute.stream;
+        offset[i]  = stride[attribute.stream];
+        stride[attribute.stream] += attribute.size;
+      }
+    }
+
+    if (streams == VertexStreams::Interleaved) {
+      stride[0] = sizeof(VertexType);
+    }
+  }
+};
+
+// Build the pipeline's vertex input straight from the attribute table, so the two can't
+// disagree
+template <typename VertexType>
+VertexInputDescription
+describeVertex(VertexStreams streams = VertexStreams::Interleaved) {
+  VertexInputDescription description;
+  VertexStreamLayout<VertexType> layout(streams);
+
+  for (uint32_t stream = 0; stream < MAX_VERTEX_STREAMS; ++stream) {
+    if (layout.stride[stream] == 0) {
+      continue;
+    }
+    VkVertexInputBindingDescription binding{};
+    binding.binding   = stream;
+    binding.stride    = layout.stride[stream];
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    description.bindings.push_back(binding);
+  }
+
+  for (size_t i = 0; i < layout.attributeCount; ++i) {
+    if (layout.stride[layout.binding[i]] == 0) {
+      continue;
+    }
+    const VertexAttribute &attribute = VertexFormat<VertexType>::attributes[i];
+
+    VkVertexInputAttributeDescription attributeDescription{};
+    attributeDescription.binding  = layout.binding[i];
+    attributeDescription.location = attribute.location;
+    attributeDescription.format   = attribute.format;
+    attributeDescription.offset   = layout.offset[i];
+    description.attributes.push_back(attributeDescription);
+  }
+  return description;
+}
+
+// Lay vertices out in memory the way describeVertex(streams) expects. With split streams
+// the second one starts at streamOffsets[1], everything's in the one buffer.
+template <typename VertexType>
+std::vector<uint8_t> packVertexStreams(const std::vector<VertexType> &vertices,
+                                       VertexStreams streams,
+                                       VkDeviceSize streamOffsets[MAX_VERTEX_STREAMS]) {
+  VertexStreamLayout<VertexType> layout(streams);
+
+  // keep every stream starting on a nicely aligned offset
+  VkDeviceSize totalSize = 0;
+  for (uint32_t stream = 0; stream < MAX_VERTEX_STREAMS; ++stream) {
+    streamOffsets[stream] = totalSize;
+    totalSize += (vertices.size() * layout.stride[stream] + 15) & ~VkDeviceSize(15);
+  }
+
+  std::vector<uint8_t> data(totalSize);
+  if (streams == VertexStreams::Interleaved) {
+    memcpy(data.data(), vertices.data(), vertices.size() * sizeof(VertexType));
+    return data;
+  }
+
+  for (size_t v = 0; v < vertices.size(); ++v) {
+    const uint8_t *vertex = reinterpret_cast<const uint8_t *>(&vertices[v]);
+    for (size_t i = 0; i < layout.attributeCount; ++i) {
+      const VertexAttribute &attribute = VertexFormat<VertexType>::attributes[i];
+      uint32_t stream                  = layout.binding[i];
+      if (layout.stride[stream] == 0) {
+        continue;
+      }
+      memcpy(data.data() + streamOffsets[stream] + v * layout.stride[stream] +
+                 layout.offset[i],
+             vertex + attribute.offset, attribute.size);
+    }
+  }
+  return data;
+}
+
+// The layout mesh vertices get uploaded in. Define VULKAN_ENGINE_FULL_VERTICES to go
+// back to full floats, e.g. to check whether quantization is to blame for something.
+#ifdef VULKAN_ENGINE_FULL_VERTICES
+using GpuVertex = Vertex;
+#else
+using GpuVertex = PackedVertex;
+#endif
+
+// Half the memory (and index fetch bandwidth) when every index fits in 16 bits. No
+// primitive restart here, so 0xFFFF is a normal index.
+inline VkIndexType indexTypeFor(size_t vertexCount) {
+  return vertexCount <= 65536 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+// the most levels of detail a mesh can have, counting the full one
+constexpr uint32_t MESH_MAX_LODS = 6;
+
+// one level of detail: a run of the mesh's indices, and how far off it is from the
+// full mesh in model space units. Matches cull.comp.
+struct MeshLod {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;
+  // its run of the mesh's meshlets
+  uint32_t firstMeshlet;
+  uint32_t meshletCount;
+};
+
+// the most a meshlet can hold, which is what mesh shaders are happiest with
+constexpr uint32_t MESHLET_MAX_VERTICES  = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// A cluster of neighbouring triangles, which the cull pass can throw out on its own.
+// Its triangles are a run of the mesh's indices. Matches cull.comp.
+struct Meshlet {
+  // bounding sphere, radius in w
+  glm::vec4 sphere;
+  // The cone every triangle's normal is inside of: its axis in xyz, and the sine of its
+  // half angle in w. A w of 1 means the normals go every which way.
+  glm::vec4 cone;
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  // how many different vertices its triangles use
+  uint32_t vertexCount;
+  uint32_t pad;
 };
 
 struct Mesh {
-  // our vertex data
+  // our vertex data. Empty for baked meshes, which go straight from disk to the gpu.
   std::vector<Vertex> vertices;
-  // where the gpu copy of that vertex data is stored
-  AllocatedBuffer vertexBuffer;
+  // triangles, three indices into vertices each
+  std::vector<uint32_t> indices;
+  // how much of each actually made it to the gpu
+  uint32_t vertexCount{0};
+  uint32_t indexCount{0};
+  // model space bounding box
+  glm::vec3 boundsMin{0.f};
+  glm::vec3 boundsMax{0.f};
+  // most detailed first. Just one covering every index until something makes more.
+  std::vector<MeshLod> lods;
+  // every level split into clusters, in model space, one level after another
+  std::vector<Meshlet> meshlets;
+  // where the gpu copy lives in the mesh pool. firstIndex counts in indexType sized
+  // units, and the indices are relative to firstVertex.
+  uint32_t firstVertex{0};
+  uint32_t firstIndex{0};
+  // and where its meshlets and levels are in the pool's meshlet and lod buffers
+  uint32_t firstMeshlet{0};
+  uint32_t firstLod{0};
+  // the gpu copy of the indices is 16 bit whenever it can be
+  VkIndexType indexType{VK_INDEX_TYPE_UINT32};
+  // turns the uploaded positions back into model space. Identity unless they're packed.
+  glm::mat4 dequantize = glm::mat4(1.f);
+
+  // Load a wavefront .obj, spreading the parse over the job system's threads if it's
+  // given one. Returns false (and leaves the mesh empty) if the file can't be read or
+  // is broken.
+  bool loadFromObj(const char *filename, JobSystem *jobs = nullptr);
+  // fit boundsMin and boundsMax around the vertices
+  void computeBounds();
+  // a model space sphere around the bounding box, radius in w
+  glm::vec4 boundingSphere() const;
+  // The most simplified of the first lodCount levels that's off by at most a unit once
+  // its error is multiplied by errorScale and divided by distance. With errorScale
+  // turning model space into pixels at a distance of 1, that's the coarsest level that's
+  // off by at most a pixel.
+  uint32_t selectLod(float distance, float errorScale, uint32_t lodCount) const;
+};
+
+// Convert a mesh's vertices to the given gpu layout, and set up its bounds and
+// dequantize matrix to match
+template <typename VertexType> std::vector<VertexType> convertVertices(Mesh &mesh);
+template <> std::vector<Vertex> convertVertices<Vertex>(Mesh &mesh);
+template <> std::vector<PackedVertex> convertVertices<PackedVertex>(Mesh &mesh);
+
+// First fit suballocation out of [0, capacity), for things that come and go in whole
+// runs. Freed runs merge back into their free neighbours.
+class RangeAllocator {
+public:
+  // forget everything that was allocated, and start over with capacity units
+  void reset(uint64_t capacity);
+  // The start of size free units, on a multiple of alignment. Empty if there's no gap
+  // that big. Nothing's taken for a size of 0.
+  std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment = 1);
+  void free(uint64_t offset, uint64_t size);
+
+  uint64_t getCapacity() const { return capacity; }
+  uint64_t getUsed() const { return used; }
+
+private:
+  // every gap, start to size
+  std::map<uint64_t, uint64_t> freeRanges;
+  uint64_t capacity{0};
+  uint64_t used{0};
 };
+
+// One set of gpu buffers every mesh is suballocated from, so the whole scene draws
+// without rebinding anything between meshes. Each vertex stream gets a buffer of its own,
+// all indexed by the same vertex number. Indices of both sizes share one buffer, and get
+// bound once per size.
+struct MeshPool {
+  AllocatedBuffer streamBuffers[MAX_VERTEX_STREAMS];
+  uint32_t streamStrides[MAX_VERTEX_STREAMS];
+  AllocatedBuffer indexBuffer;
+  // every mesh's meshlets and levels of detail, for the cull pass
+  AllocatedBuffer meshletBuffer;
+  AllocatedBuffer lodBuffer;
+
+  uint32_t vertexCapacity{0};
+  VkDeviceSize indexCapacity{0};
+  uint32_t meshletCapacity{0};
+  uint32_t lodCapacity{0};
+
+  // what's free of each, in vertices, index bytes, meshlets and levels
+  RangeAllocator vertexRanges;
+  RangeAllocator indexRanges;
+  RangeAllocator meshletRanges;
+  RangeAllocator lodRanges;
+
+  // forget every mesh in it, leaving the whole of every capacity free
+  void clear();
+  // Find room for a mesh, from its counts, index type, meshlets and levels, and set its
+  // firstVertex, firstIndex, firstMeshlet and firstLod. Returns false, taking nothing,
+  // if the pool is full.
+  bool allocate(Mesh &mesh);
+  // Hand a mesh's room back. It has to be exactly what allocate() gave it, and nothing
+  // on the gpu can still be reading from it.
+  void free(const Mesh &mesh);
+};
+
+// A mesh's vertices and indices, packed the way the mesh pool wants them. The pointers
+// point into the vectors here, the mesh's own indices, or a baked file's mapping, so
+// they're only good while whichever it is stays put.
+struct MeshUploadData {
+  std::vector<uint8_t> vertexBytes;
+  std::vector<uint16_t> shortIndices;
+  const void *vertexData{nullptr};
+  VkDeviceSize streamOffsets[MAX_VERTEX_STREAMS]{};
+  const void *indexData{nullptr};
+  VkDeviceSize indexSize{0};
+};
+
+// Pack a loaded mesh's vertices for the gpu with the given streams, and its indices at
+// the smallest size they fit in. Fills in the mesh's counts and index type, and a level
+// covering the whole thing if it has none.
+void packMeshData(Mesh &mesh, VertexStreams streams, MeshUploadData &data);
+
+// what the mesh pipeline gets in push constants
+struct MeshPushConstants {
+  glm::mat4 viewProj;
+};
+
+// Per object data the mesh shaders read out of a storage buffer, indexed by
+// gl_InstanceIndex. Draws set firstInstance to their object's index to pick it.
+struct ObjectData {
+  // the object's transform, with its mesh's dequantize folded in
+  glm::mat4 model;
+};
+
+// one entry in the draw list
+struct RenderObject {
+  VkPipeline pipeline;
+  // with no mesh, vertexCount vertices get drawn straight out of the shader
+  Mesh *mesh{nullptr};
+  uint32_t vertexCount;
+  uint32_t firstVertex;
+  // only used for meshes
+  VkPipelineLayout pipelineLayout;
+  glm::mat4 transform;
+};
\ No newline at end of file
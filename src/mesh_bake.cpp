@@ -0,0 +1,194 @@
+#include "mesh_bake.h"
+#include "meshlet_builder.h"
+
+namespace {
+uint64_t alignBaked(uint64_t offset) {
+  return (offset + BAKED_MESH_ALIGNMENT - 1) & ~(BAKED_MESH_ALIGNMENT - 1);
+}
+
+// does [offset, offset + size) fit in a file of fileSize bytes, without overflowing
+bool blobFits(uint64_t offset, uint64_t size, uint64_t fileSize) {
+  return offset <= fileSize && size <= fileSize - offset;
+}
+
+// does every index point at one of vertexCount vertices
+template <typename Index>
+bool indicesInRange(const void *data, uint32_t indexCount, uint32_t vertexCount) {
+  const Index *indices = static_cast<const Index *>(data);
+  for (uint32_t i = 0; i < indexCount; ++i) {
+    if (indices[i] >= vertexCount) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+bool bakeMesh(Mesh &mesh, VertexStreams streams, const std::string &path) {
+  VkDeviceSize streamOffsets[MAX_VERTEX_STREAMS];
+  std::vector<GpuVertex> gpuVertices = convertVertices<GpuVertex>(mesh);
+  std::vector<uint8_t> vertexData =
+      packVertexStreams(gpuVertices, streams, streamOffsets);
+
+  std::vector<uint16_t> shortIndices;
+  const void *indexData = mesh.indices.data();
+  uint64_t indexSize    = mesh.indices.size() * sizeof(uint32_t);
+
+  VkIndexType indexType = indexTypeFor(mesh.vertices.size());
+  if (indexType == VK_INDEX_TYPE_UINT16) {
+    shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+    indexData = shortIndices.data();
+    indexSize = shortIndices.size() * sizeof(uint16_t);
+  }
+
+  // this fills in the first level too, if nothing's made any
+  if (mesh.meshlets.empty()) {
+    buildMeshlets(mesh);
+  }
+  const std::vector<MeshLod> &lods = mesh.lods;
+
+  BakedMeshHeader header{};
+  header.magic         = BAKED_MESH_MAGIC;
+  header.version       = BAKED_MESH_VERSION;
+  header.vertexFormat  = VertexFormat<GpuVertex>::id;
+  header.vertexStreams = static_cast<uint32_t>(streams);
+  header.vertexCount   = static_cast<uint32_t>(mesh.vertices.size());
+  header.indexCount    = static_cast<uint32_t>(mesh.indices.size());
+  header.indexType     = static_cast<uint32_t>(indexType);
+  header.lodCount      = static_cast<uint32_t>(lods.size());
+  header.meshletCount  = static_cast<uint32_t>(mesh.meshlets.size());
+
+  memcpy(header.boundsMin, &mesh.boundsMin, sizeof(header.boundsMin));
+  memcpy(header.boundsMax, &mesh.boundsMax, sizeof(header.boundsMax));
+  memcpy(header.dequantize, &mesh.dequantize, sizeof(header.dequantize));
+  for (uint32_t stream = 0; stream < MAX_VERTEX_STREAMS; ++stream) {
+    header.streamOffsets[stream] = streamOffsets[stream];
+  }
+
+  const uint64_t meshletSize = mesh.meshlets.size() * sizeof(Meshlet);
+
+  header.lodOffset        = alignBaked(sizeof(BakedMeshHeader));
+  header.meshletOffset    = alignBaked(header.lodOffset + lods.size() * sizeof(MeshLod));
+  header.vertexDataOffset = alignBaked(header.meshletOffset + meshletSize);
+  header.vertexDataSize   = vertexData.size();
+  header.indexDataOffset  = alignBaked(header.vertexDataOffset + vertexData.size());
+  header.indexDataSize    = indexSize;
+
+  std::vector<uint8_t> fileData(header.indexDataOffset + indexSize, 0);
+  memcpy(fileData.data(), &header, sizeof(header));
+  memcpy(fileData.data() + header.lodOffset, lods.data(), lods.size() * sizeof(MeshLod));
+  memcpy(fileData.data() + header.meshletOffset, mesh.meshlets.data(), meshletSize);
+  memcpy(fileData.data() + header.vertexDataOffset, vertexData.data(), vertexData.size());
+  memcpy(fileData.data() + header.indexDataOffset, indexData, indexSize);
+
+  return writeFileAtomic(path, fileData.data(), fileData.size());
+}
+
+bool BakedMesh::open(const std::string &path, VertexStreams streams) {
+  close();
+  if (!file.open(path)) {
+    return false;
+  }
+
+  const uint64_t fileSize = file.size();
+  if (fileSize < sizeof(BakedMeshHeader)) {
+    close();
+    return false;
+  }
+  header = reinterpret_cast<const BakedMeshHeader *>(file.data());
+
+  // anything off here means a different version of us baked it, or it got mangled
+  bool valid = header->magic == BAKED_MESH_MAGIC &&
+               header->version == BAKED_MESH_VERSION &&
+               header->vertexFormat == VertexFormat<GpuVertex>::id &&
+               header->vertexStreams == static_cast<uint32_t>(streams) &&
+               header->lodCount > 0 &&
+               (header->indexType == VK_INDEX_TYPE_UINT16 ||
+                header->indexType == VK_INDEX_TYPE_UINT32);
+
+  uint64_t indexSize = header->indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4;
+  valid = valid && header->indexDataSize == header->indexCount * indexSize &&
+          blobFits(header->lodOffset, header->lodCount * sizeof(MeshLod), fileSize) &&
+          blobFits(header->meshletOffset, header->meshletCount * sizeof(Meshlet),
+                   fileSize) &&
+          blobFits(header->vertexDataOffset, header->vertexDataSize, fileSize) &&
+          blobFits(header->indexDataOffset, header->indexDataSize, fileSize);
+
+  // every stream has to hold all of its vertices, not just start inside the blob
+  VertexStreamLayout<GpuVertex> layout(streams);
+  for (uint32_t stream = 0; stream < MAX_VERTEX_STREAMS; ++stream) {
+    valid = valid && blobFits(header->streamOffsets[stream],
+                              uint64_t(header->vertexCount) * layout.stride[stream],
+                              header->vertexDataSize);
+  }
+  for (uint32_t i = 0; valid && i < header->lodCount; ++i) {
+    const MeshLod &lod = getLods()[i];
+    valid = uint64_t(lod.firstIndex) + lod.indexCount <= header->indexCount &&
+            uint64_t(lod.firstMeshlet) + lod.meshletCount <= header->meshletCount;
+  }
+  for (uint32_t i = 0; valid && i < header->meshletCount; ++i) {
+    const Meshlet &meshlet = getMeshlets()[i];
+    valid = uint64_t(meshlet.firstIndex) + meshlet.indexCount <= header->indexCount;
+  }
+
+  // the gpu would happily fetch whatever a bad index points at, so they all get looked at
+  if (valid) {
+    valid = header->indexType == VK_INDEX_TYPE_UINT16
+                ? indicesInRange<uint16_t>(getIndexData(), header->indexCount,
+                                           header->vertexCount)
+                : indicesInRange<uint32_t>(getIndexData(), header->indexCount,
+                                           header->vertexCount);
+  }
+
+  if (!valid) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void BakedMesh::close() {
+  file.close();
+  header = nullptr;
+}
+
+const MeshLod *BakedMesh::getLods() const {
+  return reinterpret_cast<const MeshLod *>(file.data() + header->lodOffset);
+}
+
+const Meshlet *BakedMesh::getMeshlets() const {
+  return reinterpret_cast<const Meshlet *>(file.data() + header->meshletOffset);
+}
+
+const void *BakedMesh::getVertexData() const {
+  return file.data() + header->vertexDataOffset;
+}
+
+const void *BakedMesh::getIndexData() const {
+  return file.data() + header->indexDataOffset;
+}
+
+void BakedMesh::describe(Mesh &mesh) const {
+  mesh.vertices.clear();
+  mesh.indices.clear();
+
+  mesh.vertexCount = header->vertexCount;
+  mesh.indexCount  = header->indexCount;
+  mesh.indexType   = static_cast<VkIndexType>(header->indexType);
+
+  memcpy(&mesh.boundsMin, header->boundsMin, sizeof(header->boundsMin));
+  memcpy(&mesh.boundsMax, header->boundsMax, sizeof(header->boundsMax));
+  memcpy(&mesh.dequantize, header->dequantize, sizeof(header->dequantize));
+
+  mesh.lods.assign(getLods(), getLods() + header->lodCount);
+  mesh.meshlets.assign(getMeshlets(), getMeshlets() + header->meshletCount);
+}
+
+void BakedMesh::describeUpload(MeshUploadData &data) const {
+  data.vertexData = getVertexData();
+  data.indexData  = getIndexData();
+  data.indexSize  = header->indexDataSize;
+  for (uint32_t stream = 0; stream < MAX_VERTEX_STREAMS; ++stream) {
+    data.streamOffsets[stream] = header->streamOffsets[stream];
+  }
+}
\ No newline at end of file
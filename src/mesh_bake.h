@@ -0,0 +1,74 @@
+#pragma once
+#include "file_utils.h"
+#include "mesh.h"
+
+// Baked meshes are the gpu-ready bytes of a mesh, so loading one is a mmap and a copy
+// into the staging ring instead of a text parse. The layout is, in order:
+//   BakedMeshHeader
+//   MeshLod[lodCount]
+//   Meshlet[meshletCount], in model space
+//   vertex data, packed the way describeVertex(vertexStreams) expects
+//   index data, 16 or 32 bit
+// with every blob starting on a 16 byte boundary.
+constexpr uint32_t BAKED_MESH_MAGIC     = 0x534d5456; // "VTMS"
+constexpr uint32_t BAKED_MESH_VERSION   = 3;
+constexpr uint64_t BAKED_MESH_ALIGNMENT = 16;
+
+struct BakedMeshHeader {
+  uint32_t magic;
+  uint32_t version;
+  // VertexFormat<>::id and VertexStreams the vertex data was packed with
+  uint32_t vertexFormat;
+  uint32_t vertexStreams;
+
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t indexType;
+  uint32_t lodCount;
+  uint32_t meshletCount;
+  uint32_t pad;
+
+  float boundsMin[3];
+  float boundsMax[3];
+  float dequantize[16];
+
+  // offsets are from the start of the file, except streamOffsets, which are from the
+  // start of the vertex data
+  uint64_t streamOffsets[MAX_VERTEX_STREAMS];
+  uint64_t lodOffset;
+  uint64_t meshletOffset;
+  uint64_t vertexDataOffset;
+  uint64_t vertexDataSize;
+  uint64_t indexDataOffset;
+  uint64_t indexDataSize;
+};
+
+// Write a mesh out in the baked format, for the current GpuVertex and the given streams.
+// Sets up the mesh's bounds and dequantize matrix along the way.
+bool bakeMesh(Mesh &mesh, VertexStreams streams, const std::string &path);
+
+// A baked mesh file, mapped into memory. The data pointers point straight into the
+// mapping, so they're only good while this is open.
+class BakedMesh {
+public:
+  // Map the file and check it over. Returns false if it can't be read, is broken, or was
+  // baked for a different vertex layout than streams and GpuVertex.
+  bool open(const std::string &path, VertexStreams streams);
+  void close();
+
+  const BakedMeshHeader &getHeader() const { return *header; }
+  const MeshLod *getLods() const;
+  const Meshlet *getMeshlets() const;
+  const void *getVertexData() const;
+  const void *getIndexData() const;
+
+  // fill in everything about mesh except where it is in the mesh pool, as if it had been
+  // uploaded from its vertices
+  void describe(Mesh &mesh) const;
+  // point data at the file's vertices and indices, to upload them straight out of it
+  void describeUpload(MeshUploadData &data) const;
+
+private:
+  MappedFile file;
+  const BakedMeshHeader *header{nullptr};
+};
\ No newline at end of file
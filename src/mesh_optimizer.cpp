@@ -0,0 +1,311 @@
+#include "mesh_optimizer.h"
+
+#include <numeric>
+
+namespace {
+// Which triangles use each vertex, packed into one array. The triangles around vertex v
+// are triangles[offsets[v]] to triangles[offsets[v + 1]].
+struct VertexAdjacency {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> triangles;
+};
+
+VertexAdjacency buildAdjacency(const std::vector<uint32_t> &indices, size_t vertexCount) {
+  VertexAdjacency adjacency;
+  adjacency.offsets.assign(vertexCount + 1, 0);
+  adjacency.triangles.resize(indices.size());
+
+  for (uint32_t index : indices) {
+    ++adjacency.offsets[index + 1];
+  }
+  std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(),
+                   adjacency.offsets.begin());
+
+  std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+  for (size_t i = 0; i < indices.size(); ++i) {
+    adjacency.triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+  return adjacency;
+}
+} // namespace
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices,
+                                    size_t vertexCount, uint32_t cacheSize) {
+  VertexCacheStats stats{};
+  if (indices.empty()) {
+    return stats;
+  }
+
+  // a FIFO cache only cares about insertion order: a vertex is still in it if fewer
+  // than cacheSize others have been inserted since it was
+  std::vector<int64_t> cacheTime(vertexCount, -int64_t(cacheSize));
+  std::vector<bool> used(vertexCount, false);
+
+  int64_t time = 0;
+  for (uint32_t index : indices) {
+    if (time - cacheTime[index] >= cacheSize) {
+      cacheTime[index] = time++;
+    }
+    used[index] = true;
+  }
+
+  size_t usedCount = std::count(used.begin(), used.end(), true);
+  stats.acmr       = static_cast<float>(time) / (indices.size() / 3);
+  stats.atvr       = static_cast<float>(time) / usedCount;
+  return stats;
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount,
+                         uint32_t cacheSize, std::vector<uint32_t> *clusters) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  VertexAdjacency adjacency = buildAdjacency(indices, vertexCount);
+
+  // how many not-yet-emitted triangles each vertex still has
+  std::vector<uint32_t> liveTriangles(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+  }
+
+  // when each vertex last went into the cache, in cache insertions
+  std::vector<int64_t> cacheTime(vertexCount, 0);
+  int64_t time = cacheSize + 1;
+
+  std::vector<bool> emitted(triangleCount, false);
+  // recently used vertices, for finding somewhere to carry on when we get stuck
+  std::vector<uint32_t> deadEnd;
+  std::vector<uint32_t> candidates;
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  if (clusters != nullptr) {
+    clusters->assign(1, 0);
+  }
+
+  // start fanning around the first vertex, and scan forward from there when stuck
+  int64_t fanVertex = 0;
+  uint32_t cursor   = 1;
+
+  while (fanVertex >= 0) {
+    candidates.clear();
+
+    // emit every triangle around the fan vertex that's still waiting
+    for (uint32_t i = adjacency.offsets[fanVertex]; i < adjacency.offsets[fanVertex + 1];
+         ++i) {
+      uint32_t triangle = adjacency.triangles[i];
+      if (emitted[triangle]) {
+        continue;
+      }
+
+      for (int corner = 0; corner < 3; ++corner) {
+        uint32_t v = indices[triangle * 3 + corner];
+        result.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        --liveTriangles[v];
+
+        if (time - cacheTime[v] > cacheSize) {
+          cacheTime[v] = time++;
+        }
+      }
+      emitted[triangle] = true;
+    }
+
+    // Pick the next fan vertex out of the ones we just touched: the one that's been in
+    // the cache longest but will still be there after we emit all its triangles.
+    fanVertex         = -1;
+    int64_t bestScore = -1;
+    for (uint32_t v : candidates) {
+      if (liveTriangles[v] == 0) {
+        continue;
+      }
+
+      int64_t score = 0;
+      if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+        score = time - cacheTime[v];
+      }
+      if (score > bestScore) {
+        bestScore = score;
+        fanVertex = v;
+      }
+    }
+
+    if (fanVertex >= 0) {
+      continue;
+    }
+
+    // Dead end. Try the recently used vertices first, they might still be cached.
+    while (!deadEnd.empty() && fanVertex < 0) {
+      uint32_t v = deadEnd.back();
+      deadEnd.pop_back();
+      if (liveTriangles[v] > 0) {
+        fanVertex = v;
+      }
+    }
+
+    // and failing that, the next vertex in order that has anything left
+    while (fanVertex < 0 && cursor < vertexCount) {
+      if (liveTriangles[cursor] > 0) {
+        fanVertex = cursor;
+      }
+      ++cursor;
+    }
+
+    // Whatever we restarted from, the cache is effectively cold now. Nothing's been
+    // emitted since the last start if the first vertex had no triangles, though.
+    uint32_t clusterStart = static_cast<uint32_t>(result.size() / 3);
+    if (fanVertex >= 0 && clusters != nullptr && clusterStart > clusters->back()) {
+      clusters->push_back(clusterStart);
+    }
+  }
+
+  indices = std::move(result);
+}
+
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<Vertex> &vertices,
+                      const std::vector<uint32_t> &clusters, float threshold) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0 || clusters.empty()) {
+    return;
+  }
+
+  // how good the cache order is as a whole, which the clusters get measured against
+  float meshAcmr = analyzeVertexCache(indices, vertices.size()).acmr;
+
+  // Split the hard clusters up wherever the piece so far already has a cache
+  // efficiency close to the whole mesh's. Smaller clusters sort better.
+  std::vector<int64_t> cacheTime(vertices.size(), -int64_t(VERTEX_CACHE_SIZE));
+  int64_t time = 0;
+
+  std::vector<uint32_t> softClusters;
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    size_t begin = clusters[c];
+    size_t end   = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+    softClusters.push_back(static_cast<uint32_t>(begin));
+
+    // every piece might end up drawn anywhere, so it starts with a cold cache
+    time += VERTEX_CACHE_SIZE;
+    size_t pieceStart = begin;
+    uint32_t misses   = 0;
+
+    for (size_t t = begin; t < end; ++t) {
+      for (int corner = 0; corner < 3; ++corner) {
+        uint32_t v = indices[t * 3 + corner];
+        if (time - cacheTime[v] >= VERTEX_CACHE_SIZE) {
+          cacheTime[v] = time++;
+          ++misses;
+        }
+      }
+
+      float pieceAcmr = static_cast<float>(misses) / (t + 1 - pieceStart);
+      if (t + 1 < end && pieceAcmr <= meshAcmr * threshold) {
+        softClusters.push_back(static_cast<uint32_t>(t + 1));
+        pieceStart = t + 1;
+        misses     = 0;
+        time += VERTEX_CACHE_SIZE;
+      }
+    }
+  }
+
+  // the middle of the mesh, which "facing out" is measured from
+  glm::vec3 meshCenter(0.f);
+  float meshArea = 0.f;
+
+  struct ClusterSort {
+    uint32_t begin;
+    uint32_t end;
+    float score;
+  };
+  std::vector<ClusterSort> sorted(softClusters.size());
+  std::vector<glm::vec3> clusterCenters(softClusters.size(), glm::vec3(0.f));
+  std::vector<glm::vec3> clusterNormals(softClusters.size(), glm::vec3(0.f));
+
+  for (size_t c = 0; c < softClusters.size(); ++c) {
+    sorted[c].begin = softClusters[c];
+    sorted[c].end   = c + 1 < softClusters.size() ? softClusters[c + 1]
+                                                  : static_cast<uint32_t>(triangleCount);
+
+    float clusterArea = 0.f;
+    for (uint32_t t = sorted[c].begin; t < sorted[c].end; ++t) {
+      const glm::vec3 &a = vertices[indices[t * 3 + 0]].position;
+      const glm::vec3 &b = vertices[indices[t * 3 + 1]].position;
+      const glm::vec3 &d = vertices[indices[t * 3 + 2]].position;
+
+      // the cross product's length is twice the area, so this is an area weighting
+      glm::vec3 normal = glm::cross(b - a, d - a);
+      float area       = glm::length(normal);
+
+      clusterNormals[c] += normal;
+      clusterCenters[c] += (a + b + d) * (area / 3.f);
+      clusterArea += area;
+    }
+
+    meshCenter += clusterCenters[c];
+    meshArea += clusterArea;
+    if (clusterArea > 0.f) {
+      clusterCenters[c] /= clusterArea;
+    }
+  }
+  if (meshArea > 0.f) {
+    meshCenter /= meshArea;
+  }
+
+  // clusters out on the surface and facing away from the middle are the likely
+  // occluders, so they go first
+  for (size_t c = 0; c < sorted.size(); ++c) {
+    float normalLength = glm::length(clusterNormals[c]);
+    if (normalLength > 0.f) {
+      glm::vec3 outward = clusterCenters[c] - meshCenter;
+      sorted[c].score   = glm::dot(outward, clusterNormals[c]) / normalLength;
+    } else {
+      sorted[c].score = 0.f;
+    }
+  }
+
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const ClusterSort &a, const ClusterSort &b) {
+                     return a.score > b.score;
+                   });
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for (const ClusterSort &cluster : sorted) {
+    result.insert(result.end(), indices.begin() + cluster.begin * 3,
+                  indices.begin() + cluster.end * 3);
+  }
+  indices = std::move(result);
+}
+
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices) {
+  const uint32_t unused = UINT32_MAX;
+  std::vector<uint32_t> remap(vertices.size(), unused);
+
+  std::vector<Vertex> result;
+  result.reserve(vertices.size());
+
+  for (uint32_t &index : indices) {
+    if (remap[index] == unused) {
+      remap[index] = static_cast<uint32_t>(result.size());
+      result.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices = std::move(result);
+}
+
+void optimizeMesh(Mesh &mesh, bool overdraw) {
+  std::vector<uint32_t> clusters;
+  optimizeVertexCache(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_SIZE,
+                      overdraw ? &clusters : nullptr);
+
+  if (overdraw) {
+    optimizeOverdraw(mesh.indices, mesh.vertices, clusters);
+  }
+
+  // this has to go last, since it follows whatever order the triangles ended up in
+  optimizeVertexFetch(mesh.vertices, mesh.indices);
+}
\ No newline at end of file
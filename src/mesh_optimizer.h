@@ -0,0 +1,44 @@
+#pragma once
+#include "mesh.h"
+
+// the post-transform cache size we optimize for. Real hardware varies, but orders tuned
+// for 16 entries hold up well on all of it.
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+// how much worse than the whole mesh a cluster's cache efficiency can get before the
+// overdraw pass stops splitting it further
+constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+// how well an index order uses a FIFO vertex cache
+struct VertexCacheStats {
+  // average cache misses per triangle. 0.5 is the ideal for big grids, 3 is the worst.
+  float acmr;
+  // average transforms per vertex. 1 means every vertex gets shaded exactly once.
+  float atvr;
+};
+
+// Simulate a FIFO cache running through the triangles
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices,
+                                    size_t vertexCount,
+                                    uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorder triangles so vertices get reused while they're still in the cache (Tipsify,
+// from Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw"). If clusters isn't null, it gets the first triangle of every run that
+// started from a cold cache, which is where the overdraw pass is allowed to cut.
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount,
+                         uint32_t cacheSize            = VERTEX_CACHE_SIZE,
+                         std::vector<uint32_t> *clusters = nullptr);
+
+// Reorder the clusters from optimizeVertexCache so the ones facing out from the middle of
+// the mesh get drawn first, and hide more of what comes after. Clusters are split further
+// while that costs less than threshold in cache efficiency.
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<Vertex> &vertices,
+                      const std::vector<uint32_t> &clusters,
+                      float threshold = OVERDRAW_THRESHOLD);
+
+// Put the vertices in the order the indices first use them, so fetching them walks
+// through memory instead of jumping around. Unused vertices get dropped.
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+
+// All of the above, in the order they have to run in
+void optimizeMesh(Mesh &mesh, bool overdraw);
\ No newline at end of file
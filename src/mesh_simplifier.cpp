@@ -0,0 +1,421 @@
+#include "mesh_simplifier.h"
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+// The sum of squared distances to a set of planes, as a symmetric 4x4 matrix: the 3x3
+// part in a, the last column in b and the corner in c. Adding two of them together gives
+// the distances to both sets of planes.
+struct Quadric {
+  double a00, a01, a02, a11, a12, a22;
+  double b0, b1, b2;
+  double c;
+};
+
+// the squared distance to the plane through point with the given unit normal
+Quadric planeQuadric(const glm::vec3 &normal, const glm::vec3 &point) {
+  double x = normal.x, y = normal.y, z = normal.z;
+  double d = -glm::dot(normal, point);
+  return {x * x, x * y, x * z, y * y, y * z, z * z, x * d, y * d, z * d, d * d};
+}
+
+void addQuadric(Quadric &quadric, const Quadric &other) {
+  quadric.a00 += other.a00;
+  quadric.a01 += other.a01;
+  quadric.a02 += other.a02;
+  quadric.a11 += other.a11;
+  quadric.a12 += other.a12;
+  quadric.a22 += other.a22;
+  quadric.b0 += other.b0;
+  quadric.b1 += other.b1;
+  quadric.b2 += other.b2;
+  quadric.c += other.c;
+}
+
+double evaluateQuadric(const Quadric &q, const glm::vec3 &point) {
+  double x = point.x, y = point.y, z = point.z;
+  double error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+                 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+                 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+  // it's a sum of squares, anything under zero is rounding
+  return std::max(error, 0.0);
+}
+
+// moving from's position onto to's, and what that costs in squared distance
+struct Collapse {
+  uint32_t from;
+  uint32_t to;
+  double cost;
+};
+
+// Which vertices share a position, and which positions can't be moved
+struct VertexTopology {
+  // every vertex's stand in for its position, shared by everything at that position
+  std::vector<uint32_t> canonical;
+  // the next vertex at the same position, going round in a loop. There's more than one
+  // wherever there's a seam in the normals or colors, like every corner of a flat shaded
+  // mesh.
+  std::vector<uint32_t> nextWedge;
+  // positions on an edge only one triangle uses, or more than two do. Moving them would
+  // open a hole.
+  std::vector<uint8_t> locked;
+};
+
+VertexTopology findTopology(const std::vector<Vertex> &vertices,
+                            const std::vector<uint32_t> &triangles) {
+  VertexTopology topology;
+  std::vector<uint32_t> &canonical = topology.canonical;
+  std::vector<uint32_t> &nextWedge = topology.nextWedge;
+  std::vector<uint8_t> &locked     = topology.locked;
+  canonical.resize(vertices.size());
+  nextWedge.resize(vertices.size());
+  locked.assign(vertices.size(), 0);
+
+  std::vector<uint32_t> order(vertices.size());
+  std::iota(order.begin(), order.end(), 0);
+  auto positionLess = [&](uint32_t a, uint32_t b) {
+    const glm::vec3 &pa = vertices[a].position;
+    const glm::vec3 &pb = vertices[b].position;
+    if (pa.x != pb.x) {
+      return pa.x < pb.x;
+    }
+    if (pa.y != pb.y) {
+      return pa.y < pb.y;
+    }
+    return pa.z < pb.z;
+  };
+  std::sort(order.begin(), order.end(), positionLess);
+
+  for (size_t i = 0; i < order.size();) {
+    size_t end = i + 1;
+    while (end < order.size() &&
+           vertices[order[end]].position == vertices[order[i]].position) {
+      ++end;
+    }
+    for (size_t j = i; j < end; ++j) {
+      canonical[order[j]] = order[i];
+      nextWedge[order[j]] = order[j + 1 < end ? j + 1 : i];
+    }
+    i = end;
+  }
+
+  // count how many triangles every edge has, by sorting them so repeats end up together.
+  // Going by position, a seam is just another edge with a triangle either side.
+  std::vector<uint64_t> edges;
+  edges.reserve(triangles.size());
+  for (size_t i = 0; i < triangles.size(); i += 3) {
+    for (uint32_t corner = 0; corner < 3; ++corner) {
+      uint32_t a = canonical[triangles[i + corner]];
+      uint32_t b = canonical[triangles[i + (corner + 1) % 3]];
+      edges.push_back(uint64_t(std::min(a, b)) << 32 | std::max(a, b));
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+
+  for (size_t i = 0; i < edges.size();) {
+    size_t end = i + 1;
+    while (end < edges.size() && edges[end] == edges[i]) {
+      ++end;
+    }
+    if (end - i != 2) {
+      locked[edges[i] >> 32]        = 1;
+      locked[edges[i] & 0xffffffff] = 1;
+    }
+    i = end;
+  }
+  return topology;
+}
+
+// How far apart two vertices' normals and colors are. Both are unit-ish, so it's only
+// good for comparing with another one of these.
+float attributeDistance(const Vertex &a, const Vertex &b) {
+  glm::vec3 normal = a.normal - b.normal;
+  glm::vec3 color  = a.color - b.color;
+  return glm::dot(normal, normal) + glm::dot(color, color);
+}
+
+// Which vertex at to's position the wedge ends up on when its position collapses onto
+// to's. Along a seam that's the one it shares a triangle with, on its own side. When
+// nothing at to's position is connected to it (a flat shaded face that's being folded
+// over), it gets merged with whichever one has the closest normal and color.
+uint32_t collapseWedge(uint32_t wedge, uint32_t to, const std::vector<Vertex> &vertices,
+                       const std::vector<uint32_t> &triangles,
+                       const std::vector<uint32_t> &adjacencyOffsets,
+                       const std::vector<uint32_t> &adjacency,
+                       const VertexTopology &topology) {
+  const uint32_t target = topology.canonical[to];
+  for (uint32_t i = adjacencyOffsets[wedge]; i < adjacencyOffsets[wedge + 1]; ++i) {
+    const uint32_t *triangle = &triangles[adjacency[i] * 3];
+    for (uint32_t corner = 0; corner < 3; ++corner) {
+      if (topology.canonical[triangle[corner]] == target) {
+        return triangle[corner];
+      }
+    }
+  }
+
+  uint32_t best      = to;
+  float bestDistance = attributeDistance(vertices[wedge], vertices[to]);
+  for (uint32_t other = topology.nextWedge[to]; other != to;
+       other = topology.nextWedge[other]) {
+    float distance = attributeDistance(vertices[wedge], vertices[other]);
+    if (distance < bestDistance) {
+      best         = other;
+      bestDistance = distance;
+    }
+  }
+  return best;
+}
+
+// Would moving from onto to turn any of from's triangles over? Triangles with to's
+// position in them get squashed flat and disappear, so they don't count.
+bool collapseFlips(const Collapse &collapse, const std::vector<Vertex> &vertices,
+                   const std::vector<uint32_t> &triangles,
+                   const std::vector<uint32_t> &adjacencyOffsets,
+                   const std::vector<uint32_t> &adjacency,
+                   const std::vector<uint32_t> &canonical) {
+  const glm::vec3 &target = vertices[collapse.to].position;
+  const uint32_t to       = canonical[collapse.to];
+
+  for (uint32_t i = adjacencyOffsets[collapse.from];
+       i < adjacencyOffsets[collapse.from + 1]; ++i) {
+    const uint32_t *triangle = &triangles[adjacency[i] * 3];
+    if (canonical[triangle[0]] == to || canonical[triangle[1]] == to ||
+        canonical[triangle[2]] == to) {
+      continue;
+    }
+
+    glm::vec3 before[3];
+    glm::vec3 after[3];
+    for (uint32_t corner = 0; corner < 3; ++corner) {
+      before[corner] = vertices[triangle[corner]].position;
+      after[corner]  = triangle[corner] == collapse.from ? target : before[corner];
+    }
+
+    glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+    glm::vec3 normalAfter  = glm::cross(after[1] - after[0], after[2] - after[0]);
+    if (glm::dot(normalBefore, normalAfter) <= 0.f) {
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace
+
+std::vector<SimplifiedLod> simplifyMesh(const std::vector<Vertex> &vertices,
+                                        const uint32_t *indices, size_t indexCount,
+                                        const std::vector<size_t> &targetIndexCounts,
+                                        float maxError) {
+  std::vector<SimplifiedLod> levels;
+  std::vector<uint32_t> triangles(indices, indices + indexCount);
+  const size_t vertexCount = vertices.size();
+
+  const VertexTopology topology          = findTopology(vertices, triangles);
+  const std::vector<uint32_t> &canonical = topology.canonical;
+  const std::vector<uint32_t> &nextWedge = topology.nextWedge;
+  const std::vector<uint8_t> &locked     = topology.locked;
+
+  // Every position starts out with the planes of the triangles around it. Collapses move
+  // whole positions, so that's where the quadrics live too, not on each vertex there.
+  std::vector<Quadric> quadrics(vertexCount, Quadric{});
+  for (size_t i = 0; i < triangles.size(); i += 3) {
+    const glm::vec3 &a = vertices[triangles[i]].position;
+    const glm::vec3 &b = vertices[triangles[i + 1]].position;
+    const glm::vec3 &c = vertices[triangles[i + 2]].position;
+
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    float length     = glm::length(normal);
+    if (length == 0.f) {
+      continue;
+    }
+
+    Quadric plane = planeQuadric(normal / length, a);
+    for (uint32_t corner = 0; corner < 3; ++corner) {
+      addQuadric(quadrics[canonical[triangles[i + corner]]], plane);
+    }
+  }
+
+  const double maxCost = double(maxError) * maxError;
+  // the worst collapse so far, which is how far off the current triangles are
+  double error = 0.0;
+  bool stuck   = false;
+
+  std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+  std::vector<uint32_t> adjacency;
+  std::vector<uint32_t> remap(vertexCount);
+  std::vector<uint8_t> touched(vertexCount);
+  std::vector<Collapse> collapses;
+  std::vector<Collapse> wedgeMoves;
+
+  for (size_t target : targetIndexCounts) {
+    // A pass at a time, each doing the cheapest collapses that don't touch any position
+    // another one in the same pass already has. That keeps every cost and flip test in a
+    // pass valid without having to update anything until the end of it.
+    while (!stuck && triangles.size() > target) {
+      std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+      for (uint32_t index : triangles) {
+        ++adjacencyOffsets[index + 1];
+      }
+      std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(),
+                       adjacencyOffsets.begin());
+      adjacency.resize(triangles.size());
+      std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+      for (size_t i = 0; i < triangles.size(); ++i) {
+        adjacency[fill[triangles[i]]++] = static_cast<uint32_t>(i / 3);
+      }
+
+      // every edge, collapsed whichever way is cheaper. Inner edges show up twice, but
+      // the second one is always skipped since the first touched both ends.
+      collapses.clear();
+      for (size_t i = 0; i < triangles.size(); i += 3) {
+        for (uint32_t corner = 0; corner < 3; ++corner) {
+          uint32_t a = triangles[i + corner];
+          uint32_t b = triangles[i + (corner + 1) % 3];
+
+          Quadric both = quadrics[canonical[a]];
+          addQuadric(both, quadrics[canonical[b]]);
+
+          Collapse collapse{a, b, INFINITY};
+          if (!locked[canonical[a]]) {
+            collapse.cost = evaluateQuadric(both, vertices[b].position);
+          }
+          if (!locked[canonical[b]]) {
+            double cost = evaluateQuadric(both, vertices[a].position);
+            if (cost < collapse.cost) {
+              collapse = {b, a, cost};
+            }
+          }
+          if (collapse.cost <= maxCost) {
+            collapses.push_back(collapse);
+          }
+        }
+      }
+      std::sort(collapses.begin(), collapses.end(),
+                [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+      // each collapse takes out two triangles, more or less
+      size_t goal = std::max<size_t>((triangles.size() - target) / 6, 1);
+      size_t done = 0;
+
+      std::iota(remap.begin(), remap.end(), 0);
+      std::fill(touched.begin(), touched.end(), 0);
+      for (const Collapse &collapse : collapses) {
+        if (done >= goal) {
+          break;
+        }
+        const uint32_t from = canonical[collapse.from];
+        const uint32_t to   = canonical[collapse.to];
+        if (touched[from] || touched[to]) {
+          continue;
+        }
+
+        // every vertex at from's position goes, each onto its own vertex at to's
+        wedgeMoves.clear();
+        bool flips     = false;
+        uint32_t wedge = collapse.from;
+        do {
+          Collapse move = {wedge,
+                           collapseWedge(wedge, collapse.to, vertices, triangles,
+                                         adjacencyOffsets, adjacency, topology),
+                           0.0};
+          flips = flips || collapseFlips(move, vertices, triangles, adjacencyOffsets,
+                                         adjacency, canonical);
+          wedgeMoves.push_back(move);
+          wedge = nextWedge[wedge];
+        } while (wedge != collapse.from && !flips);
+        if (flips) {
+          continue;
+        }
+
+        addQuadric(quadrics[to], quadrics[from]);
+        error = std::max(error, collapse.cost);
+        ++done;
+
+        // everything around from gets to as a neighbour, so their tests are stale now
+        touched[to] = 1;
+        for (const Collapse &move : wedgeMoves) {
+          remap[move.from] = move.to;
+          for (uint32_t i = adjacencyOffsets[move.from];
+               i < adjacencyOffsets[move.from + 1]; ++i) {
+            const uint32_t *triangle        = &triangles[adjacency[i] * 3];
+            touched[canonical[triangle[0]]] = 1;
+            touched[canonical[triangle[1]]] = 1;
+            touched[canonical[triangle[2]]] = 1;
+          }
+        }
+      }
+
+      if (done == 0) {
+        stuck = true;
+        break;
+      }
+
+      // move the collapsed vertices, and drop the triangles that got squashed flat. With
+      // seams, that can be two different vertices ending up at the same position.
+      size_t kept = 0;
+      for (size_t i = 0; i < triangles.size(); i += 3) {
+        uint32_t a = remap[triangles[i]];
+        uint32_t b = remap[triangles[i + 1]];
+        uint32_t c = remap[triangles[i + 2]];
+        if (canonical[a] == canonical[b] || canonical[b] == canonical[c] ||
+            canonical[c] == canonical[a]) {
+          continue;
+        }
+        triangles[kept++] = a;
+        triangles[kept++] = b;
+        triangles[kept++] = c;
+      }
+      triangles.resize(kept);
+    }
+
+    levels.push_back({triangles, static_cast<float>(std::sqrt(error))});
+    if (stuck) {
+      break;
+    }
+  }
+  return levels;
+}
+
+void generateLods(Mesh &mesh) {
+  if (mesh.lods.empty()) {
+    mesh.lods.push_back({0, static_cast<uint32_t>(mesh.indices.size()), 0.f, 0, 0});
+  }
+  // the levels (and meshlets) get made over from the first one
+  mesh.lods.resize(1);
+  mesh.meshlets.clear();
+  const MeshLod base = mesh.lods[0];
+
+  std::vector<size_t> targets;
+  size_t triangleCount = base.indexCount / 3;
+  while (targets.size() + 1 < MESH_MAX_LODS) {
+    triangleCount = static_cast<size_t>(triangleCount * LOD_REDUCTION);
+    if (triangleCount < LOD_MIN_TRIANGLES) {
+      break;
+    }
+    targets.push_back(triangleCount * 3);
+  }
+  if (targets.empty()) {
+    return;
+  }
+
+  mesh.computeBounds();
+  float maxError = LOD_MAX_ERROR * mesh.boundingSphere().w;
+  std::vector<SimplifiedLod> levels =
+      simplifyMesh(mesh.vertices, mesh.indices.data() + base.firstIndex, base.indexCount,
+                   targets, maxError);
+
+  size_t previousCount = base.indexCount;
+  for (SimplifiedLod &level : levels) {
+    if (level.indices.size() > previousCount * LOD_MIN_REDUCTION) {
+      break;
+    }
+    optimizeVertexCache(level.indices, mesh.vertices.size());
+
+    mesh.lods.push_back({static_cast<uint32_t>(mesh.indices.size()),
+                         static_cast<uint32_t>(level.indices.size()), level.error, 0, 0});
+    mesh.indices.insert(mesh.indices.end(), level.indices.begin(), level.indices.end());
+    previousCount = level.indices.size();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+#include "mesh.h"
+
+// every level after the first has at most this much of the one before's triangles
+constexpr float LOD_REDUCTION = 0.5f;
+// and if it can't get below this much, it's not worth having and the chain stops
+constexpr float LOD_MIN_REDUCTION = 0.85f;
+// nothing gets simplified further than this many triangles
+constexpr uint32_t LOD_MIN_TRIANGLES = 32;
+// how far off a level can be before it's too far gone to use, as a fraction of the
+// mesh's bounding sphere
+constexpr float LOD_MAX_ERROR = 0.1f;
+
+// one level out of the simplifier
+struct SimplifiedLod {
+  std::vector<uint32_t> indices;
+  // how far it's off from the triangles that went in, in the same units as positions
+  float error;
+};
+
+// Simplify triangles with quadric error metrics (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics"), collapsing edges until there are at most
+// targetIndexCounts[k] indices left, for every k in turn. Collapses only ever move a
+// vertex onto one of its neighbours, so every level uses the same vertices. Everything at
+// the same position (both sides of a seam in the normals or colors) moves together, so
+// seams don't open up cracks, and vertices on borders stay put, so levels don't pull
+// away from their edges. Stops early (with fewer levels) once the next collapse would be
+// off by more than maxError.
+std::vector<SimplifiedLod> simplifyMesh(const std::vector<Vertex> &vertices,
+                                        const uint32_t *indices, size_t indexCount,
+                                        const std::vector<size_t> &targetIndexCounts,
+                                        float maxError);
+
+// Fill in mesh.lods, up to MESH_MAX_LODS of them, from its first level (or all of its
+// indices). The new levels' indices get optimized for the vertex cache and go after the
+// others in mesh.indices, so every level is one run of the same index data.
+void generateLods(Mesh &mesh);
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "mesh_streamer.h"
+
+#include "cpu_profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace {
+// std::*_heap keeps the biggest on top, so "less" is farther away
+bool fartherAway(const StreamRequest &a, const StreamRequest &b) {
+  return a.distance > b.distance;
+}
+} // namespace
+
+void MeshStreamer::init(uint32_t threadCount, StreamLoadFunction loadFunction) {
+  load     = std::move(loadFunction);
+  quitting = false;
+
+  for (uint32_t i = 0; i < threadCount; ++i) {
+    threads.emplace_back(&MeshStreamer::workerLoop, this, i);
+  }
+}
+
+void MeshStreamer::cleanup() {
+  {
+    std::lock_guard<std::mutex> lock(requestMutex);
+    quitting = true;
+    requests.clear();
+  }
+  requestAdded.notify_all();
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  threads.clear();
+}
+
+void MeshStreamer::request(uint32_t id, const std::string &path,
+                           const glm::vec3 &position) {
+  {
+    std::lock_guard<std::mutex> lock(requestMutex);
+    requests.push_back({id, path, position, glm::length(position - viewerPosition)});
+    std::push_heap(requests.begin(), requests.end(), fartherAway);
+  }
+  requestAdded.notify_one();
+}
+
+bool MeshStreamer::cancel(uint32_t id) {
+  std::lock_guard<std::mutex> lock(requestMutex);
+  auto found =
+      std::find_if(requests.begin(), requests.end(),
+                   [id](const StreamRequest &request) { return request.id == id; });
+  if (found == requests.end()) {
+    return false;
+  }
+
+  requests.erase(found);
+  std::make_heap(requests.begin(), requests.end(), fartherAway);
+  return true;
+}
+
+void MeshStreamer::prioritize(const glm::vec3 &viewer) {
+  std::lock_guard<std::mutex> lock(requestMutex);
+  viewerPosition = viewer;
+  for (StreamRequest &request : requests) {
+    request.distance = glm::length(request.position - viewer);
+  }
+  std::make_heap(requests.begin(), requests.end(), fartherAway);
+}
+
+// Sleep until there's a request, load the nearest one, repeat
+void MeshStreamer::workerLoop(uint32_t threadIndex) {
+  std::string threadName = "streaming worker " + std::to_string(threadIndex);
+  CpuProfiler::setThreadName(threadName.c_str());
+
+  while (true) {
+    StreamRequest request;
+    {
+      std::unique_lock<std::mutex> lock(requestMutex);
+      requestAdded.wait(lock, [this] { return quitting || !requests.empty(); });
+      if (quitting) {
+        return;
+      }
+
+      std::pop_heap(requests.begin(), requests.end(), fartherAway);
+      request = std::move(requests.back());
+      requests.pop_back();
+    }
+
+    auto result = std::make_unique<StreamedMesh>();
+    result->id  = request.id;
+    {
+      CPU_ZONE("stream mesh");
+      auto start = std::chrono::steady_clock::now();
+      // a bad file shouldn't take the whole app down with this thread, so it just comes
+      // back unloaded, and whatever's standing in for it stays
+      try {
+        load(request, *result);
+      } catch (const std::exception &e) {
+        std::cerr << "Loading " << request.path << " failed: " << e.what() << std::endl;
+        result     = std::make_unique<StreamedMesh>();
+        result->id = request.id;
+      }
+
+      std::chrono::duration<double, std::milli> loadTime =
+          std::chrono::steady_clock::now() - start;
+      result->loadTime = loadTime.count();
+    }
+    finished.push(std::move(result));
+  }
+}
\ No newline at end of file
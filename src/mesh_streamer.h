@@ -0,0 +1,78 @@
+#pragma once
+#include "mesh.h"
+#include "mesh_bake.h"
+#include "mpsc_queue.h"
+#include "vk_types.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// how many threads load meshes in the background. The .obj parser already spreads itself
+// over every core, so these mostly just keep the disk busy.
+constexpr uint32_t STREAMING_THREAD_COUNT = 2;
+
+// a mesh someone wants loaded, and where it's wanted
+struct StreamRequest {
+  // whatever the requester uses to tell its meshes apart
+  uint32_t id;
+  std::string path;
+  glm::vec3 position;
+  // how far that is from the viewer, nearest gets loaded first
+  float distance;
+};
+
+// What a loading thread hands back: the mesh, and its data packed for the mesh pool.
+// Baked meshes keep their file mapped here, and upload points straight into it.
+struct StreamedMesh {
+  uint32_t id;
+  // false if the file couldn't be loaded, in which case nothing else is filled in
+  bool loaded{false};
+  Mesh mesh;
+  MeshUploadData upload;
+  BakedMesh baked;
+  // how long it took, in ms
+  double loadTime{0.0};
+};
+
+// how a request gets turned into a mesh, on one of the loading threads
+using StreamLoadFunction = std::function<void(const StreamRequest &, StreamedMesh &)>;
+
+// Loads meshes on background threads, nearest first. Requests wait in a heap ordered by
+// their distance to the viewer, which gets re-sorted whenever the viewer moves, and
+// finished loads come back through a lock-free queue the main thread drains whenever it
+// gets around to it, so the loading threads never wait on it.
+class MeshStreamer {
+public:
+  void init(uint32_t threadCount, StreamLoadFunction loadFunction);
+  // Stop the threads, once they've finished what they're in the middle of. Whatever's
+  // still waiting gets dropped.
+  void cleanup();
+
+  // queue a mesh up to be loaded
+  void request(uint32_t id, const std::string &path, const glm::vec3 &position);
+  // Take a request back out, if no thread has picked it up yet. Returns false if it's
+  // already loading (or loaded), in which case it'll still come out of poll().
+  bool cancel(uint32_t id);
+  // move the viewer, re-sorting whatever's waiting by its distance from there
+  void prioritize(const glm::vec3 &viewer);
+
+  // the next finished load, or nullptr if there isn't one. Only from one thread.
+  std::unique_ptr<StreamedMesh> poll() { return finished.pop(); }
+
+private:
+  void workerLoop(uint32_t threadIndex);
+
+  StreamLoadFunction load;
+  std::vector<std::thread> threads;
+
+  // a heap, nearest request on top
+  std::vector<StreamRequest> requests;
+  glm::vec3 viewerPosition{0.f};
+  std::mutex requestMutex;
+  std::condition_variable requestAdded;
+  bool quitting{false};
+
+  MpscQueue<StreamedMesh> finished;
+};
\ No newline at end of file
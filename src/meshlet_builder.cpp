@@ -0,0 +1,157 @@
+#include "meshlet_builder.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// how many of a triangle's vertices meshlet doesn't have yet, with a vertex used twice
+// by the triangle only counted once
+uint32_t countNewVertices(const uint32_t *triangle,
+                          const std::vector<uint32_t> &vertexMeshlets, uint32_t meshlet) {
+  uint32_t newVertices = 0;
+  for (uint32_t corner = 0; corner < 3; ++corner) {
+    uint32_t vertex = triangle[corner];
+    bool repeated   = (corner > 0 && vertex == triangle[0]) ||
+                    (corner > 1 && vertex == triangle[1]);
+    newVertices += vertexMeshlets[vertex] != meshlet && !repeated;
+  }
+  return newVertices;
+}
+
+// fill in a finished meshlet's sphere and cone from its triangles
+void computeMeshletBounds(Meshlet &meshlet, const std::vector<Vertex> &vertices,
+                          const std::vector<uint32_t> &indices) {
+  const uint32_t *triangles = indices.data() + meshlet.firstIndex;
+
+  // a sphere around the box, same as the whole mesh gets
+  glm::vec3 boundsMin(INFINITY);
+  glm::vec3 boundsMax(-INFINITY);
+  for (uint32_t i = 0; i < meshlet.indexCount; ++i) {
+    boundsMin = glm::min(boundsMin, vertices[triangles[i]].position);
+    boundsMax = glm::max(boundsMax, vertices[triangles[i]].position);
+  }
+  glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+
+  float radius = 0.f;
+  for (uint32_t i = 0; i < meshlet.indexCount; ++i) {
+    radius = std::max(radius, glm::length(vertices[triangles[i]].position - center));
+  }
+  meshlet.sphere = glm::vec4(center, radius);
+
+  // The cone's axis is the average face normal, and it's as wide as the face furthest
+  // from that. Degenerate triangles never get drawn, so they don't count.
+  std::vector<glm::vec3> normals;
+  normals.reserve(meshlet.indexCount / 3);
+  glm::vec3 axis(0.f);
+  for (uint32_t i = 0; i < meshlet.indexCount; i += 3) {
+    glm::vec3 a      = vertices[triangles[i]].position;
+    glm::vec3 b      = vertices[triangles[i + 1]].position;
+    glm::vec3 c      = vertices[triangles[i + 2]].position;
+    glm::vec3 normal = glm::cross(b - a, c - a);
+
+    float length = glm::length(normal);
+    if (length > 0.f) {
+      normals.push_back(normal / length);
+      axis += normals.back();
+    }
+  }
+
+  float axisLength = glm::length(axis);
+  if (axisLength == 0.f) {
+    meshlet.cone = glm::vec4(0.f, 0.f, 1.f, 1.f);
+    return;
+  }
+  axis /= axisLength;
+
+  float minDot = 1.f;
+  for (const glm::vec3 &normal : normals) {
+    minDot = std::min(minDot, glm::dot(axis, normal));
+  }
+
+  // The cull pass wants the sine of the spread, so it can test against the angle the
+  // cluster is seen at without any trig of its own
+  float spread = 1.f;
+  if (minDot > MESHLET_MIN_CONE_SPREAD) {
+    spread = std::sqrt(1.f - minDot * minDot);
+  }
+  meshlet.cone = glm::vec4(axis, spread);
+}
+} // namespace
+
+std::vector<Meshlet> buildMeshlets(const std::vector<Vertex> &vertices,
+                                   const std::vector<uint32_t> &indices,
+                                   uint32_t firstIndex, uint32_t indexCount,
+                                   uint32_t maxVertices, uint32_t maxTriangles) {
+  std::vector<Meshlet> meshlets;
+  if (indexCount == 0) {
+    return meshlets;
+  }
+
+  // which meshlet last took each vertex, so counting the new ones a triangle brings in
+  // is just a compare
+  std::vector<uint32_t> vertexMeshlets(vertices.size(), UINT32_MAX);
+
+  Meshlet current{};
+  current.firstIndex = firstIndex;
+
+  for (uint32_t i = firstIndex; i < firstIndex + indexCount; i += 3) {
+    const uint32_t *triangle = &indices[i];
+    uint32_t meshletIndex    = static_cast<uint32_t>(meshlets.size());
+
+    uint32_t newVertices = countNewVertices(triangle, vertexMeshlets, meshletIndex);
+
+    // start a new one when this triangle doesn't fit
+    if (current.vertexCount + newVertices > maxVertices ||
+        current.indexCount / 3 + 1 > maxTriangles) {
+      meshlets.push_back(current);
+      current            = Meshlet{};
+      current.firstIndex = i;
+      newVertices        = countNewVertices(triangle, vertexMeshlets, ++meshletIndex);
+    }
+
+    for (uint32_t corner = 0; corner < 3; ++corner) {
+      vertexMeshlets[triangle[corner]] = meshletIndex;
+    }
+    current.vertexCount += newVertices;
+    current.indexCount += 3;
+  }
+  meshlets.push_back(current);
+
+  for (Meshlet &meshlet : meshlets) {
+    computeMeshletBounds(meshlet, vertices, indices);
+  }
+  return meshlets;
+}
+
+void buildMeshlets(Mesh &mesh) {
+  if (mesh.lods.empty()) {
+    mesh.lods.push_back({0, static_cast<uint32_t>(mesh.indices.size()), 0.f, 0, 0});
+  }
+
+  // every level gets its own, one level after another
+  mesh.meshlets.clear();
+  for (MeshLod &lod : mesh.lods) {
+    std::vector<Meshlet> meshlets =
+        buildMeshlets(mesh.vertices, mesh.indices, lod.firstIndex, lod.indexCount);
+    lod.firstMeshlet = static_cast<uint32_t>(mesh.meshlets.size());
+    lod.meshletCount = static_cast<uint32_t>(meshlets.size());
+    mesh.meshlets.insert(mesh.meshlets.end(), meshlets.begin(), meshlets.end());
+  }
+}
+
+std::vector<Meshlet> packMeshlets(const Mesh &mesh) {
+  glm::mat4 quantize     = glm::inverse(mesh.dequantize);
+  glm::mat3 quantizeAxis = glm::mat3(quantize);
+
+  std::vector<Meshlet> packed(mesh.meshlets);
+  for (Meshlet &meshlet : packed) {
+    glm::vec3 center = glm::vec3(quantize * glm::vec4(glm::vec3(meshlet.sphere), 1.f));
+    // the cull pass normalizes the axis once it's in view space, so it doesn't matter
+    // that this squashes it
+    glm::vec3 axis = quantizeAxis * glm::vec3(meshlet.cone);
+
+    meshlet.sphere = glm::vec4(center, meshlet.sphere.w);
+    meshlet.cone   = glm::vec4(axis, meshlet.cone.w);
+  }
+  return packed;
+}
\ No newline at end of file
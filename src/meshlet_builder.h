@@ -0,0 +1,25 @@
+#pragma once
+#include "mesh.h"
+
+// below this, a cone is so wide (about 84 degrees from its axis) that hardly anything
+// could ever see only its back, so it's not worth testing
+constexpr float MESHLET_MIN_CONE_SPREAD = 0.1f;
+
+// Split indices[firstIndex, firstIndex + indexCount) into meshlets of at most
+// maxVertices different vertices and maxTriangles triangles. Triangles stay in the order
+// they're in, so run the vertex cache optimizer first: its order keeps neighbours
+// together, which is what makes the clusters tight.
+std::vector<Meshlet> buildMeshlets(const std::vector<Vertex> &vertices,
+                                   const std::vector<uint32_t> &indices,
+                                   uint32_t firstIndex, uint32_t indexCount,
+                                   uint32_t maxVertices  = MESHLET_MAX_VERTICES,
+                                   uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// fill in mesh.meshlets from every one of its levels
+void buildMeshlets(Mesh &mesh);
+
+// The mesh's meshlets the way the cull pass wants them: centers and cone axes in the
+// space its uploaded positions are in, so the object's model matrix (with the dequantize
+// folded in) takes them to world space. Radii and cone angles stay in model space, which
+// holds up as long as objects are only ever scaled the same along every axis.
+std::vector<Meshlet> packMeshlets(const Mesh &mesh);
\ No newline at end of file
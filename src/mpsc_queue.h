@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <memory>
+
+// A lock-free queue any number of threads can push onto, and one thread pops off of.
+// It's a linked list with a dummy node at the front: pushing swaps the new node in as the
+// back and then links the old back to it, and popping moves the front past the dummy,
+// so the consumer never touches what producers do. Between those two steps of a push the
+// list is briefly cut short, and pop() just doesn't see that item yet.
+template <typename T> class MpscQueue {
+public:
+  MpscQueue() : back(new Node), front(back.load()) {}
+  ~MpscQueue() {
+    while (pop()) {
+    }
+    delete front;
+  }
+
+  MpscQueue(const MpscQueue &)            = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  // from any thread
+  void push(std::unique_ptr<T> value) {
+    Node *node  = new Node;
+    node->value = std::move(value);
+
+    Node *previous = back.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+  }
+
+  // Only ever from the one consumer thread. Returns nullptr when there's nothing there
+  // (yet).
+  std::unique_ptr<T> pop() {
+    Node *next = front->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      return nullptr;
+    }
+
+    // next becomes the new dummy, once its value's been taken out
+    delete front;
+    front = next;
+    return std::move(next->value);
+  }
+
+private:
+  struct Node {
+    std::atomic<Node *> next{nullptr};
+    std::unique_ptr<T> value;
+  };
+
+  // where producers add on
+  std::atomic<Node *> back;
+  // the dummy, which only the consumer touches
+  Node *front;
+};
\ No newline at end of file
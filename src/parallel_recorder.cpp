@@ -0,0 +1,153 @@
+#include "parallel_recorder.h"
+
+#include "cpu_profiler.h"
+
+#include <exception>
+
+// Make a command pool per thread per frame. The buffers come later, as slices need them.
+void ParallelRecorder::init(VkDevice device, uint32_t queueFamily,
+                            uint32_t framesInFlight, JobSystem &jobs) {
+  this->device = device;
+  this->jobs   = &jobs;
+
+  // the buffers get rerecorded from scratch every frame, and reset a whole pool at once
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.pNext            = nullptr;
+  poolInfo.queueFamilyIndex = queueFamily;
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+  threads = std::vector<ThreadData>(jobs.getThreadCount());
+
+  for (auto &thread : threads) {
+    thread.pools.resize(framesInFlight);
+    thread.buffers.resize(framesInFlight);
+    thread.buffersUsed.resize(framesInFlight);
+
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+      if (vkCreateCommandPool(device, &poolInfo, nullptr, &thread.pools[i]) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("Failed to create recording thread command pool!");
+      }
+    }
+  }
+}
+
+// Free the pools. The gpu has to be done with the buffers.
+void ParallelRecorder::cleanup() {
+  for (auto &thread : threads) {
+    // destroying the pool frees its buffers too
+    for (VkCommandPool pool : thread.pools) {
+      vkDestroyCommandPool(device, pool, nullptr);
+    }
+  }
+  threads.clear();
+  jobs = nullptr;
+}
+
+std::vector<VkCommandBuffer>
+ParallelRecorder::record(uint32_t frameSlot, VkRenderPass renderPass,
+                         VkFramebuffer framebuffer, size_t drawCount,
+                         const RecordFunction &recordFunction) {
+  // tell the secondary buffers which pass they'll be running inside of
+  VkCommandBufferInheritanceInfo inheritance{};
+  inheritance.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritance.pNext       = nullptr;
+  inheritance.renderPass  = renderPass;
+  inheritance.subpass     = 0;
+  inheritance.framebuffer = framebuffer;
+
+  // throw out last time's commands in one go, before anyone starts on this time's
+  for (auto &thread : threads) {
+    vkResetCommandPool(device, thread.pools[frameSlot], 0);
+    thread.buffersUsed[frameSlot] = 0;
+  }
+
+  // One even slice per thread, though whoever gets to them first records them. An
+  // exception can't leave a job without taking the process down, so each slice keeps
+  // whatever it threw for this thread to rethrow once they're all done.
+  const size_t sliceCount = threads.size();
+  std::vector<VkCommandBuffer> slices(sliceCount, VK_NULL_HANDLE);
+  std::vector<std::exception_ptr> errors(sliceCount);
+  jobs->parallelFor(sliceCount, 1, [&](size_t firstSlice, size_t endSlice) {
+    for (size_t slice = firstSlice; slice < endSlice; ++slice) {
+      size_t begin = drawCount * slice / sliceCount;
+      size_t end   = drawCount * (slice + 1) / sliceCount;
+      if (begin == end) {
+        continue;
+      }
+      try {
+        slices[slice] =
+            recordSlice(frameSlot, inheritance, begin, end, recordFunction);
+      } catch (...) {
+        errors[slice] = std::current_exception();
+      }
+    }
+  });
+
+  for (const std::exception_ptr &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // slices that came out empty didn't record anything, so leave them out
+  std::vector<VkCommandBuffer> secondaries;
+  for (VkCommandBuffer slice : slices) {
+    if (slice != VK_NULL_HANDLE) {
+      secondaries.push_back(slice);
+    }
+  }
+  return secondaries;
+}
+
+VkCommandBuffer
+ParallelRecorder::recordSlice(uint32_t frameSlot,
+                              const VkCommandBufferInheritanceInfo &inheritance,
+                              size_t begin, size_t end,
+                              const RecordFunction &recordFunction) {
+  CPU_ZONE("record slice");
+
+  // only this thread ever touches its own pools
+  ThreadData &thread = threads[jobs->getThreadIndex()];
+  std::vector<VkCommandBuffer> &buffers = thread.buffers[frameSlot];
+  size_t &used                          = thread.buffersUsed[frameSlot];
+
+  if (used == buffers.size()) {
+    VkCommandBufferAllocateInfo commandBufferInfo{};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferInfo.pNext = nullptr;
+
+    commandBufferInfo.commandPool        = thread.pools[frameSlot];
+    commandBufferInfo.commandBufferCount = 1;
+    // secondary, so it can be run from inside the primary buffer's render pass
+    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+    VkCommandBuffer buffer;
+    if (vkAllocateCommandBuffers(device, &commandBufferInfo, &buffer) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate secondary command buffer!");
+    }
+    buffers.push_back(buffer);
+  }
+  VkCommandBuffer cmd = buffers[used++];
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.pNext = nullptr;
+
+  // continue means the whole buffer runs inside the render pass from the inheritance
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                    VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  beginInfo.pInheritanceInfo = &inheritance;
+
+  if (vkBeginCommandBuffer(cmd, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to start recording a secondary command buffer!");
+  }
+
+  recordFunction(cmd, begin, end);
+
+  if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to end a secondary command buffer!");
+  }
+  return cmd;
+}
\ No newline at end of file
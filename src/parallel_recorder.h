@@ -0,0 +1,51 @@
+#pragma once
+#include "job_system.h"
+#include "vk_types.h"
+
+// records a slice [begin, end) of the draw list into a command buffer
+using RecordFunction = std::function<void(VkCommandBuffer cmd, size_t begin, size_t end)>;
+
+// Splits recording of a render pass's draws into slices, spread over the job system's
+// threads. Every thread owns a command pool per frame in flight (pools can't be touched
+// by two threads at once), and records each slice it picks up into a secondary command
+// buffer from its own pool, which the primary buffer then runs with
+// vkCmdExecuteCommands.
+class ParallelRecorder {
+public:
+  void init(VkDevice device, uint32_t queueFamily, uint32_t framesInFlight,
+            JobSystem &jobs);
+  void cleanup();
+
+  uint32_t getThreadCount() { return static_cast<uint32_t>(threads.size()); }
+
+  // Record drawCount draws into secondary buffers, all inside the given render pass and
+  // framebuffer, and return the ones that ended up with work in them, in draw order.
+  // The frame slot's fence has to have been waited on, since this resets its pools. If
+  // recording a slice throws, it gets rethrown here once every slice is done.
+  std::vector<VkCommandBuffer> record(uint32_t frameSlot, VkRenderPass renderPass,
+                                      VkFramebuffer framebuffer, size_t drawCount,
+                                      const RecordFunction &recordFunction);
+
+private:
+  // everything one job system thread records with
+  struct ThreadData {
+    // one pool per frame in flight
+    std::vector<VkCommandPool> pools;
+    // the secondary buffers allocated from each pool so far, and how many of them this
+    // frame's slices have used. A thread picks up however many slices it gets to, so
+    // they're allocated as they're needed and kept around after.
+    std::vector<std::vector<VkCommandBuffer>> buffers;
+    std::vector<size_t> buffersUsed;
+  };
+
+  // record draws [begin, end) on whichever thread this is, into its next free buffer
+  VkCommandBuffer recordSlice(uint32_t frameSlot,
+                              const VkCommandBufferInheritanceInfo &inheritance,
+                              size_t begin, size_t end,
+                              const RecordFunction &recordFunction);
+
+  VkDevice device;
+  JobSystem *jobs{nullptr};
+  // indexed by the job system's thread index
+  std::vector<ThreadData> threads;
+};
\ No newline at end of file
@@ -11,6 +11,14 @@ VkPipeline PipelineBuilder::buildPipeline(VkDevice device, VkRenderPass renderPa
   viewportInfo.scissorCount  = 1;
   viewportInfo.pScissors     = &scissor;
 
+  // anything dynamic gets ignored above, and has to be set in the command buffer
+  VkPipelineDynamicStateCreateInfo dynamicInfo{};
+  dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicInfo.pNext = nullptr;
+
+  dynamicInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+  dynamicInfo.pDynamicStates    = dynamicStates.data();
+
   // set up dummy color blend
   VkPipelineColorBlendStateCreateInfo colorBlending{};
   colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -32,14 +40,16 @@ VkPipeline PipelineBuilder::buildPipeline(VkDevice device, VkRenderPass renderPa
   pipelineInfo.pViewportState      = &viewportInfo;
   pipelineInfo.pRasterizationState = &rasterizer;
   pipelineInfo.pMultisampleState   = &multisampling;
+  pipelineInfo.pDepthStencilState  = &depthStencil;
   pipelineInfo.pColorBlendState    = &colorBlending;
+  pipelineInfo.pDynamicState       = dynamicStates.empty() ? nullptr : &dynamicInfo;
   pipelineInfo.layout              = pipelineLayout;
   pipelineInfo.renderPass          = renderPass;
   pipelineInfo.subpass             = 0;
   pipelineInfo.basePipelineHandle  = VK_NULL_HANDLE;
 
   VkPipeline newPipeline;
-  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr,
+  if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr,
                                 &newPipeline) != VK_SUCCESS) {
     std::cout << "Failed to create pipeline!\n";
     return VK_NULL_HANDLE;
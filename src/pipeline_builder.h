@@ -10,11 +10,20 @@ public:
   VkViewport viewport;
   VkRect2D scissor;
 
+  // state that gets set while recording instead of baked in, e.g. the viewport and
+  // scissor, so the pipeline doesn't care what size the window is
+  std::vector<VkDynamicState> dynamicStates;
+
   VkPipelineRasterizationStateCreateInfo rasterizer;
 
+  VkPipelineDepthStencilStateCreateInfo depthStencil;
+
   VkPipelineColorBlendAttachmentState colorBlendAttachment;
   VkPipelineMultisampleStateCreateInfo multisampling;
   VkPipelineLayout pipelineLayout;
 
+  // lets the driver reuse compiled pipelines. Optional.
+  VkPipelineCache pipelineCache{VK_NULL_HANDLE};
+
   VkPipeline buildPipeline(VkDevice device, VkRenderPass pass);
 };
\ No newline at end of file
@@ -0,0 +1,369 @@
+#include "scene_bvh.h"
+
+namespace {
+// what classifyBox returns for a box that's wholly outside a plane
+constexpr uint32_t BOX_OUTSIDE = UINT32_MAX;
+// every one of the six frustum planes
+constexpr uint32_t ALL_PLANES = 0x3f;
+// the root has no parent
+constexpr uint32_t NO_NODE = UINT32_MAX;
+
+// Test a box against the planes whose bits are set. Returns the ones it still
+// straddles, so the box's children can skip the planes it's already wholly inside.
+uint32_t classifyBox(const Frustum &frustum, const Aabb &box, uint32_t planes) {
+  for (uint32_t p = 0; p < 6; ++p) {
+    if ((planes & (1u << p)) == 0) {
+      continue;
+    }
+
+    // the corners furthest along the normal and furthest against it
+    const glm::vec4 &plane = frustum.planes[p];
+    glm::vec3 positive(plane.x >= 0.f ? box.max.x : box.min.x,
+                       plane.y >= 0.f ? box.max.y : box.min.y,
+                       plane.z >= 0.f ? box.max.z : box.min.z);
+    glm::vec3 negative(plane.x >= 0.f ? box.min.x : box.max.x,
+                       plane.y >= 0.f ? box.min.y : box.max.y,
+                       plane.z >= 0.f ? box.min.z : box.max.z);
+
+    if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.f) {
+      return BOX_OUTSIDE;
+    }
+    if (glm::dot(glm::vec3(plane), negative) + plane.w >= 0.f) {
+      planes &= ~(1u << p);
+    }
+  }
+  return planes;
+}
+
+// Slab test a ray against a box. distance is where it goes in, or 0 if it starts inside.
+bool intersectRay(const Aabb &box, const glm::vec3 &origin,
+                  const glm::vec3 &inverseDirection, float maxDistance, float &distance) {
+  glm::vec3 t0    = (box.min - origin) * inverseDirection;
+  glm::vec3 t1    = (box.max - origin) * inverseDirection;
+  glm::vec3 tNear = glm::min(t0, t1);
+  glm::vec3 tFar  = glm::max(t0, t1);
+
+  float enter = std::max({tNear.x, tNear.y, tNear.z, 0.f});
+  float exit  = std::min({tFar.x, tFar.y, tFar.z});
+  distance    = enter;
+  return enter <= exit && enter <= maxDistance;
+}
+} // namespace
+
+Aabb transformAabb(const Aabb &box, const glm::mat4 &transform) {
+  if (box.empty()) {
+    return box;
+  }
+
+  // every axis of the transform stretches the box by whichever end of it reaches out
+  // furthest along that axis (Arvo)
+  Aabb result;
+  result.min = result.max = glm::vec3(transform[3]);
+  for (int column = 0; column < 3; ++column) {
+    glm::vec3 axis = glm::vec3(transform[column]);
+    glm::vec3 a    = axis * box.min[column];
+    glm::vec3 b    = axis * box.max[column];
+    result.min += glm::min(a, b);
+    result.max += glm::max(a, b);
+  }
+  return result;
+}
+
+void SceneBvh::build(const std::vector<Aabb> &bounds) {
+  objectBounds = bounds;
+  objectLeaves.assign(bounds.size(), NO_NODE);
+  objectIndices.clear();
+  unboundedObjects.clear();
+  nodes.clear();
+  parents.clear();
+
+  std::vector<BuildItem> items;
+  items.reserve(bounds.size());
+  for (uint32_t i = 0; i < bounds.size(); ++i) {
+    if (bounds[i].empty()) {
+      unboundedObjects.push_back(i);
+      continue;
+    }
+    items.push_back({bounds[i], (bounds[i].min + bounds[i].max) * 0.5f, i});
+  }
+
+  if (!items.empty()) {
+    // a binary tree with a leaf per object at worst
+    nodes.reserve(2 * items.size());
+    parents.reserve(2 * items.size());
+    nodes.push_back({});
+    parents.push_back(NO_NODE);
+    buildNode(0, 0, static_cast<uint32_t>(items.size()), items);
+  }
+
+  // the leaves ended up pointing at the items in the order they got split into
+  objectIndices.resize(items.size());
+  for (size_t i = 0; i < items.size(); ++i) {
+    objectIndices[i] = items[i].object;
+  }
+  dirty.assign(nodes.size(), 0);
+}
+
+void SceneBvh::update(uint32_t object, const Aabb &box) {
+  uint32_t leaf = objectLeaves[object];
+  if (leaf == NO_NODE || box.empty()) {
+    return;
+  }
+  objectBounds[object] = box;
+
+  // anything above a dirty node is already dirty too, so stop at the first one
+  for (uint32_t node = leaf; node != NO_NODE && !dirty[node]; node = parents[node]) {
+    dirty[node] = 1;
+  }
+}
+
+void SceneBvh::refit() {
+  if (!nodes.empty() && dirty[0]) {
+    refitNode(0);
+  }
+}
+
+void SceneBvh::cull(const Frustum &frustum, std::vector<uint32_t> &visible) const {
+  visible.assign(unboundedObjects.begin(), unboundedObjects.end());
+  if (nodes.empty()) {
+    return;
+  }
+
+  // every node, and the planes its parent still straddled
+  struct Entry {
+    uint32_t node;
+    uint32_t planes;
+  };
+  std::vector<Entry> stack;
+  stack.reserve(64);
+  stack.push_back({0, ALL_PLANES});
+
+  while (!stack.empty()) {
+    Entry entry = stack.back();
+    stack.pop_back();
+
+    const Node &node = nodes[entry.node];
+    uint32_t planes  = entry.planes;
+    if (planes != 0) {
+      planes = classifyBox(frustum, node.bounds, planes);
+      if (planes == BOX_OUTSIDE) {
+        continue;
+      }
+    }
+
+    if (node.count == 0) {
+      stack.push_back({node.first, planes});
+      stack.push_back({node.first + 1, planes});
+      continue;
+    }
+
+    // a leaf that's only partly inside still gets its objects tested one by one
+    for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+      uint32_t object = objectIndices[i];
+      if (planes == 0 ||
+          classifyBox(frustum, objectBounds[object], planes) != BOX_OUTSIDE) {
+        visible.push_back(object);
+      }
+    }
+  }
+}
+
+std::optional<BvhHit> SceneBvh::pick(const glm::vec3 &origin, const glm::vec3 &direction,
+                                     float maxDistance) const {
+  std::optional<BvhHit> hit;
+  if (nodes.empty()) {
+    return hit;
+  }
+
+  // dividing by zero is fine here, the infinities fall out of the slab test right
+  glm::vec3 inverseDirection = glm::vec3(1.f) / direction;
+  float nearest              = maxDistance;
+
+  // every node, and where the ray goes into it
+  std::vector<std::pair<uint32_t, float>> stack;
+  stack.reserve(64);
+
+  float rootDistance;
+  if (intersectRay(nodes[0].bounds, origin, inverseDirection, nearest, rootDistance)) {
+    stack.push_back({0, rootDistance});
+  }
+
+  while (!stack.empty()) {
+    auto [index, distance] = stack.back();
+    stack.pop_back();
+    // something nearer might have turned up since this got pushed
+    if (distance > nearest) {
+      continue;
+    }
+
+    const Node &node = nodes[index];
+    if (node.count > 0) {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        uint32_t object = objectIndices[i];
+        float objectDistance;
+        if (intersectRay(objectBounds[object], origin, inverseDirection, nearest,
+                         objectDistance) &&
+            (!hit || objectDistance < nearest)) {
+          hit     = BvhHit{object, objectDistance};
+          nearest = objectDistance;
+        }
+      }
+      continue;
+    }
+
+    float leftDistance, rightDistance;
+    bool hitLeft  = intersectRay(nodes[node.first].bounds, origin, inverseDirection,
+                                 nearest, leftDistance);
+    bool hitRight = intersectRay(nodes[node.first + 1].bounds, origin, inverseDirection,
+                                 nearest, rightDistance);
+
+    // the nearer child goes on top, so it gets looked at first
+    if (hitLeft && hitRight && leftDistance < rightDistance) {
+      stack.push_back({node.first + 1, rightDistance});
+      stack.push_back({node.first, leftDistance});
+    } else {
+      if (hitLeft) {
+        stack.push_back({node.first, leftDistance});
+      }
+      if (hitRight) {
+        stack.push_back({node.first + 1, rightDistance});
+      }
+    }
+  }
+  return hit;
+}
+
+void SceneBvh::buildNode(uint32_t node, uint32_t first, uint32_t count,
+                         std::vector<BuildItem> &items) {
+  const auto begin = items.begin() + first;
+  const auto end   = begin + count;
+
+  Aabb bounds, centroidBounds;
+  for (auto item = begin; item != end; ++item) {
+    bounds.grow(item->bounds);
+    centroidBounds.grow(item->centroid);
+  }
+  nodes[node].bounds = bounds;
+
+  // Bin the centroids along every axis at once, and find the split with the least
+  // surface area times objects on either side. Flat axes can't be split along. Small
+  // nodes get fewer bins, the sweeps would cost more than the binning otherwise.
+  const uint32_t binCount = std::min(BVH_BIN_COUNT, count);
+  glm::vec3 extent        = centroidBounds.max - centroidBounds.min;
+  glm::vec3 scale;
+  for (int axis = 0; axis < 3; ++axis) {
+    scale[axis] = extent[axis] > 0.f ? binCount / extent[axis] : 0.f;
+  }
+  auto binOf = [&](const BuildItem &item, int axis) {
+    float offset = (item.centroid[axis] - centroidBounds.min[axis]) * scale[axis];
+    return std::min(binCount - 1, static_cast<uint32_t>(offset));
+  };
+
+  Aabb bins[3][BVH_BIN_COUNT];
+  uint32_t binCounts[3][BVH_BIN_COUNT] = {};
+  for (auto item = begin; item != end; ++item) {
+    for (int axis = 0; axis < 3; ++axis) {
+      uint32_t bin = binOf(*item, axis);
+      bins[axis][bin].grow(item->bounds);
+      ++binCounts[axis][bin];
+    }
+  }
+
+  float bestCost     = INFINITY;
+  int bestAxis       = -1;
+  uint32_t bestSplit = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (count == 1 || scale[axis] == 0.f) {
+      continue;
+    }
+
+    // sweep from the left, then from the right, meeting at every split. Only splits
+    // with something on both sides count.
+    float leftCosts[BVH_BIN_COUNT];
+    uint32_t leftCounts[BVH_BIN_COUNT];
+    Aabb left;
+    uint32_t leftCount = 0;
+    for (uint32_t bin = 0; bin < binCount - 1; ++bin) {
+      left.grow(bins[axis][bin]);
+      leftCount += binCounts[axis][bin];
+      leftCounts[bin] = leftCount;
+      leftCosts[bin]  = leftCount > 0 ? left.halfArea() * leftCount : 0.f;
+    }
+
+    Aabb right;
+    uint32_t rightCount = 0;
+    for (uint32_t bin = binCount - 1; bin > 0; --bin) {
+      right.grow(bins[axis][bin]);
+      rightCount += binCounts[axis][bin];
+      if (rightCount == 0 || leftCounts[bin - 1] == 0) {
+        continue;
+      }
+
+      float cost = leftCosts[bin - 1] + right.halfArea() * rightCount;
+      if (cost < bestCost) {
+        bestCost  = cost;
+        bestAxis  = axis;
+        bestSplit = bin;
+      }
+    }
+  }
+
+  // a leaf costs testing everything in it, a split costs testing the two children and
+  // then whatever's in the ones that get hit
+  float area    = bounds.halfArea();
+  bool makeLeaf = bestAxis < 0 ? count <= BVH_MAX_LEAF_SIZE
+                               : count <= BVH_MAX_LEAF_SIZE &&
+                                     bestCost + area >= area * count;
+  if (makeLeaf) {
+    nodes[node].first = first;
+    nodes[node].count = count;
+    for (auto item = begin; item != end; ++item) {
+      objectLeaves[item->object] = node;
+    }
+    return;
+  }
+
+  uint32_t leftCount = count / 2;
+  if (bestAxis >= 0) {
+    // same binning as above, so the split lands exactly where the sweep said it would
+    auto middle = std::partition(begin, end, [&](const BuildItem &item) {
+      return binOf(item, bestAxis) < bestSplit;
+    });
+    leftCount = static_cast<uint32_t>(middle - begin);
+  }
+  // Otherwise every centroid's in the same spot, and any split is as good as another.
+  // Same goes if rounding ever puts everything on one side.
+  if (leftCount == 0 || leftCount == count) {
+    leftCount = count / 2;
+  }
+
+  uint32_t children = static_cast<uint32_t>(nodes.size());
+  nodes.resize(nodes.size() + 2);
+  parents.resize(parents.size() + 2, node);
+  nodes[node].first = children;
+  nodes[node].count = 0;
+
+  buildNode(children, first, leftCount, items);
+  buildNode(children + 1, first + leftCount, count - leftCount, items);
+}
+
+void SceneBvh::refitNode(uint32_t index) {
+  dirty[index] = 0;
+
+  Node &node = nodes[index];
+  Aabb bounds;
+  if (node.count > 0) {
+    for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+      bounds.grow(objectBounds[objectIndices[i]]);
+    }
+  } else {
+    // clean children are already right
+    for (uint32_t child = node.first; child < node.first + 2; ++child) {
+      if (dirty[child]) {
+        refitNode(child);
+      }
+      bounds.grow(nodes[child].bounds);
+    }
+  }
+  nodes[index].bounds = bounds;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+#include "frustum_culler.h"
+#include "vk_types.h"
+
+// leaves split until they're at most this big, whatever the surface area heuristic says
+constexpr uint32_t BVH_MAX_LEAF_SIZE = 8;
+// how many buckets the centroids get sorted into when looking for the best split
+constexpr uint32_t BVH_BIN_COUNT = 16;
+
+// An axis aligned box. The default one is empty (min above max), and growing it by
+// anything gives back that thing.
+struct Aabb {
+  glm::vec3 min{INFINITY};
+  glm::vec3 max{-INFINITY};
+
+  bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+  void grow(const glm::vec3 &point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+  void grow(const Aabb &box) {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+  }
+  // half the surface area, which is all the heuristic needs
+  float halfArea() const {
+    glm::vec3 size = max - min;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+  }
+};
+
+// the box around a box after it's been through a transform
+Aabb transformAabb(const Aabb &box, const glm::mat4 &transform);
+
+// where a ray first hits an object
+struct BvhHit {
+  uint32_t object;
+  float distance;
+};
+
+// A bounding volume hierarchy over the scene's objects, split with the surface area
+// heuristic. Objects can move afterwards: update() marks the path from its leaf to the
+// root dirty, and refit() only walks into dirty nodes to grow or shrink their boxes.
+// Refitting never changes the tree's shape, so build() again after objects have moved
+// a long way and the boxes have gotten loose.
+class SceneBvh {
+public:
+  // Build the tree over one box per object. Empty boxes are objects with nothing to
+  // go on: they're never culled, and never picked.
+  void build(const std::vector<Aabb> &bounds);
+
+  // Give an object a new box. Takes effect on the next refit(). Objects can't move in
+  // or out of the tree this way, an empty box here is ignored.
+  void update(uint32_t object, const Aabb &box);
+  // bring every dirty node's box up to date
+  void refit();
+
+  // Fill visible with every object whose box is at least partly inside the frustum,
+  // in no particular order. Whole subtrees inside the frustum skip the plane tests.
+  void cull(const Frustum &frustum, std::vector<uint32_t> &visible) const;
+  // the nearest object whose box the ray hits within maxDistance, if there is one
+  std::optional<BvhHit> pick(const glm::vec3 &origin, const glm::vec3 &direction,
+                             float maxDistance = INFINITY) const;
+
+  size_t getNodeCount() const { return nodes.size(); }
+
+private:
+  // Leaves have count objects starting at objectIndices[first]. Inner nodes have a
+  // count of zero, and their two children at first and first + 1.
+  struct Node {
+    Aabb bounds;
+    uint32_t first;
+    uint32_t count;
+  };
+
+  // an object as the build sees it, all in one place so splitting reads memory in order
+  struct BuildItem {
+    Aabb bounds;
+    glm::vec3 centroid;
+    uint32_t object;
+  };
+
+  // split items[first, first + count) under node, and so on down
+  void buildNode(uint32_t node, uint32_t first, uint32_t count,
+                 std::vector<BuildItem> &items);
+  void refitNode(uint32_t index);
+
+  std::vector<Node> nodes;
+  // the leaves point into this, every subtree's objects are next to each other
+  std::vector<uint32_t> objectIndices;
+  std::vector<Aabb> objectBounds;
+  // the leaf every object is in, or UINT32_MAX if it isn't in the tree
+  std::vector<uint32_t> objectLeaves;
+  // objects with empty boxes, which cull() always lets through
+  std::vector<uint32_t> unboundedObjects;
+
+  std::vector<uint32_t> parents;
+  std::vector<uint8_t> dirty;
+};
\ No newline at end of file
@@ -3,28 +3,56 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
 
+#include "cpu_profiler.h"
+#include "file_utils.h"
 #include "vk_initializers.h"
 #include "vk_types.h"
 
+#include <cctype>
+#include <cerrno>
+#include <exception>
 #include <glm/gtx/transform.hpp>
+#include <map>
 
 #define VMA_IMPLEMENTATION
 #include "vk_mem_alloc.h"
 
+namespace {
+// baked meshes are told apart from .objs by their extension
+bool isBakedMeshPath(const std::string &path) {
+  return path.size() > 6 && path.compare(path.size() - 6, 6, ".tmesh") == 0;
+}
+
+// the .obj next to a baked mesh, which gets loaded instead if the bake is broken
+std::string objPathFor(const std::string &bakedPath) {
+  return bakedPath.substr(0, bakedPath.size() - 6) + ".obj";
+}
+} // namespace
+
 // PRIMARY FUNCTIONS
 //------------------------------------------------------------------------
 
 // Boot up the engine
 void VulkanEngine::init() {
 
-  // Initialize SDL and make a window with it
-  SDL_Init(SDL_INIT_VIDEO);
+  CpuProfiler::setThreadName("main");
 
-  SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
+  // headless runs are benchmarks, and meshes popping in on other threads whenever they
+  // happen to finish would make every run time something different
+  if (headless) {
+    streamMeshes = false;
+  }
+
+  // Initialize SDL and make a window with it, unless there's nothing to show it on
+  if (!headless) {
+    SDL_Init(SDL_INIT_VIDEO);
 
-  window =
-      SDL_CreateWindow("Vulkan Engine", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                       windowExtent.width, windowExtent.height, window_flags);
+    SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
+
+    window = SDL_CreateWindow("Vulkan Engine", SDL_WINDOWPOS_UNDEFINED,
+                              SDL_WINDOWPOS_UNDEFINED, windowExtent.width,
+                              windowExtent.height, window_flags);
+  }
 
   initVulkan();
 
@@ -35,18 +63,52 @@ void VulkanEngine::init() {
 // Spin up a vulkan context complete with everything needed to render
 void VulkanEngine::initVulkan() {
   createInstance();
-  createSurface();
+  if (!headless) {
+    createSurface();
+  }
   pickPhysicalDevice();
   createDevice();
-  createSwapChain();
+  // the offscreen images are allocated through VMA, so it has to exist before them
+  createMemAllocator();
+
+  uploader.init(device, allocator, queueFamilyIndices.transferFamily.value(),
+                transferQueue);
+  mainDeletionQueue.pushFunction([=]() { uploader.cleanup(); });
+  if (headless) {
+    createOffscreenImages();
+  } else {
+    createSwapChain();
+  }
   createImageViews();
+  createDepthResources();
   initCommands();
   createRenderPass();
   createFramebuffers();
   createSyncStructures();
+  gpuProfiler.init(device, chosenGPU, findQueueFamilies(chosenGPU).graphicsFamily.value(),
+                   MAX_FRAMES_IN_FLIGHT);
+  createQueryPools();
+  createPipelineCache();
+  createDescriptors();
   createPipelines();
+  createComputePipelines();
+  loadMeshes();
+  initScene();
+  createDrawBuffers();
+  createDepthPyramid();
+  if (streamMeshes) {
+    initStreaming();
+  }
 
-  createMemAllocator();
+  // the indirect draws and their instances come out of the cull pass, even with culling
+  // turned off. Graphics waits on it before reading them, and before the pyramid gets
+  // rebuilt underneath it.
+  if (indirectDraws) {
+    computePasses.push_back({"cull", [this](VkCommandBuffer cmd) { recordCulling(cmd); },
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                                 VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT});
+  }
 }
 
 // Cleans up all the objects when the application is closed
@@ -58,11 +120,22 @@ void VulkanEngine::cleanup() {
     // Wait for the GPU To finish doing stuff before we rip all the objects away from it
     vkDeviceWaitIdle(device);
 
-    // Destroy everything that we added to the deletion queue
+    // Destroy everything that we added to the deletion queues, swapchain stuff first
+    // since it's built on top of the rest
+    swapChainDeletionQueue.flush();
     mainDeletionQueue.flush();
 
+    // the allocator outlives swapchain rebuilds, so it isn't in the deletion queue
+    vmaDestroyAllocator(allocator);
+
+    // same goes for the pipeline cache, which gets written out for next time first
+    savePipelineCache();
+    vkDestroyPipelineCache(device, pipelineCache, nullptr);
+
     // destroy the render surface
-    vkDestroySurfaceKHR(instance, displaySurface, nullptr);
+    if (!headless) {
+      vkDestroySurfaceKHR(instance, displaySurface, nullptr);
+    }
 
     // Destroy the logical device
     vkDestroyDevice(device, nullptr);
@@ -71,86 +144,84 @@ void VulkanEngine::cleanup() {
     vkDestroyInstance(instance, nullptr);
 
     // Destroy the SDL window
-    SDL_DestroyWindow(window);
+    if (!headless) {
+      SDL_DestroyWindow(window);
+    }
   }
 }
 
 // Draw to the screen
 void VulkanEngine::draw() {
-  // wait for the gpu to finish its work before starting to draw
-  vkWaitForFences(device, 1, &getCurrentFrame().renderFence, true, UINT64_MAX);
-  vkResetFences(device, 1, &getCurrentFrame().renderFence);
+  // normally last frame's draw() already updated this one
+  if (!frameUpdated) {
+    updateFrame(getCurrentFrame());
+    frameUpdated = true;
+  }
   // std::cerr << "\rthe current frame in flight is frame " << frameNumber %
   // MAX_FRAMES_IN_FLIGHT << " and the overall frame count is " << frameNumber << ' ' <<
   // std::flush;
 
   uint32_t swapChainImageIndex;
-  VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT32_MAX,
-                                          getCurrentFrame().presentSemaphore, nullptr,
-                                          &swapChainImageIndex);
+  VkResult result;
 
-  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-    recreateSwapChain();
-    return;
-  } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-    throw std::runtime_error("Failed to acquire next image!");
+  if (headless) {
+    // each frame in flight owns one offscreen image, so the fence its update waited on
+    // already guarantees nobody else is still drawing to it
+    swapChainImageIndex = frameNumber % swapChainImages.size();
+  } else {
+    CPU_ZONE("acquire image");
+    result = vkAcquireNextImageKHR(device, swapChain, UINT32_MAX,
+                                   getCurrentFrame().presentSemaphore, nullptr,
+                                   &swapChainImageIndex);
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+      // the update worked the camera out for the old size, so it gets done again
+      recreateSwapChain();
+      frameUpdated = false;
+      return;
+    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+      throw std::runtime_error("Failed to acquire next image!");
+    }
   }
 
-  // reset the command buffer so we can send new stuff to it
-  if (vkResetCommandBuffer(getCurrentFrame().graphicsCommandBuffer, 0) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to reset command buffer!");
+  // only reset the fence once we know we're submitting, otherwise bailing out for a
+  // resize above would leave it unsignalled forever
+  vkResetFences(device, 1, &getCurrentFrame().renderFence);
+
+  // kick off the compute work first, so it can get going while we record graphics
+  VkPipelineStageFlags computeWaitStages;
+  {
+    CPU_ZONE("submit compute");
+    computeWaitStages = submitCompute();
   }
 
   // rename for less typing
   VkCommandBuffer graphBuffer = getCurrentFrame().graphicsCommandBuffer;
 
-  // boot up the command buffer
-  VkCommandBufferBeginInfo graphBeginInfo{};
-  graphBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  graphBeginInfo.pNext = nullptr;
+  // Record this frame on the job system while this thread updates the next one.
+  // Recording only reads this frame's slot, and the update only writes the next one's,
+  // plus the scene, which recording doesn't look at. Whatever recording throws comes
+  // back here, since it can't leave the job.
+  JobCounter recorded;
+  std::exception_ptr recordError;
+  jobs.run(recorded, [this, graphBuffer, swapChainImageIndex, &recordError] {
+    CPU_ZONE("record commands");
+    try {
+      recordCommands(graphBuffer, swapChainImageIndex);
+    } catch (...) {
+      recordError = std::current_exception();
+    }
+  });
 
-  // tell vulkan this buffer is only executing once per frame
-  graphBeginInfo.pInheritanceInfo = nullptr;
-  graphBeginInfo.flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  updateFrame(bufferFrames[(frameNumber + 1) % MAX_FRAMES_IN_FLIGHT]);
+  frameUpdated = true;
 
-  if (vkBeginCommandBuffer(graphBuffer, &graphBeginInfo) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to start recording the command buffer!");
+  {
+    CPU_ZONE("wait for recording");
+    jobs.wait(recorded);
   }
-
-  // set the blanking color
-  VkClearValue blankValue;
-  blankValue.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-
-  // create render pass
-  VkRenderPassBeginInfo rpInfo{};
-  rpInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  rpInfo.pNext = nullptr;
-
-  rpInfo.renderPass          = renderPass;
-  rpInfo.renderArea.offset.x = 0;
-  rpInfo.renderArea.offset.y = 0;
-
-  // tell it what area of screenspace to render to
-  rpInfo.renderArea.extent = windowExtent;
-
-  rpInfo.framebuffer = swapChainFramebuffers[swapChainImageIndex];
-
-  rpInfo.clearValueCount = 1;
-  rpInfo.pClearValues    = &blankValue;
-
-  // begin the renderpass
-  vkCmdBeginRenderPass(graphBuffer, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-  // bind the pipeline
-  vkCmdBindPipeline(graphBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderPipeline);
-
-  // its high noon
-  vkCmdDraw(graphBuffer, 3, 1, 0, 0);
-
-  vkCmdEndRenderPass(graphBuffer);
-
-  if (vkEndCommandBuffer(graphBuffer) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to end the commmand buffer!");
+  if (recordError) {
+    std::rethrow_exception(recordError);
   }
 
   // submit buffer to GPU
@@ -158,24 +229,63 @@ void VulkanEngine::draw() {
   submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
   submit.pNext = nullptr;
 
-  VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  // there's no image acquisition or presentation to sync with when headless
+  std::vector<VkSemaphore> waitSemaphores;
+  std::vector<VkPipelineStageFlags> waitStages;
+  if (!headless) {
+    waitSemaphores.push_back(getCurrentFrame().presentSemaphore);
+    waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+  }
 
-  submit.pWaitDstStageMask = &waitStage;
+  // only hold up the stages that read compute results, everything before them can run
+  // while compute is still going
+  if (computeWaitStages != 0) {
+    waitSemaphores.push_back(getCurrentFrame().computeSemaphore);
+    waitStages.push_back(computeWaitStages);
+  }
 
-  submit.waitSemaphoreCount = 1;
-  submit.pWaitSemaphores    = &getCurrentFrame().presentSemaphore;
+  submit.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+  submit.pWaitSemaphores    = waitSemaphores.data();
+  submit.pWaitDstStageMask  = waitStages.data();
 
-  submit.signalSemaphoreCount = 1;
-  submit.pSignalSemaphores    = &getCurrentFrame().renderSemaphore;
+  // next frame's culling waits on the depth pyramid this frame builds
+  std::vector<VkSemaphore> signalSemaphores;
+  if (!headless) {
+    signalSemaphores.push_back(getCurrentFrame().renderSemaphore);
+  }
+  if (buildsDepthPyramid()) {
+    signalSemaphores.push_back(getCurrentFrame().depthPyramidSemaphore);
+  }
+
+  submit.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+  submit.pSignalSemaphores    = signalSemaphores.data();
 
   submit.commandBufferCount = 1;
   submit.pCommandBuffers    = &graphBuffer;
 
-  result = vkQueueSubmit(graphicsQueue, 1, &submit, getCurrentFrame().renderFence);
+  {
+    CPU_ZONE("queue submit");
+    result = vkQueueSubmit(graphicsQueue, 1, &submit, getCurrentFrame().renderFence);
+  }
 
   if (result != VK_SUCCESS) {
     throw std::runtime_error("Failed to submit image to queue!");
   }
+
+  // this is what'll be on screen while the camera's already on to the next frame, so
+  // it's what clicks get picked against
+  displayedViewProj = getCurrentFrame().viewProj;
+
+  if (buildsDepthPyramid()) {
+    pendingPyramidSemaphore = getCurrentFrame().depthPyramidSemaphore;
+    depthPyramidReady       = true;
+  }
+
+  if (headless) {
+    frameNumber++;
+    return;
+  }
+
   // display image to the screen
 
   VkPresentInfoKHR presentInfo{};
@@ -190,11 +300,15 @@ void VulkanEngine::draw() {
 
   presentInfo.pImageIndices = &swapChainImageIndex;
 
-  result = vkQueuePresentKHR(graphicsQueue, &presentInfo);
+  {
+    CPU_ZONE("queue present");
+    result = vkQueuePresentKHR(graphicsQueue, &presentInfo);
+  }
 
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
 
     recreateSwapChain();
+    frameUpdated = false;
 
   } else if (result != VK_SUCCESS) {
     throw std::runtime_error("Failed to present swapchain image!");
@@ -204,853 +318,3141 @@ void VulkanEngine::draw() {
   frameNumber++;
 }
 
-// Primary loop of the engine.
-void VulkanEngine::run() {
-  SDL_Event e;
-  bool bQuit = false;
-
-  // main loop
-
-  while (!bQuit) {
+void VulkanEngine::updateFrame(FrameData &frame) {
+  // wait for the gpu to finish with the slot before touching it
+  {
+    CPU_ZONE("wait for fence");
+    vkWaitForFences(device, 1, &frame.renderFence, true, UINT64_MAX);
+  }
 
-    // ask SDL for everything that's happened since the last frame
-    while (SDL_PollEvent(&e) != 0) {
-      // if you hit  the x button, close the damn window
-      if (e.type == SDL_QUIT) {
-        bQuit = true;
-      }
-      if (e.type == SDL_KEYDOWN) {
-        if (e.key.keysym.sym == SDLK_a) {
-          camPos[0] += .05;
-        }
-        if (e.key.keysym.sym == SDLK_d) {
-          camPos[0] -= .05;
-        }
-        if (e.key.keysym.sym == SDLK_w) {
-          camPos[2] += .05;
-        }
-        if (e.key.keysym.sym == SDLK_s) {
-          camPos[2] -= .05;
-        }
-      }
+  // streaming changes what objects draw, so it has to go before anything reads them
+  {
+    CPU_ZONE("update streaming");
+    if (streamMeshes) {
+      updateStreaming();
     }
+    updateFrameBuffers(frame);
+  }
 
-    // then draw the picture
-    draw();
+  // the compute passes read what the cpu writes here, so it has to come before them
+  {
+    CPU_ZONE("write draw commands");
+    updateCamera();
+    writeDrawCommands(frame);
   }
 }
 
-// Get the extensions we need for the app to run
-std::vector<const char *> VulkanEngine::getRequiredExtensions() {
+VkPipelineStageFlags VulkanEngine::submitCompute() {
+  if (computePasses.empty()) {
+    return 0;
+  }
+
+  // the graphics submit waits on this frame's compute semaphore, so the render fence
+  // its update waited on also covers the compute buffer
+  VkCommandBuffer compBuffer = getCurrentFrame().computeCommandBuffer;
+  if (vkResetCommandBuffer(compBuffer, 0) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to reset compute command buffer!");
+  }
 
-  // get the extensions SDL needs
-  uint32_t extensionCount{0};
+  VkCommandBufferBeginInfo compBeginInfo{};
+  compBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  compBeginInfo.pNext = nullptr;
 
-  SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, nullptr);
+  compBeginInfo.pInheritanceInfo = nullptr;
+  compBeginInfo.flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-  std::vector<const char *> extensions(extensionCount);
-  SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, extensions.data());
+  if (vkBeginCommandBuffer(compBuffer, &compBeginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to start recording the compute command buffer!");
+  }
 
-  if (enableValidationLayers) {
-    // adds the validation layers to the list if we've enabled them
-    extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+  VkPipelineStageFlags waitStages = 0;
+  for (auto &pass : computePasses) {
+    CpuZone passZone(pass.name);
+    pass.record(compBuffer);
+    waitStages |= pass.consumerStages;
   }
 
-  return extensions;
+  if (vkEndCommandBuffer(compBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to end the compute command buffer!");
+  }
+
+  VkSubmitInfo submit{};
+  submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit.pNext = nullptr;
+
+  submit.commandBufferCount = 1;
+  submit.pCommandBuffers    = &compBuffer;
+
+  // anything reading last frame's depth pyramid has to wait for it to be built
+  VkPipelineStageFlags pyramidWaitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  if (pendingPyramidSemaphore != VK_NULL_HANDLE) {
+    submit.waitSemaphoreCount = 1;
+    submit.pWaitSemaphores    = &pendingPyramidSemaphore;
+    submit.pWaitDstStageMask  = &pyramidWaitStage;
+  }
+
+  submit.signalSemaphoreCount = 1;
+  submit.pSignalSemaphores    = &getCurrentFrame().computeSemaphore;
+
+  if (vkQueueSubmit(computeQueue, 1, &submit, VK_NULL_HANDLE) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to submit compute work!");
+  }
+  pendingPyramidSemaphore = VK_NULL_HANDLE;
+
+  // A pass that didn't say who reads it could be read by anything, so everything waits.
+  // Top of pipe wouldn't hold anything up, and the render fence would stop covering the
+  // compute buffer.
+  return waitStages != 0 ? waitStages
+                         : static_cast<VkPipelineStageFlags>(
+                               VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 }
 
-// Create the vulkan context
-void VulkanEngine::createInstance() {
-  // if the validation layers are turned on, but aren't available on the system,
-  // panic.
-  if (enableValidationLayers && !checkValidationSupport()) {
-    throw std::runtime_error("validation layers requested, but not available!");
+// Fill in a frame's command buffer, drawing into the given swapchain image
+void VulkanEngine::recordCommands(VkCommandBuffer graphBuffer,
+                                  uint32_t swapChainImageIndex) {
+  // reset the command buffer so we can send new stuff to it
+  if (vkResetCommandBuffer(graphBuffer, 0) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to reset command buffer!");
   }
 
-  // create a struct to hold application info
-  VkApplicationInfo appInfo{};
-  appInfo.sType              = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-  appInfo.pApplicationName   = "Vulkan Adventure";
-  appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.pEngineName        = "The Unibox";
-  appInfo.engineVersion      = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion         = VK_API_VERSION_1_0;
+  // boot up the command buffer
+  VkCommandBufferBeginInfo graphBeginInfo{};
+  graphBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  graphBeginInfo.pNext = nullptr;
 
-  // create a struct to hold critical vulkan info
-  VkInstanceCreateInfo createInfo{};
-  createInfo.sType            = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-  createInfo.pApplicationInfo = &appInfo;
-  createInfo.pNext            = nullptr;
+  // tell vulkan this buffer is only executing once per frame
+  graphBeginInfo.pInheritanceInfo = nullptr;
+  graphBeginInfo.flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-  // add the extensions SDL needs to the struct, plus the validation layers if necessary
-  auto extensions                    = getRequiredExtensions();
-  createInfo.enabledExtensionCount   = static_cast<uint32_t>(extensions.size());
-  createInfo.ppEnabledExtensionNames = extensions.data();
+  if (vkBeginCommandBuffer(graphBuffer, &graphBeginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to start recording the command buffer!");
+  }
 
-  // if the validation layers are turned on, add them to the struct. Otherwise,
-  // tell the struct there are no layers turnd on.
+  // the fence the update waited on means this frame's old timestamps are ready, so
+  // read them and reset the queries for this time around
+  FrameData &frame = getCurrentFrame();
+  gpuProfiler.beginFrame(graphBuffer, frameNumber % MAX_FRAMES_IN_FLIGHT,
+                         frame.timestampPool);
+  uint32_t frameScope = gpuProfiler.beginScope(graphBuffer, "frame");
 
-  if (enableValidationLayers) {
-    createInfo.enabledLayerCount   = static_cast<uint32_t>(validationLayers.size());
-    createInfo.ppEnabledLayerNames = validationLayers.data();
+  // set the blanking color, and push the depth all the way back
+  VkClearValue clearValues[2];
+  clearValues[0].color        = {{0.0f, 0.0f, 0.0f, 1.0f}};
+  clearValues[1].depthStencil = {1.0f, 0};
+
+  // create render pass
+  VkRenderPassBeginInfo rpInfo{};
+  rpInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  rpInfo.pNext = nullptr;
+
+  rpInfo.renderPass          = renderPass;
+  rpInfo.renderArea.offset.x = 0;
+  rpInfo.renderArea.offset.y = 0;
+
+  // tell it what area of screenspace to render to
+  rpInfo.renderArea.extent = windowExtent;
+
+  rpInfo.framebuffer = swapChainFramebuffers[swapChainImageIndex];
 
+  rpInfo.clearValueCount = 2;
+  rpInfo.pClearValues    = clearValues;
+
+  // begin the renderpass
+  uint32_t passScope = gpuProfiler.beginScope(graphBuffer, "main pass");
+
+  if (indirectDraws) {
+    // one draw per index size, however big the scene gets
+    vkCmdBeginRenderPass(graphBuffer, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
+    recordIndirectDraws(graphBuffer);
+  } else if (frame.visibleDraws.size() >= parallelRecordThreshold &&
+             recorder.getThreadCount() > 1) {
+    // big draw lists get split up between the recording threads, small ones aren't
+    // worth the handoff
+    vkCmdBeginRenderPass(graphBuffer, &rpInfo,
+                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    std::vector<VkCommandBuffer> secondaries = recorder.record(
+        frameNumber % MAX_FRAMES_IN_FLIGHT, renderPass, rpInfo.framebuffer,
+        frame.visibleDraws.size(),
+        [this](VkCommandBuffer cmd, size_t begin, size_t end) {
+          recordDraws(cmd, begin, end);
+        });
+
+    vkCmdExecuteCommands(graphBuffer, static_cast<uint32_t>(secondaries.size()),
+                         secondaries.data());
   } else {
-    createInfo.enabledLayerCount = 0;
+    vkCmdBeginRenderPass(graphBuffer, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
+    recordDraws(graphBuffer, 0, frame.visibleDraws.size());
   }
 
-  // make the instance
-  if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to create instance!");
+  vkCmdEndRenderPass(graphBuffer);
+  gpuProfiler.endScope(graphBuffer, passScope);
+
+  // the render pass leaves depth ready to sample, for next frame's occlusion culling
+  if (buildsDepthPyramid()) {
+    uint32_t pyramidScope = gpuProfiler.beginScope(graphBuffer, "depth pyramid");
+    depthPyramid.record(graphBuffer);
+    gpuProfiler.endScope(graphBuffer, pyramidScope);
+  }
+
+  gpuProfiler.endScope(graphBuffer, frameScope);
+
+  if (vkEndCommandBuffer(graphBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to end the commmand buffer!");
   }
 }
 
-// make the surface to present to
-void VulkanEngine::createSurface() {
-  if (SDL_Vulkan_CreateSurface(window, instance, &displaySurface) != SDL_TRUE) {
-    std::cout << "can't create surface!";
-  };
-  SDL_SetWindowResizable(window, SDL_TRUE);
+void VulkanEngine::updateCamera() {
+  view = glm::translate(camPos);
+  // depth from 0 to 1 like vulkan wants, instead of opengl's -1 to 1
+  projection = glm::perspectiveRH_ZO(
+      glm::radians(70.f), (float)swapChainExtent.width / (float)swapChainExtent.height,
+      zNear, zFar);
+  // vulkan's y points down, opengl's (and so glm's) points up
+  projection[1][1] *= -1;
+  viewProj = projection * view;
+
+  // a unit of error a unit away covers P11 * height / 2 pixels
+  lodScale = std::abs(projection[1][1]) * swapChainExtent.height * 0.5f /
+             lodErrorThreshold;
 }
-//------------------------------------------------------------------------
 
-// GPU SELECTION FUNCTIONS
-//------------------------------------------------------------------------
-// Get the gpus on the system
-void VulkanEngine::pickPhysicalDevice() {
-  // first, get a list of all the devices on the system.
-  uint32_t deviceCount = 0;
-  vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+void VulkanEngine::writeDrawCommands(FrameData &frame) {
+  // everything recording needs that isn't in the frame's buffers
+  frame.view              = view;
+  frame.projection        = projection;
+  frame.viewProj          = viewProj;
+  frame.lodScale          = lodScale;
+  frame.indirectDrawCount = indirectDrawCount;
+  frame.clusterCount      = static_cast<uint32_t>(cullClusters.size());
+  for (uint32_t group = 0; group < INDEX_TYPE_COUNT; ++group) {
+    frame.groupDrawStarts[group] = groupDrawStarts[group];
+    frame.groupDrawCounts[group] = groupDrawCounts[group];
+  }
 
-  // if we can't find any devices, throw a runtime error
-  if (deviceCount == 0) {
-    throw std::runtime_error("No GPUs with Vulkan support found!");
+  // the flat culler wants every sphere every frame, the bvh keeps its own boxes
+  const bool flatCulling = !indirectDraws && frustumCulling && !bvhCulling;
+  if (flatCulling) {
+    culler.resize(renderObjects.size());
   }
 
-  std::vector<VkPhysicalDevice> devices(deviceCount);
-  vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
-  std::cout << "found " << deviceCount << " GPUs!" << std::endl;
-  for (const auto GPU : devices) {
-    if (isDeviceSuitable(GPU)) {
-      chosenGPU = GPU;
-      return;
+  for (size_t i = 0; i < renderObjects.size(); ++i) {
+    const RenderObject &object = renderObjects[i];
+    if (object.mesh == nullptr) {
+      if (indirectDraws) {
+        frame.cullObjects[i].drawIndex = NO_DRAW;
+      } else if (flatCulling) {
+        // no bounds to go on, so it's never culled
+        culler.setSphere(i, glm::vec4(0.f, 0.f, 0.f, INFINITY));
+      }
+      continue;
     }
-  }
-  // if we make it out of the loop without finding a qualified gpu, throw a runtime error.
-  throw std::runtime_error("No device found that supports all extensions!");
-}
 
-// Check to see if the GPU has all the features we require
-bool VulkanEngine::isDeviceSuitable(VkPhysicalDevice GPU) {
-  // first, get the basic properties of the device
-  VkPhysicalDeviceProperties deviceProperties;
-  vkGetPhysicalDeviceProperties(GPU, &deviceProperties);
+    // dequantizing the packed positions is folded into the model matrix
+    frame.objects[i].model = object.transform * object.mesh->dequantize;
 
-  // then, get its supported extensions
-  uint32_t numExtensions{0};
-  vkEnumerateDeviceExtensionProperties(GPU, nullptr, &numExtensions, nullptr);
+    // the bounds go to world space here, so culling doesn't need the transform
+    if (!indirectDraws) {
+      if (flatCulling) {
+        culler.setSphere(i, transformSphere(object.mesh->boundingSphere(),
+                                            object.transform));
+      }
+      continue;
+    }
 
-  std::cout << "Your " << deviceProperties.deviceName << " supports " << numExtensions
-            << " extensions!" << std::endl;
+    // objects drawn by meshlet still get their sphere, so their meshlets can all be
+    // thrown out at once when it's off screen
+    const Mesh &mesh       = *object.mesh;
+    const DrawBatch &batch = drawBatches[objectBatches[i]];
+    CullObject &cullObject = frame.cullObjects[i];
+    cullObject.sphere      = transformSphere(mesh.boundingSphere(), object.transform);
+    cullObject.drawIndex   = batch.meshletCount > 0 ? NO_DRAW : batch.drawIndex;
+    cullObject.scale       = maxScale(object.transform);
+    cullObject.firstLod    = mesh.firstLod;
+    cullObject.lodCount    = batch.lodCount;
+  }
 
-  std::vector<VkExtensionProperties> supportedExtensions(numExtensions);
-  vkEnumerateDeviceExtensionProperties(GPU, nullptr, &numExtensions,
-                                       supportedExtensions.data());
+  if (indirectDraws) {
+    // every batch's draw, waiting for the cull pass to add the visible instances
+    for (const DrawBatch &batch : drawBatches) {
+      if (batch.drawIndex == NO_DRAW) {
+        continue;
+      }
 
-  // then, check if the gpu supports all the extensions we need
+      const Mesh &mesh = *renderObjects[batch.firstObject].mesh;
 
-  // for every extension that the engine requires, check to see if the gpu has one in its
-  // supported list that matches. If there is even one missing, the check fails and you
-  // get a runtime error.
-  for (const char *requiredExtension : requiredDeviceExtensions) {
-    std::cout << "Checking GPU support for " << requiredExtension << "..." << std::endl;
+      // a draw per meshlet, each with a slot for every one of the batch's objects
+      if (batch.meshletCount > 0) {
+        for (uint32_t m = 0; m < batch.meshletCount; ++m) {
+          const Meshlet &meshlet = mesh.meshlets[m];
 
-    bool extensionFound = false;
-    for (const auto &extension : supportedExtensions) {
-      if (strcmp(extension.extensionName, requiredExtension) == 0) {
-        std::cout << "extension " << requiredExtension << " found!" << std::endl;
-        extensionFound = true;
-        break;
+          VkDrawIndexedIndirectCommand &command =
+              frame.batchCommands[batch.drawIndex + m];
+          command.indexCount    = meshlet.indexCount;
+          command.instanceCount = 0;
+          command.firstIndex    = mesh.firstIndex + meshlet.firstIndex;
+          command.vertexOffset  = static_cast<int32_t>(mesh.firstVertex);
+          command.firstInstance = batch.firstInstance + m * batch.objectCount;
+        }
+        continue;
+      }
+
+      // otherwise a draw per level, which the cull pass picks between
+      for (uint32_t l = 0; l < batch.lodCount; ++l) {
+        const MeshLod &lod = mesh.lods[l];
+
+        VkDrawIndexedIndirectCommand &command = frame.batchCommands[batch.drawIndex + l];
+        command.indexCount    = lod.indexCount;
+        command.instanceCount = 0;
+        command.firstIndex    = mesh.firstIndex + lod.firstIndex;
+        command.vertexOffset  = static_cast<int32_t>(mesh.firstVertex);
+        command.firstInstance = batch.firstInstance + l * batch.objectCount;
       }
     }
-    if (!extensionFound) {
-      throw std::runtime_error("couldn't find all the extensions required!");
+    return;
+  }
+
+  if (frustumCulling && bvhCulling) {
+    CPU_ZONE("bvh cull");
+    sceneBvh.refit();
+    sceneBvh.cull(extractFrustum(viewProj), visibleObjects);
+  } else if (frustumCulling) {
+    CPU_ZONE("frustum cull");
+    culler.cull(extractFrustum(viewProj), visibleObjects);
+  } else {
+    visibleObjects.resize(renderObjects.size());
+    for (size_t i = 0; i < visibleObjects.size(); ++i) {
+      visibleObjects[i] = static_cast<uint32_t>(i);
     }
-  } // if we make out of the loop, the gpu supports all the extensions we asked for.
+  }
 
-  // next, get its features, and pass them to the GPUFeatures variable, just in case.
-  VkPhysicalDeviceFeatures deviceFeatures;
-  vkGetPhysicalDeviceFeatures(GPU, &deviceFeatures);
+  // Sort the survivors into their batches' instance slots at the level their distance
+  // calls for, which also puts the batches back in draw list order whatever order
+  // culling found them in
+  lodInstanceCounts.assign(drawBatches.size() * MESH_MAX_LODS, 0);
+  for (uint32_t object : visibleObjects) {
+    uint32_t batchIndex    = objectBatches[object];
+    const DrawBatch &batch = drawBatches[batchIndex];
+
+    uint32_t lod = 0;
+    if (batch.lodCount > 1) {
+      lod = selectLod(renderObjects[object], batch.lodCount);
+    }
 
-  GPUFeatures = deviceFeatures;
+    uint32_t &count = lodInstanceCounts[batchIndex * MESH_MAX_LODS + lod];
+    frame.instances[batch.firstInstance + lod * batch.objectCount + count++] = object;
+  }
 
-  // next, see if it has adequate support for making a swapchain
-  bool swapChainAdequate{false};
-  SwapChainSupportDetails swapChainSupport = querySwapChainSupport(GPU);
+  frame.visibleDraws.clear();
+  for (uint32_t b = 0; b < drawBatches.size(); ++b) {
+    const DrawBatch &batch     = drawBatches[b];
+    const RenderObject &object = renderObjects[batch.firstObject];
 
-  // if it has at least one present mode and surface format, we're good.
-  swapChainAdequate =
-      !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+    for (uint32_t lod = 0; lod < batch.lodCount; ++lod) {
+      uint32_t count = lodInstanceCounts[b * MESH_MAX_LODS + lod];
+      if (count == 0) {
+        continue;
+      }
 
-  // finally, check to see if it supports all the queue families we need.
-  QueueFamilyIndices indices = findQueueFamilies(GPU);
+      VisibleDraw draw{};
+      draw.pipeline       = object.pipeline;
+      draw.pipelineLayout = object.pipelineLayout;
+      draw.firstInstance  = batch.firstInstance + lod * batch.objectCount;
+      draw.instanceCount  = count;
+
+      if (object.mesh == nullptr) {
+        draw.count = object.vertexCount;
+        draw.first = object.firstVertex;
+      } else {
+        // the same draw the batch's indirect command for the level would have been
+        const Mesh &mesh     = *object.mesh;
+        const MeshLod &level = mesh.lods[lod];
+        draw.indexed         = true;
+        draw.indexType       = mesh.indexType;
+        draw.count           = level.indexCount;
+        draw.first           = mesh.firstIndex + level.firstIndex;
+        draw.vertexOffset    = static_cast<int32_t>(mesh.firstVertex);
+      }
+      frame.visibleDraws.push_back(draw);
+    }
+  }
+}
 
-  // return the result of all our queries.
-  return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-         indices.isComplete() && indices.isComplete();
+uint32_t VulkanEngine::selectLod(const RenderObject &object, uint32_t lodCount) const {
+  // the same as the cull pass: from the nearest the bounding sphere gets to the eye
+  glm::vec4 sphere = transformSphere(object.mesh->boundingSphere(), object.transform);
+  glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(sphere), 1.f));
+  float distance   = std::max(glm::length(center) - sphere.w, zNear);
+  return object.mesh->selectLod(distance, lodScale * maxScale(object.transform),
+                                lodCount);
 }
 
-// Check which queue families the device supports, and then mark down their indices
-VulkanEngine::QueueFamilyIndices VulkanEngine::findQueueFamilies(VkPhysicalDevice GPU) {
-  QueueFamilyIndices indices;
+void VulkanEngine::recordCulling(VkCommandBuffer cmd) {
+  FrameData &frame = getCurrentFrame();
 
-  uint32_t queueFamilyCount{0};
-  // first, get the number of queue families the device supports
-  vkGetPhysicalDeviceQueueFamilyProperties(GPU, &queueFamilyCount, nullptr);
+  // every visible object bumps its batch's instance count, so they start out at zero
+  if (frame.indirectDrawCount > 0) {
+    VkBufferCopy copy{0, 0,
+                      frame.indirectDrawCount * sizeof(VkDrawIndexedIndirectCommand)};
+    vkCmdCopyBuffer(cmd, frame.batchBuffer.memBuffer, frame.indirectBuffer.memBuffer, 1,
+                    &copy);
+  }
+  // and so does every compacted draw
+  vkCmdFillBuffer(cmd, frame.drawCountBuffer.memBuffer, 0, VK_WHOLE_SIZE, 0);
+
+  VkMemoryBarrier resetBarrier{};
+  resetBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  resetBarrier.pNext         = nullptr;
+  resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &resetBarrier, 0,
+                       nullptr, 0, nullptr);
+
+  // normalized side planes through the eye, for a view looking down +z
+  float P00     = frame.projection[0][0];
+  float P11     = frame.projection[1][1];
+  float xLength = std::sqrt(P00 * P00 + 1.f);
+  float yLength = std::sqrt(P11 * P11 + 1.f);
+
+  CullConstants constants{};
+  constants.view    = frame.view;
+  constants.frustum = glm::vec4(P00 / xLength, 1.f / xLength, std::abs(P11) / yLength,
+                                1.f / yLength);
+  constants.P00     = P00;
+  constants.P11     = P11;
+  constants.zNear   = zNear;
+  constants.zFar    = zFar;
+
+  VkExtent2D depthExtent = depthPyramid.getDepthExtent();
+  constants.depthSize    = glm::vec2(depthExtent.width, depthExtent.height);
+
+  constants.objectCount  = static_cast<uint32_t>(renderObjects.size());
+  constants.clusterCount = frame.clusterCount;
+  constants.lodScale     = frame.lodScale;
+  constants.flags        = 0;
+  if (frustumCulling) {
+    constants.flags |= CULL_FRUSTUM | CULL_CONE;
+  }
+  if (occlusionCulling && depthPyramidReady) {
+    constants.flags |= CULL_OCCLUSION;
+  }
 
-  // then, get the properties of those families.
-  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-  vkGetPhysicalDeviceQueueFamilyProperties(GPU, &queueFamilyCount, queueFamilies.data());
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1,
+                          &frame.cullDescriptor, 0, nullptr);
+  vkCmdPushConstants(cmd, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                     sizeof(CullConstants), &constants);
+  // a thread per object, then one per meshlet
+  uint32_t threadCount = constants.objectCount + constants.clusterCount;
+  vkCmdDispatch(cmd, (threadCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+  // Without a gpu-side draw count, the draws stay where they are, and the ones nothing
+  // was visible in just draw no instances
+  if (!drawIndirectCountSupported || frame.indirectDrawCount == 0) {
+    return;
+  }
 
-  uint32_t i = 0;
-  for (const auto &queueFamily : queueFamilies) {
-    // check to see if this gpu supports graphics. (lol)
-    if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-      // ignore these type conversion errors, they're bullshit.
-      indices.graphicsFamily = i;
+  // every instance count has to be in before a draw can be told apart from an empty one
+  VkMemoryBarrier cullBarrier{};
+  cullBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  cullBarrier.pNext         = nullptr;
+  cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  cullBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &cullBarrier, 0,
+                       nullptr, 0, nullptr);
+
+  constants.flags         = CULL_COMPACT;
+  constants.drawCount     = frame.indirectDrawCount;
+  constants.wideDrawStart = frame.groupDrawStarts[1];
+  vkCmdPushConstants(cmd, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                     sizeof(CullConstants), &constants);
+  vkCmdDispatch(cmd, (frame.indirectDrawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1,
+                1);
+}
+
+void VulkanEngine::setViewportAndScissor(VkCommandBuffer cmd) {
+  // the pipeline leaves the viewport and scissor up to us, so they follow the window
+  VkViewport viewport{};
+  viewport.x        = 0.0f;
+  viewport.y        = 0.0f;
+  viewport.width    = (float)swapChainExtent.width;
+  viewport.height   = (float)swapChainExtent.height;
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+  VkRect2D scissor{};
+  scissor.offset = {0, 0};
+  scissor.extent = swapChainExtent;
+  vkCmdSetScissor(cmd, 0, 1, &scissor);
+}
+
+void VulkanEngine::bindMeshPoolVertices(VkCommandBuffer cmd) {
+  // every stream has a buffer of its own, all starting at vertex 0
+  VkDeviceSize streamOffsets[MAX_VERTEX_STREAMS] = {0, 0};
+  uint32_t bindingCount = vertexStreams == VertexStreams::Interleaved ? 1 : 2;
+  VkBuffer streamBuffers[MAX_VERTEX_STREAMS] = {meshPool.streamBuffers[0].memBuffer,
+                                                meshPool.streamBuffers[1].memBuffer};
+  vkCmdBindVertexBuffers(cmd, 0, bindingCount, streamBuffers, streamOffsets);
+}
+
+void VulkanEngine::recordIndirectDraws(VkCommandBuffer cmd) {
+  FrameData &frame = getCurrentFrame();
+  setViewportAndScissor(cmd);
+
+  // every mesh object goes through the mesh pipeline and the pool, so everything gets
+  // bound exactly once
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipelineLayout, 0, 1,
+                          &frame.objectDescriptor, 0, nullptr);
+
+  MeshPushConstants constants;
+  constants.viewProj = frame.viewProj;
+  vkCmdPushConstants(cmd, meshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                     sizeof(MeshPushConstants), &constants);
+
+  bindMeshPoolVertices(cmd);
+
+  const VkIndexType indexTypes[INDEX_TYPE_COUNT] = {VK_INDEX_TYPE_UINT16,
+                                                    VK_INDEX_TYPE_UINT32};
+  const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+  for (uint32_t group = 0; group < INDEX_TYPE_COUNT; ++group) {
+    uint32_t drawCount = frame.groupDrawCounts[group];
+    if (drawCount == 0) {
+      continue;
     }
 
-    if (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) {
-      indices.computeFamily = i;
+    // one draw per batch, however many of its instances are visible. Batches that were
+    // culled entirely draw no instances.
+    vkCmdBindIndexBuffer(cmd, meshPool.indexBuffer.memBuffer, 0, indexTypes[group]);
+    VkDeviceSize commandOffset = VkDeviceSize(frame.groupDrawStarts[group]) * stride;
+
+    if (drawIndirectCountSupported) {
+      // unless the cull pass packed the ones with instances together and counted them,
+      // in which case the cpu's count is only an upper bound
+      cmdDrawIndexedIndirectCount(cmd, frame.compactedBuffer.memBuffer, commandOffset,
+                                  frame.drawCountBuffer.memBuffer,
+                                  group * sizeof(uint32_t), drawCount, stride);
+    } else if (multiDrawIndirectSupported) {
+      vkCmdDrawIndexedIndirect(cmd, frame.indirectBuffer.memBuffer, commandOffset,
+                               drawCount, stride);
+    } else {
+      // without multi draw, every indirect draw can only be one command long
+      for (uint32_t i = 0; i < drawCount; ++i) {
+        vkCmdDrawIndexedIndirect(cmd, frame.indirectBuffer.memBuffer,
+                                 commandOffset + i * stride, 1, stride);
+      }
     }
+  }
+}
 
-    // then, check to see if this family supports drawing on the SDL surface.
-    VkBool32 presentSupport{false};
-    vkGetPhysicalDeviceSurfaceSupportKHR(GPU, i, displaySurface, &presentSupport);
+void VulkanEngine::recordDraws(VkCommandBuffer cmd, size_t begin, size_t end) {
+  const FrameData &frame = getCurrentFrame();
 
-    if (presentSupport) {
-      indices.presentFamily = i;
+  // Secondary buffers don't inherit any state, so every slice sets its own
+  setViewportAndScissor(cmd);
+
+  bindMeshPoolVertices(cmd);
+
+  MeshPushConstants constants;
+  constants.viewProj = frame.viewProj;
+
+  VkPipeline boundPipeline   = VK_NULL_HANDLE;
+  VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+  for (size_t k = begin; k < end; ++k) {
+    const VisibleDraw &draw = frame.visibleDraws[k];
+
+    // only rebind when it actually changes
+    if (draw.pipeline != boundPipeline) {
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.pipeline);
+      boundPipeline = draw.pipeline;
+
+      if (draw.indexed) {
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                draw.pipelineLayout, 0, 1, &frame.objectDescriptor, 0,
+                                nullptr);
+        vkCmdPushConstants(cmd, draw.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                           sizeof(MeshPushConstants), &constants);
+      }
     }
 
-    if (indices.isComplete()) {
-      break;
+    if (!draw.indexed) {
+      // its high noon
+      vkCmdDraw(cmd, draw.count, draw.instanceCount, draw.first, draw.firstInstance);
+      continue;
     }
-    ++i;
+
+    if (draw.indexType != boundIndexType) {
+      vkCmdBindIndexBuffer(cmd, meshPool.indexBuffer.memBuffer, 0, draw.indexType);
+      boundIndexType = draw.indexType;
+    }
+    vkCmdDrawIndexed(cmd, draw.count, draw.instanceCount, draw.first, draw.vertexOffset,
+                     draw.firstInstance);
   }
-  return indices;
 }
-//------------------------------------------------------------------------
 
-// COMMAND INITIALIZATION FUNCTIONS
-//------------------------------------------------------------------------
-// Set up command pools for graphical commands, complete with buffers
-void VulkanEngine::initGraphicsCommands() {
-  QueueFamilyIndices queueFamilyIndices = findQueueFamilies(chosenGPU);
+// Primary loop of the engine.
+void VulkanEngine::run() {
+  if (headless) {
+    runHeadless();
+    return;
+  }
 
-  // each command pool can only execute commmands for one queue family, and in this case
-  // we've picked graphics
-  VkCommandPoolCreateInfo poolInfo{};
-  poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-  poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // optional
+  SDL_Event e;
+  bool bQuit = false;
 
-  // generate a command pool for each frame in the buffer
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-    // final creation of command pool
-    if (vkCreateCommandPool(device, &poolInfo, nullptr,
-                            &bufferFrames[i].graphicsCommandPool) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to create command pool!");
+  // main loop
+
+  while (!bQuit) {
+    CPU_ZONE("frame");
+
+    {
+      CPU_ZONE("poll events");
+      // ask SDL for everything that's happened since the last frame
+      while (SDL_PollEvent(&e) != 0) {
+        // if you hit  the x button, close the damn window
+        if (e.type == SDL_QUIT) {
+          bQuit = true;
+        }
+        if (e.type == SDL_KEYDOWN) {
+          if (e.key.keysym.sym == SDLK_a) {
+            camPos[0] += .05;
+          }
+          if (e.key.keysym.sym == SDLK_d) {
+            camPos[0] -= .05;
+          }
+          if (e.key.keysym.sym == SDLK_w) {
+            camPos[2] += .05;
+          }
+          if (e.key.keysym.sym == SDLK_s) {
+            camPos[2] -= .05;
+          }
+          // dump the last few thousand frames of cpu zones
+          if (e.key.keysym.sym == SDLK_F12) {
+            CpuProfiler::writeChromeTrace(tracePath);
+          }
+        }
+        // say what's under the cursor
+        if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) {
+          std::optional<uint32_t> picked = pickObject(e.button.x, e.button.y);
+          if (picked) {
+            std::cout << "picked object " << *picked << std::endl;
+          } else {
+            std::cout << "picked nothing" << std::endl;
+          }
+        }
+      }
     }
 
-    // now attach a command buffer to it
-    VkCommandBufferAllocateInfo commandBufferInfo{};
-    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferInfo.pNext = nullptr;
+    // then draw the picture
+    draw();
+    reportProfiling();
+  }
 
-    // tell the buffer which command pool it belongs to
-    commandBufferInfo.commandPool = bufferFrames[i].graphicsCommandPool;
-    // allocate a single command buffer
-    commandBufferInfo.commandBufferCount = 1;
-    // command level is Primary
-    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  if (traceOnExit) {
+    CpuProfiler::writeChromeTrace(tracePath);
+  }
+}
 
-    if (vkAllocateCommandBuffers(device, &commandBufferInfo,
-                                 &bufferFrames[i].graphicsCommandBuffer) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to allocate graphical command buffer!");
-    }
-    mainDeletionQueue.pushFunction([=]() {
-      vkDestroyCommandPool(device, bufferFrames[i].graphicsCommandPool, nullptr);
-    });
+// Render a fixed number of frames with nobody watching, and report how long they took.
+void VulkanEngine::runHeadless() {
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int i = 0; i < headlessFrameCount; ++i) {
+    CPU_ZONE("frame");
+    draw();
+    reportProfiling();
+  }
+  // the last frames might still be in flight, and they count too
+  vkDeviceWaitIdle(device);
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  double frameTime = elapsed.count() / std::max(headlessFrameCount, 1u);
+  std::cout << "rendered " << headlessFrameCount << " headless frames in "
+            << elapsed.count() << " ms (" << frameTime << " ms/frame, "
+            << 1000.0 / frameTime << " fps)" << std::endl;
+  gpuProfiler.printStats(std::cout);
+
+  if (traceOnExit) {
+    CpuProfiler::writeChromeTrace(tracePath);
   }
 }
 
-// Set up command pools for compute commands, complete with buffers.
-void VulkanEngine::initComputeCommands() {
-  QueueFamilyIndices queueFamilyIndices = findQueueFamilies(chosenGPU);
+// Every profileInterval frames, print the gpu timings and log them to the csv
+void VulkanEngine::reportProfiling() {
+  if (profileInterval == 0 || frameNumber % profileInterval != 0) {
+    return;
+  }
 
-  // each command pool can only execute commmands for one queue family, and in this case
-  // we've picked graphics
-  VkCommandPoolCreateInfo poolInfo{};
-  poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  poolInfo.queueFamilyIndex = queueFamilyIndices.computeFamily.value();
-  poolInfo.flags            = 0; // optional
+  gpuProfiler.printStats(std::cout);
+  if (!profileCsvPath.empty()) {
+    gpuProfiler.writeCsv(profileCsvPath, frameNumber);
+  }
+}
 
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-    // final creation of command pool
-    if (vkCreateCommandPool(device, &poolInfo, nullptr,
-                            &bufferFrames[i].computeCommandPool) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to create command pool!");
-    }
+// Get the extensions we need for the app to run
+std::vector<const char *> VulkanEngine::getRequiredExtensions() {
 
-    // now attach a command buffer to it
-    VkCommandBufferAllocateInfo commandBufferInfo{};
-    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferInfo.pNext = nullptr;
+  std::vector<const char *> extensions;
 
-    // tell the buffer which command pool it belongs to
-    commandBufferInfo.commandPool = bufferFrames[i].computeCommandPool;
-    // allocate a single command buffer
-    commandBufferInfo.commandBufferCount = 1;
-    // command level is Primary
-    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  // get the extensions SDL needs. Without a window we don't need any surface extensions.
+  if (!headless) {
+    uint32_t extensionCount{0};
 
-    if (vkAllocateCommandBuffers(device, &commandBufferInfo,
-                                 &bufferFrames[i].computeCommandBuffer) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to allocate graphical command buffer!");
-    }
-    mainDeletionQueue.pushFunction([=]() {
-      vkDestroyCommandPool(device, bufferFrames[i].computeCommandPool, nullptr);
-    });
+    SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, nullptr);
+
+    extensions.resize(extensionCount);
+    SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, extensions.data());
   }
+
+  if (enableValidationLayers) {
+    // adds the validation layers to the list if we've enabled them
+    extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+  }
+
+  return extensions;
 }
 
-// Just calls the above two functions
-void VulkanEngine::initCommands() {
-  initGraphicsCommands();
-  initComputeCommands();
+// Get the device extensions we need for the app to run
+std::vector<const char *> VulkanEngine::getRequiredDeviceExtensions() {
+  // nothing gets presented when headless, so the swapchain extension isn't needed
+  if (headless) {
+    return {};
+  }
+  return requiredDeviceExtensions;
+}
+
+// Create the vulkan context
+void VulkanEngine::createInstance() {
+  // if the validation layers are turned on, but aren't available on the system,
+  // panic.
+  if (enableValidationLayers && !checkValidationSupport()) {
+    throw std::runtime_error("validation layers requested, but not available!");
+  }
+
+  // create a struct to hold application info
+  VkApplicationInfo appInfo{};
+  appInfo.sType              = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  appInfo.pApplicationName   = "Vulkan Adventure";
+  appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+  appInfo.pEngineName        = "The Unibox";
+  appInfo.engineVersion      = VK_MAKE_VERSION(1, 0, 0);
+  appInfo.apiVersion         = VK_API_VERSION_1_0;
+
+  // create a struct to hold critical vulkan info
+  VkInstanceCreateInfo createInfo{};
+  createInfo.sType            = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  createInfo.pApplicationInfo = &appInfo;
+  createInfo.pNext            = nullptr;
+
+  // add the extensions SDL needs to the struct, plus the validation layers if necessary
+  auto extensions                    = getRequiredExtensions();
+  createInfo.enabledExtensionCount   = static_cast<uint32_t>(extensions.size());
+  createInfo.ppEnabledExtensionNames = extensions.data();
+
+  // if the validation layers are turned on, add them to the struct. Otherwise,
+  // tell the struct there are no layers turnd on.
+
+  if (enableValidationLayers) {
+    createInfo.enabledLayerCount   = static_cast<uint32_t>(validationLayers.size());
+    createInfo.ppEnabledLayerNames = validationLayers.data();
+
+  } else {
+    createInfo.enabledLayerCount = 0;
+  }
+
+  // make the instance
+  if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create instance!");
+  }
+}
+
+// make the surface to present to
+void VulkanEngine::createSurface() {
+  if (SDL_Vulkan_CreateSurface(window, instance, &displaySurface) != SDL_TRUE) {
+    std::cout << "can't create surface!";
+  };
+  SDL_SetWindowResizable(window, SDL_TRUE);
 }
 //------------------------------------------------------------------------
 
-// LOGICAL DEVICE CREATION
+// GPU SELECTION FUNCTIONS
 //------------------------------------------------------------------------
-void VulkanEngine::createDevice() {
-  // QUEUE CREATION
-  // make a struct to hold queue info
-  QueueFamilyIndices indices = findQueueFamilies(chosenGPU);
-  std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-  std::vector<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(),
-                                               indices.presentFamily.value(),
-                                               indices.computeFamily.value()};
+// Get the gpus on the system, and pick the best one we're allowed to use
+void VulkanEngine::pickPhysicalDevice() {
+  // first, get a list of all the devices on the system.
+  uint32_t deviceCount = 0;
+  vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
 
-  // for each queue family, fill in its struct and add it to the
-  // queueCreateInfos vector.
-  float queuePriority = 1.0f;
-  for (uint32_t queueFamily : uniqueQueueFamilies) {
-    // fill the struct
-    VkDeviceQueueCreateInfo queueCreateInfo{};
-    queueCreateInfo.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = queueFamily;
-    queueCreateInfo.queueCount       = 1;
-    queueCreateInfo.pQueuePriorities = &queuePriority;
+  // if we can't find any devices, throw a runtime error
+  if (deviceCount == 0) {
+    throw std::runtime_error("No GPUs with Vulkan support found!");
+  }
+
+  std::vector<VkPhysicalDevice> devices(deviceCount);
+  vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+  std::cout << "found " << deviceCount << " GPUs!" << std::endl;
+
+  // the command line wins over the environment
+  std::string forcedGPU = preferredGPU;
+  if (forcedGPU.empty() && std::getenv("VULKAN_ENGINE_GPU") != nullptr) {
+    forcedGPU = std::getenv("VULKAN_ENGINE_GPU");
+  }
+
+  // scores can be anything a custom scorer likes, negative included, so nothing's been
+  // picked until there's a best score at all
+  std::optional<int64_t> bestScore;
+  bool forcedFound = false;
+  for (uint32_t i = 0; i < deviceCount; ++i) {
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(devices[i], &deviceProperties);
+
+    if (!isDeviceSuitable(devices[i])) {
+      std::cout << "[" << i << "] " << deviceProperties.deviceName
+                << " can't run the engine, skipping it." << std::endl;
+      continue;
+    }
+
+    int64_t score = deviceScorer ? deviceScorer(devices[i]) : rateDevice(devices[i]);
+    std::cout << "[" << i << "] " << deviceProperties.deviceName << " scored " << score
+              << std::endl;
+
+    // a forced device beats anything the scoring says
+    if (!forcedGPU.empty() && deviceMatches(forcedGPU, i, deviceProperties.deviceName)) {
+      std::cout << "using " << deviceProperties.deviceName << " because it was asked for"
+                << std::endl;
+      chosenGPU   = devices[i];
+      bestScore   = score;
+      forcedFound = true;
+    } else if (!forcedFound && (!bestScore || score > *bestScore)) {
+      chosenGPU = devices[i];
+      bestScore = score;
+    }
+  }
+
+  // if we make it out of the loop without finding a qualified gpu, throw a runtime error.
+  if (!bestScore) {
+    throw std::runtime_error("No device found that supports all extensions!");
+  }
+
+  if (!forcedGPU.empty() && !forcedFound) {
+    std::cout << "no usable device matches \"" << forcedGPU
+              << "\", falling back to the highest score." << std::endl;
+  }
+
+  // keep the features of whatever we ended up with around, just in case.
+  vkGetPhysicalDeviceFeatures(chosenGPU, &GPUFeatures);
+}
+
+// Check to see if the GPU has all the features we require
+bool VulkanEngine::isDeviceSuitable(VkPhysicalDevice GPU) {
+  // first, get the basic properties of the device
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(GPU, &deviceProperties);
+
+  // then, get its supported extensions
+  uint32_t numExtensions{0};
+  vkEnumerateDeviceExtensionProperties(GPU, nullptr, &numExtensions, nullptr);
+
+  std::cout << "Your " << deviceProperties.deviceName << " supports " << numExtensions
+            << " extensions!" << std::endl;
+
+  std::vector<VkExtensionProperties> supportedExtensions(numExtensions);
+  vkEnumerateDeviceExtensionProperties(GPU, nullptr, &numExtensions,
+                                       supportedExtensions.data());
+
+  // then, check if the gpu supports all the extensions we need
+
+  // for every extension that the engine requires, check to see if the gpu has one in its
+  // supported list that matches. If there is even one missing, the device is out.
+  for (const char *requiredExtension : getRequiredDeviceExtensions()) {
+    std::cout << "Checking GPU support for " << requiredExtension << "..." << std::endl;
+
+    bool extensionFound = false;
+    for (const auto &extension : supportedExtensions) {
+      if (strcmp(extension.extensionName, requiredExtension) == 0) {
+        std::cout << "extension " << requiredExtension << " found!" << std::endl;
+        extensionFound = true;
+        break;
+      }
+    }
+    if (!extensionFound) {
+      return false;
+    }
+  } // if we make out of the loop, the gpu supports all the extensions we asked for.
+
+  // next, see if it has adequate support for making a swapchain
+  bool swapChainAdequate{headless};
+  if (!headless) {
+    SwapChainSupportDetails swapChainSupport = querySwapChainSupport(GPU);
+
+    // if it has at least one present mode and surface format, we're good.
+    swapChainAdequate =
+        !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+  }
+
+  // finally, check to see if it supports all the queue families we need.
+  QueueFamilyIndices indices = findQueueFamilies(GPU);
+
+  // return the result of all our queries. Any kind of device will do, how good it is
+  // gets decided by rateDevice().
+  return swapChainAdequate && indices.isComplete();
+}
+
+// Give a usable GPU a score, so we can pick the fastest one. Higher is better.
+int64_t VulkanEngine::rateDevice(VkPhysicalDevice GPU) {
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(GPU, &deviceProperties);
+
+  VkPhysicalDeviceFeatures deviceFeatures;
+  vkGetPhysicalDeviceFeatures(GPU, &deviceFeatures);
+
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  vkGetPhysicalDeviceMemoryProperties(GPU, &memoryProperties);
+
+  int64_t score = 0;
+
+  // the kind of device matters most. These are spaced out far enough that the other
+  // bonuses can't make an integrated gpu beat a discrete one.
+  switch (deviceProperties.deviceType) {
+  case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+    score += 100000;
+    break;
+  case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+    score += 50000;
+    break;
+  case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+    score += 20000;
+    break;
+  case VK_PHYSICAL_DEVICE_TYPE_CPU:
+    score += 10000;
+    break;
+  default:
+    break;
+  }
+
+  // more vram is better. One point per 16MB of the biggest device local heap.
+  VkDeviceSize largestHeap = 0;
+  for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i) {
+    if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      largestHeap = std::max(largestHeap, memoryProperties.memoryHeaps[i].size);
+    }
+  }
+  score += static_cast<int64_t>(largestHeap / (16 * 1024 * 1024));
+
+  // dedicated compute and transfer families can run alongside the graphics queue
+  uint32_t queueFamilyCount{0};
+  vkGetPhysicalDeviceQueueFamilyProperties(GPU, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(GPU, &queueFamilyCount, queueFamilies.data());
+
+  bool dedicatedCompute{false}, dedicatedTransfer{false};
+  for (const auto &queueFamily : queueFamilies) {
+    VkQueueFlags flags = queueFamily.queueFlags;
+    if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+      dedicatedCompute = true;
+    }
+    if ((flags & VK_QUEUE_TRANSFER_BIT) &&
+        !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      dedicatedTransfer = true;
+    }
+  }
+  score += dedicatedCompute ? 1000 : 0;
+  score += dedicatedTransfer ? 500 : 0;
+
+  // features we can make use of
+  score += deviceFeatures.multiDrawIndirect ? 250 : 0;
+  score += deviceFeatures.drawIndirectFirstInstance ? 250 : 0;
+  score += deviceProperties.limits.timestampComputeAndGraphics ? 100 : 0;
+
+  return score;
+}
+
+// See if a device is the one named in a --gpu / VULKAN_ENGINE_GPU forcedGPU. That's
+// either its index in the device list, or part of its name (case doesn't matter).
+bool VulkanEngine::deviceMatches(const std::string &forcedGPU, uint32_t index,
+                                 const char *deviceName) {
+  // the ctype functions only take unsigned chars, and device names can be anything
+  auto isDigit = [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; };
+  if (std::all_of(forcedGPU.begin(), forcedGPU.end(), isDigit)) {
+    // an index too big to parse can't be any device's
+    errno                     = 0;
+    unsigned long long wanted = std::strtoull(forcedGPU.c_str(), nullptr, 10);
+    return errno != ERANGE && wanted == index;
+  }
+
+  auto lower = [](std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](char c) {
+      return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    });
+    return text;
+  };
+  return lower(deviceName).find(lower(forcedGPU)) != std::string::npos;
+}
+
+// Check which queue families the device supports, and then mark down their indices
+VulkanEngine::QueueFamilyIndices VulkanEngine::findQueueFamilies(VkPhysicalDevice GPU) {
+  QueueFamilyIndices indices;
+  bool dedicatedCompute{false};
+
+  uint32_t queueFamilyCount{0};
+  // first, get the number of queue families the device supports
+  vkGetPhysicalDeviceQueueFamilyProperties(GPU, &queueFamilyCount, nullptr);
+
+  // then, get the properties of those families.
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(GPU, &queueFamilyCount, queueFamilies.data());
+
+  uint32_t i = 0;
+  for (const auto &queueFamily : queueFamilies) {
+    // check to see if this gpu supports graphics. (lol)
+    if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT && !indices.graphicsFamily) {
+      // ignore these type conversion errors, they're bullshit.
+      indices.graphicsFamily = i;
+    }
+
+    // a compute-only family usually means separate hardware queues, so compute work
+    // can actually run alongside rendering. Take one of those if there is one.
+    if (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) {
+      bool dedicated = !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+      if (!indices.computeFamily || (dedicated && !dedicatedCompute)) {
+        indices.computeFamily = i;
+        dedicatedCompute      = dedicated;
+      }
+    }
+
+    // a transfer-only family is the dma engine, which can copy without getting in the
+    // way of anything else
+    if (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT &&
+        !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+        !indices.transferFamily) {
+      indices.transferFamily = i;
+    }
+
+    // then, check to see if this family supports drawing on the SDL surface. With no
+    // surface, the graphics family stands in for presentation.
+    VkBool32 presentSupport{false};
+    if (!headless) {
+      vkGetPhysicalDeviceSurfaceSupportKHR(GPU, i, displaySurface, &presentSupport);
+    }
+
+    // presenting from the graphics family saves handing images between queues
+    if (presentSupport && (!indices.presentFamily || indices.graphicsFamily == i)) {
+      indices.presentFamily = i;
+    }
+    ++i;
+  }
+
+  if (headless) {
+    indices.presentFamily = indices.graphicsFamily;
+  }
+  // graphics queues can always copy
+  if (!indices.transferFamily) {
+    indices.transferFamily = indices.graphicsFamily;
+  }
+  return indices;
+}
+//------------------------------------------------------------------------
+
+// COMMAND INITIALIZATION FUNCTIONS
+//------------------------------------------------------------------------
+// Set up command pools for graphical commands, complete with buffers
+void VulkanEngine::initGraphicsCommands() {
+  QueueFamilyIndices queueFamilyIndices = findQueueFamilies(chosenGPU);
+
+  // each command pool can only execute commmands for one queue family, and in this case
+  // we've picked graphics
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // optional
+
+  // generate a command pool for each frame in the buffer
+  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    // final creation of command pool
+    if (vkCreateCommandPool(device, &poolInfo, nullptr,
+                            &bufferFrames[i].graphicsCommandPool) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create command pool!");
+    }
+
+    // now attach a command buffer to it
+    VkCommandBufferAllocateInfo commandBufferInfo{};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferInfo.pNext = nullptr;
+
+    // tell the buffer which command pool it belongs to
+    commandBufferInfo.commandPool = bufferFrames[i].graphicsCommandPool;
+    // allocate a single command buffer
+    commandBufferInfo.commandBufferCount = 1;
+    // command level is Primary
+    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+    if (vkAllocateCommandBuffers(device, &commandBufferInfo,
+                                 &bufferFrames[i].graphicsCommandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate graphical command buffer!");
+    }
+    mainDeletionQueue.pushFunction([=]() {
+      vkDestroyCommandPool(device, bufferFrames[i].graphicsCommandPool, nullptr);
+    });
+  }
+}
+
+// Set up command pools for compute commands, complete with buffers.
+void VulkanEngine::initComputeCommands() {
+  QueueFamilyIndices queueFamilyIndices = findQueueFamilies(chosenGPU);
+
+  // each command pool can only execute commmands for one queue family, and in this case
+  // we've picked graphics
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.queueFamilyIndex = queueFamilyIndices.computeFamily.value();
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    // final creation of command pool
+    if (vkCreateCommandPool(device, &poolInfo, nullptr,
+                            &bufferFrames[i].computeCommandPool) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create command pool!");
+    }
+
+    // now attach a command buffer to it
+    VkCommandBufferAllocateInfo commandBufferInfo{};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferInfo.pNext = nullptr;
+
+    // tell the buffer which command pool it belongs to
+    commandBufferInfo.commandPool = bufferFrames[i].computeCommandPool;
+    // allocate a single command buffer
+    commandBufferInfo.commandBufferCount = 1;
+    // command level is Primary
+    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+    if (vkAllocateCommandBuffers(device, &commandBufferInfo,
+                                 &bufferFrames[i].computeCommandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate graphical command buffer!");
+    }
+    mainDeletionQueue.pushFunction([=]() {
+      vkDestroyCommandPool(device, bufferFrames[i].computeCommandPool, nullptr);
+    });
+  }
+}
+
+uint32_t VulkanEngine::getJobWorkerCount() const {
+  // leave a core for the main thread, it runs jobs too
+  if (jobThreadCount == 0) {
+    return std::max(1u, std::thread::hardware_concurrency()) - 1;
+  }
+  return jobThreadCount;
+}
+
+// Sets up the command pools for every queue, and the recording threads with theirs
+void VulkanEngine::initCommands() {
+  initGraphicsCommands();
+  initComputeCommands();
+
+  // pushed first so it's stopped last, once nothing's left using it
+  jobs.init(getJobWorkerCount());
+  mainDeletionQueue.pushFunction([=]() { jobs.cleanup(); });
+
+  recorder.init(device, findQueueFamilies(chosenGPU).graphicsFamily.value(),
+                MAX_FRAMES_IN_FLIGHT, jobs);
+  mainDeletionQueue.pushFunction([=]() { recorder.cleanup(); });
+
+  culler.init(jobs);
+  mainDeletionQueue.pushFunction([=]() { culler.cleanup(); });
+}
+//------------------------------------------------------------------------
+
+// LOGICAL DEVICE CREATION
+//------------------------------------------------------------------------
+void VulkanEngine::createDevice() {
+  // QUEUE CREATION
+  // make a struct to hold queue info
+  QueueFamilyIndices indices = findQueueFamilies(chosenGPU);
+  std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+  // families can double up (graphics and present almost always do), and each one can
+  // only be asked for once
+  std::set<uint32_t> uniqueQueueFamilies = {
+      indices.graphicsFamily.value(), indices.presentFamily.value(),
+      indices.computeFamily.value(), indices.transferFamily.value()};
+
+  // for each queue family, fill in its struct and add it to the
+  // queueCreateInfos vector.
+  float queuePriority = 1.0f;
+  for (uint32_t queueFamily : uniqueQueueFamilies) {
+    // fill the struct
+    VkDeviceQueueCreateInfo queueCreateInfo{};
+    queueCreateInfo.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreateInfo.queueFamilyIndex = queueFamily;
+    queueCreateInfo.queueCount       = 1;
+    queueCreateInfo.pQueuePriorities = &queuePriority;
+
+    // add it to the infos vector
+    queueCreateInfos.push_back(queueCreateInfo);
+  }
+  // END QUEUE CREATION
+
+  // DEVICE CREATION
+  // make a struct to hold all the device info
+  VkDeviceCreateInfo deviceInfo{};
+  deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  deviceInfo.pNext = nullptr;
+
+  // give it the queue info we just put together
+  deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+  deviceInfo.pQueueCreateInfos    = queueCreateInfos.data();
+
+  // Only turn on the features indirect drawing wants. Picking objects by firstInstance
+  // is what lets one indirect draw cover many objects, so it's that or direct draws.
+  vkGetPhysicalDeviceFeatures(chosenGPU, &GPUFeatures);
+
+  VkPhysicalDeviceFeatures enabledFeatures{};
+  enabledFeatures.multiDrawIndirect         = GPUFeatures.multiDrawIndirect;
+  enabledFeatures.drawIndirectFirstInstance = GPUFeatures.drawIndirectFirstInstance;
+  deviceInfo.pEnabledFeatures               = &enabledFeatures;
+
+  multiDrawIndirectSupported = GPUFeatures.multiDrawIndirect == VK_TRUE;
+
+  // the depth pyramid gets built right after the main pass, on the graphics queue
+  uint32_t queueFamilyCount{0};
+  vkGetPhysicalDeviceQueueFamilyProperties(chosenGPU, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(chosenGPU, &queueFamilyCount,
+                                           queueFamilies.data());
+  VkQueueFlags graphicsFlags = queueFamilies[indices.graphicsFamily.value()].queueFlags;
+  if (occlusionCulling && !(graphicsFlags & VK_QUEUE_COMPUTE_BIT)) {
+    std::cout << "Graphics queue can't run compute, turning off occlusion culling"
+              << std::endl;
+    occlusionCulling = false;
+  }
+  if (indirectDraws && GPUFeatures.drawIndirectFirstInstance != VK_TRUE) {
+    std::cout << "No drawIndirectFirstInstance, falling back to direct draws"
+              << std::endl;
+    indirectDraws = false;
+  }
+
+  // tell the device what device extensions we're using, plus whichever optional ones
+  // it has
+  std::vector<const char *> deviceExtensions = getRequiredDeviceExtensions();
+
+  uint32_t numExtensions{0};
+  vkEnumerateDeviceExtensionProperties(chosenGPU, nullptr, &numExtensions, nullptr);
+  std::vector<VkExtensionProperties> supportedExtensions(numExtensions);
+  vkEnumerateDeviceExtensionProperties(chosenGPU, nullptr, &numExtensions,
+                                       supportedExtensions.data());
+
+  for (const char *optionalExtension : optionalDeviceExtensions) {
+    for (const auto &extension : supportedExtensions) {
+      if (strcmp(extension.extensionName, optionalExtension) != 0) {
+        continue;
+      }
+      deviceExtensions.push_back(optionalExtension);
+      if (strcmp(optionalExtension, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0) {
+        drawIndirectCountSupported = true;
+      }
+      break;
+    }
+  }
+  deviceInfo.enabledExtensionCount   = static_cast<uint32_t>(deviceExtensions.size());
+  deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+  // tell the device whether or not we're using validation layers.
+  if (enableValidationLayers) {
+    deviceInfo.enabledLayerCount   = static_cast<uint32_t>(validationLayers.size());
+    deviceInfo.ppEnabledLayerNames = validationLayers.data();
+  } else {
+    deviceInfo.enabledLayerCount = 0;
+  }
+
+  // actually create the device!
+  if (vkCreateDevice(chosenGPU, &deviceInfo, nullptr, &device) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create logical device!");
+  }
+
+  // END DEVICE CREATION
+
+  // extension functions aren't exported by the loader, they have to be looked up
+  if (drawIndirectCountSupported) {
+    cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)
+        vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+    drawIndirectCountSupported = cmdDrawIndexedIndirectCount != nullptr;
+  }
+
+  // attach the queues to their handles
+  queueFamilyIndices = indices;
+  vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+  vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+  vkGetDeviceQueue(device, indices.computeFamily.value(), 0, &computeQueue);
+  vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
+}
+//------------------------------------------------------------------------
+
+// SWAPCHAIN CREATION FUNCTIONS
+//-----------------------------------------------------------------------
+// See if the GPU has minimum support for our swapchain
+VulkanEngine::SwapChainSupportDetails
+VulkanEngine::querySwapChainSupport(VkPhysicalDevice GPU) {
+
+  SwapChainSupportDetails details;
+  // Get the surface capabilities of our device
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(GPU, displaySurface, &details.capabilities);
+
+  // Get the supported surface formats
+  uint32_t formatCount;
+  vkGetPhysicalDeviceSurfaceFormatsKHR(GPU, displaySurface, &formatCount, nullptr);
+
+  if (formatCount != 0) {
+    details.formats.resize(formatCount);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(GPU, displaySurface, &formatCount,
+                                         details.formats.data());
+  }
+
+  // Get the supported present modes
+  uint32_t presentModeCount;
+  vkGetPhysicalDeviceSurfacePresentModesKHR(GPU, displaySurface, &presentModeCount,
+                                            nullptr);
+
+  if (presentModeCount != 0) {
+    details.presentModes.resize(presentModeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(GPU, displaySurface, &presentModeCount,
+                                              details.presentModes.data());
+  }
+  return details;
+}
+
+// Choose the surface color output format. Basically, pick a colorspace.
+VkSurfaceFormatKHR VulkanEngine::chooseSwapSurfaceFormat(
+    const std::vector<VkSurfaceFormatKHR> &availableFormats) {
+  for (const auto &availableFormat : availableFormats) {
+    if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB &&
+        availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+      return availableFormat;
+    }
+  }
+
+  return availableFormats[0];
+}
+
+// Choose the vsync/present mode. see obsidian note "Vulkan present modes" for
+// details.
+VkPresentModeKHR VulkanEngine::chooseSwapPresentMode(
+    const std::vector<VkPresentModeKHR> &availablePresentModes) {
+
+  // triple buffer if we have it
+  for (const auto &availablePresentMode : availablePresentModes) {
+    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+      return availablePresentMode;
+    }
+  }
+  // otherwise standard vsync
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// Set the resolution of the swapchain images, in pixels
+VkExtent2D VulkanEngine::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) {
+
+  if (capabilities.currentExtent.width != UINT32_MAX) {
+    return capabilities.currentExtent;
+  } else {
+    int width, height;
+    SDL_GetWindowSize(window, &width, &height);
+
+    VkExtent2D actualExtent = {static_cast<uint32_t>(width),
+                               static_cast<uint32_t>(height)};
+
+    // clamp the size to between the surface's specified max and min
+    actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width,
+                                    capabilities.maxImageExtent.width);
+
+    actualExtent.height =
+        std::clamp(actualExtent.height, capabilities.minImageExtent.height,
+                   capabilities.maxImageExtent.height);
+    return actualExtent;
+  }
+}
+
+// Build the swapchain
+void VulkanEngine::createSwapChain() {
+
+  swapChainSupport = querySwapChainSupport(chosenGPU);
+  // minimum amount of images the swapchain needs to function, +1 to avoid
+  // driver hangups
+  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+
+  // if there is a max # of images, and we've exceeded it, set it to the max instead
+  if (swapChainSupport.capabilities.maxImageCount > 0 &&
+      imageCount > swapChainSupport.capabilities.maxImageCount) {
+
+    imageCount = swapChainSupport.capabilities.maxImageCount;
+  }
+
+  // get the basic specs of our swapchain
+  VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+  VkPresentModeKHR presentMode     = chooseSwapPresentMode(swapChainSupport.presentModes);
+  VkExtent2D extent                = chooseSwapExtent(swapChainSupport.capabilities);
+
+  // fill in the struct for swapchain creation
+  VkSwapchainCreateInfoKHR createInfo{};
+  createInfo.sType           = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+  createInfo.surface         = displaySurface;
+  createInfo.minImageCount   = imageCount;
+  createInfo.imageFormat     = surfaceFormat.format;
+  createInfo.imageColorSpace = surfaceFormat.colorSpace;
+  createInfo.imageExtent     = extent;
+
+  // this is always 1 unless you're doing stereoscopic 3D
+  createInfo.imageArrayLayers = 1;
+
+  // tell vulkan we're rendering these images directly
+  createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+  QueueFamilyIndices indices    = findQueueFamilies(chosenGPU);
+  uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(),
+                                   indices.presentFamily.value()};
+
+  // determines whether or not image sharing is sloppy or exclusive
+  if (indices.graphicsFamily != indices.presentFamily) {
+    createInfo.imageSharingMode      = VK_SHARING_MODE_CONCURRENT;
+    createInfo.queueFamilyIndexCount = 2;
+    createInfo.pQueueFamilyIndices   = queueFamilyIndices;
+  } else {
+    createInfo.imageSharingMode      = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.queueFamilyIndexCount = 0;       // optional
+    createInfo.pQueueFamilyIndices   = nullptr; // optional
+  }
+
+  // don't do anything special to the image
+  createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+  // ignore the alpha channel for blending
+  createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+
+  createInfo.presentMode = presentMode;
+  // ignore the color of pixels that are obscured
+  createInfo.clipped = VK_TRUE;
+  // this is for recreating a swapchain when needed, as we need the "old" version to do
+  // that.
+  createInfo.oldSwapchain = VK_NULL_HANDLE;
+  // almost there!
+
+  if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create swapchain!");
+  }
+
+  // now we have to retrieve the swapchain images!
+  // first, query the actual number of images (not the minimum, which we defined at the
+  // beginning of the function)
+  vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
+  // then, we resize the vector to fit the actual number of images
+  swapChainImages.resize(imageCount);
+  // then, do the grad student shuffle!
+  vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+
+  // store the format and extent for later
+  swapChainImageFormat = surfaceFormat.format;
+  swapChainExtent      = extent;
+
+  // add the swapchain to the deletion queue
+  swapChainDeletionQueue.pushFunction(
+      [=]() { vkDestroySwapchainKHR(device, swapChain, nullptr); });
+}
+
+// Make the images we render into when there's no swapchain to hand them to us
+void VulkanEngine::createOffscreenImages() {
+  // match what a desktop swapchain would normally give us
+  swapChainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+  swapChainExtent      = windowExtent;
+
+  VkImageCreateInfo imageInfo = vkinit::imageCreateInfo(
+      swapChainImageFormat,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      {swapChainExtent.width, swapChainExtent.height, 1});
+
+  // the images live in vram, the cpu never touches them
+  VmaAllocationCreateInfo allocInfo{};
+  allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+  // one image per frame in flight, so two frames never draw into the same one
+  offscreenImages.resize(MAX_FRAMES_IN_FLIGHT);
+  swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+
+  for (size_t i = 0; i < offscreenImages.size(); ++i) {
+    if (vmaCreateImage(allocator, &imageInfo, &allocInfo, &offscreenImages[i].memImage,
+                       &offscreenImages[i].allocation, nullptr) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create offscreen image!");
+    }
+
+    // the rest of the pipeline (image views, framebuffers) just sees them as swapchain
+    // images
+    swapChainImages[i] = offscreenImages[i].memImage;
+
+    swapChainDeletionQueue.pushFunction([=]() {
+      vmaDestroyImage(allocator, offscreenImages[i].memImage,
+                      offscreenImages[i].allocation);
+    });
+  }
+}
+
+// Wipe out the swapchain and its associated objects so we can rebuild it
+void VulkanEngine::cleanupSwapChain() { swapChainDeletionQueue.flush(); }
+
+// Rebuild the swapchain. Called when the window is resized or minimized.
+void VulkanEngine::recreateSwapChain() {
+  SDL_Event e;
+  vkDeviceWaitIdle(device);
+
+  // first set the new resolution of the window, so the swapchain doesn't get confused
+  int width, height;
+
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(chosenGPU, displaySurface,
+                                            &swapChainSupport.capabilities);
+
+  if (swapChainSupport.capabilities.currentExtent.width == 0 ||
+      swapChainSupport.capabilities.currentExtent.height == 0) {
+    // We have to make the window non-resizable so that it doesn't eat 10 pixels off each
+    // axis during un-minimization. Don't ask me why, I don't know.
+    SDL_SetWindowResizable(window, SDL_FALSE);
+  }
+
+  while (swapChainSupport.capabilities.currentExtent.width == 0 ||
+         swapChainSupport.capabilities.currentExtent.height == 0) {
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(chosenGPU, displaySurface,
+                                              &swapChainSupport.capabilities);
+    SDL_WaitEvent(&e);
+  }
+
+  windowExtent.width =
+      static_cast<uint32_t>(swapChainSupport.capabilities.currentExtent.width);
+  windowExtent.height =
+      static_cast<uint32_t>(swapChainSupport.capabilities.currentExtent.height);
+
+  // std::cout << "window has been resized to " << windowX << " wide and " << windowY << "
+  // tall\n";
+
+  cleanupSwapChain();
+
+  // the render pass and pipelines only care about the image format, which comes from
+  // the same surface every time, and the viewport is dynamic. So only the stuff that
+  // actually has the window's size baked in needs rebuilding.
+  createSwapChain();
+  createImageViews();
+  createDepthResources();
+  createFramebuffers();
+  // the new pyramid has nothing in it until a frame's been drawn at the new size
+  createDepthPyramid();
+  depthPyramidReady = false;
+
+  SDL_SetWindowResizable(window, SDL_TRUE);
+}
+//-----------------------------------------------------------------------
+
+// PIPELINE SETUP FUNCTIONS
+//-----------------------------------------------------------------------
+// Tell the vulkan context how to look at the images we make
+void VulkanEngine::createImageViews() {
+  // make the imageviews list as big as the actual swapchain
+  swapChainImageViews.resize(swapChainImages.size());
+
+  for (size_t i = 0; i < swapChainImages.size(); ++i) {
+    VkImageViewCreateInfo createInfo{};
+    createInfo.sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    createInfo.image    = swapChainImages[i];
+    createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    createInfo.format   = swapChainImageFormat;
+
+    // this allows you to swizzle all the colors around if you want. These settings make
+    // it do nothing.
+    createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+
+    // describe the image's purpose and specs
+    createInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    createInfo.subresourceRange.baseMipLevel   = 0;
+    createInfo.subresourceRange.levelCount     = 1;
+    createInfo.subresourceRange.baseArrayLayer = 0;
+    createInfo.subresourceRange.layerCount     = 1;
+
+    // make the image view for real
+    if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("Failed to create image views!");
+    }
+    swapChainDeletionQueue.pushFunction(
+        [=]() { vkDestroyImageView(device, swapChainImageViews[i], nullptr); });
+  }
+}
+
+// Make the depth buffer, which gets sampled afterwards to build the depth pyramid
+void VulkanEngine::createDepthResources() {
+  // 32 bit float if the device can sample it, otherwise 16 bit, which is always there
+  if (depthFormat == VK_FORMAT_UNDEFINED) {
+    const VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                          VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    for (VkFormat format : {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM}) {
+      VkFormatProperties properties;
+      vkGetPhysicalDeviceFormatProperties(chosenGPU, format, &properties);
+      if ((properties.optimalTilingFeatures & features) == features) {
+        depthFormat = format;
+        break;
+      }
+    }
+  }
+
+  VkImageCreateInfo imageInfo = vkinit::imageCreateInfo(
+      depthFormat,
+      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      {swapChainExtent.width, swapChainExtent.height, 1});
+
+  VmaAllocationCreateInfo allocInfo{};
+  allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+  if (vmaCreateImage(allocator, &imageInfo, &allocInfo, &depthImage.memImage,
+                     &depthImage.allocation, nullptr) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the depth buffer!");
+  }
+
+  VkImageViewCreateInfo viewInfo = vkinit::imageViewCreateInfo(
+      depthFormat, depthImage.memImage, VK_IMAGE_ASPECT_DEPTH_BIT);
+  if (vkCreateImageView(device, &viewInfo, nullptr, &depthImageView) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the depth buffer view!");
+  }
+
+  swapChainDeletionQueue.pushFunction([=]() {
+    vkDestroyImageView(device, depthImageView, nullptr);
+    vmaDestroyImage(allocator, depthImage.memImage, depthImage.allocation);
+  });
+}
+
+// Create a render pass
+void VulkanEngine::createRenderPass() {
+  // an attachment is basically a render target
+  VkAttachmentDescription colorAttachment{};
+  colorAttachment.format  = swapChainImageFormat;
+  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+
+  // clear the framebuffer to black before drawing a new frame
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  // store the rendered shit in memory so it can... be rendered
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+  // not using stencils, so we don't give a shit about the load and store
+  colorAttachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+  // we don't care what the previous layout of the image was
+  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  // we're using the image to be presented, or copied out if there's no screen
+  colorAttachment.finalLayout =
+      headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  VkAttachmentReference colorAttachmentRef{};
+  colorAttachmentRef.attachment = 0;
+  colorAttachmentRef.layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  // depth starts cleared every frame, and gets kept for the depth pyramid afterwards
+  VkAttachmentDescription depthAttachment{};
+  depthAttachment.format         = depthFormat;
+  depthAttachment.samples        = VK_SAMPLE_COUNT_1_BIT;
+  depthAttachment.loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+  depthAttachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+  depthAttachment.finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  VkAttachmentReference depthAttachmentRef{};
+  depthAttachmentRef.attachment = 1;
+  depthAttachmentRef.layout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkSubpassDescription subpass{};
+  // you can also bind this to compute. Very interesting...
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  // The index of the attachment in this array is directly referenced from the fragment
+  // shader with the layout(location = 0) out vec4 outColor directive!
+  subpass.colorAttachmentCount    = 1;
+  subpass.pColorAttachments       = &colorAttachmentRef;
+  subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+  VkSubpassDependency dependencies[2] = {};
+  // Don't write color until the image is back from being presented, or clear depth until
+  // last frame's pyramid build is done reading it
+  dependencies[0].srcSubpass    = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass    = 0;
+  dependencies[0].srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  dependencies[0].srcAccessMask = 0;
+  dependencies[0].dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                  VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  // and the pyramid build doesn't start reading depth until it's all written
+  dependencies[1].srcSubpass    = 0;
+  dependencies[1].dstSubpass    = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask  = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstStageMask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  VkAttachmentDescription attachments[2] = {colorAttachment, depthAttachment};
+
+  VkRenderPassCreateInfo renderPassInfo{};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  // connect the attachments to the render pass
+  renderPassInfo.attachmentCount = 2;
+  renderPassInfo.pAttachments    = attachments;
+  // connect the subpass to the render pass
+  renderPassInfo.subpassCount    = 1;
+  renderPassInfo.pSubpasses      = &subpass;
+  renderPassInfo.dependencyCount = 2;
+  renderPassInfo.pDependencies   = dependencies;
+
+  if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create render pass!");
+  }
+
+  mainDeletionQueue.pushFunction(
+      [=]() { vkDestroyRenderPass(device, renderPass, nullptr); });
+}
+
+// Create framebuffers to put data into
+void VulkanEngine::createFramebuffers() {
+  // make as many framebuffers as there are images
+  VkFramebufferCreateInfo fbInfo{};
+  fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  fbInfo.pNext = nullptr;
+
+  fbInfo.renderPass      = renderPass;
+  fbInfo.attachmentCount = 2;
+  fbInfo.width           = windowExtent.width;
+  fbInfo.height          = windowExtent.height;
+  fbInfo.layers          = 1;
+
+  const uint32_t swapChainImageCount = swapChainImages.size();
+  swapChainFramebuffers.resize(swapChainImageCount);
+
+  for (int i = 0; i < swapChainImageCount; ++i) {
+    // every framebuffer shares the one depth buffer
+    VkImageView attachments[2] = {swapChainImageViews[i], depthImageView};
+    fbInfo.pAttachments        = attachments;
+    if (vkCreateFramebuffer(device, &fbInfo, nullptr, &swapChainFramebuffers[i]) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("Failed to create framebuffer!");
+    }
+
+    swapChainDeletionQueue.pushFunction(
+        [=]() { vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr); });
+  }
+}
+// Make semaphores and fences for each frame in the swapchain
+void VulkanEngine::createSyncStructures() {
+  // resize the semaphore vectors to the amount of concurrent frames possible
+
+  // grug fill in tiny semaphore struct
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = nullptr;
+  semaphoreInfo.flags = 0;
+
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  // turn the fence on by default so rendering can actually start.
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+  // make fences and semaphores for each frame in the buffer
+  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    vkCreateFence(device, &fenceInfo, nullptr, &bufferFrames[i].renderFence);
+    // make semaphores for image availability and render status, and make fences for
+    // cpu-gpu sync.
+
+    vkCreateSemaphore(device, &semaphoreInfo, nullptr, &bufferFrames[i].presentSemaphore);
+    vkCreateSemaphore(device, &semaphoreInfo, nullptr, &bufferFrames[i].renderSemaphore);
+    vkCreateSemaphore(device, &semaphoreInfo, nullptr, &bufferFrames[i].computeSemaphore);
+    vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+                      &bufferFrames[i].depthPyramidSemaphore);
+
+    mainDeletionQueue.pushFunction(
+        [=]() { vkDestroyFence(device, bufferFrames[i].renderFence, nullptr); });
+
+    mainDeletionQueue.pushFunction(
+        [=]() { vkDestroySemaphore(device, bufferFrames[i].presentSemaphore, nullptr); });
+
+    mainDeletionQueue.pushFunction(
+        [=]() { vkDestroySemaphore(device, bufferFrames[i].renderSemaphore, nullptr); });
+
+    mainDeletionQueue.pushFunction(
+        [=]() { vkDestroySemaphore(device, bufferFrames[i].computeSemaphore, nullptr); });
+
+    mainDeletionQueue.pushFunction([=]() {
+      vkDestroySemaphore(device, bufferFrames[i].depthPyramidSemaphore, nullptr);
+    });
+  }
+}
+
+// Make a timestamp query pool for each frame in flight, if the profiler can use them
+void VulkanEngine::createQueryPools() {
+  if (!gpuProfiler.isEnabled()) {
+    return;
+  }
+
+  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    bufferFrames[i].timestampPool = gpuProfiler.createQueryPool();
+
+    mainDeletionQueue.pushFunction(
+        [=]() { vkDestroyQueryPool(device, bufferFrames[i].timestampPool, nullptr); });
+  }
+}
+
+// Set up the graphics pipeline(s)
+void VulkanEngine::createPipelines() {
+  VkShaderModule fragShader;
+  if (!loadShaderModule("shaders/shader.frag.spv", &fragShader)) {
+    throw std::runtime_error("Failed to build the fragment shader module!");
+  }
+
+  VkShaderModule vertShader;
+  if (!loadShaderModule("shaders/shader.vert.spv", &vertShader)) {
+    throw std::runtime_error("Failed to build the vertex shader module!");
+  }
+
+  // create the pipeline layout in its default config
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+
+  vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
+
+  // now make the pipeline
+
+  PipelineBuilder pipelineBuilder;
+
+  // tell the pipeline about our shader stages
+  pipelineBuilder.shaderStages.push_back(
+      vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, vertShader));
+  pipelineBuilder.shaderStages.push_back(
+      vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, fragShader));
+
+  // tell the pipeline about vertex buffers and shit
+  pipelineBuilder.vertexInputInfo = vkinit::vertexInputStateCreateInfo();
+  // tell the pipeline how to put verts together
+  pipelineBuilder.inputAssembly =
+      vkinit::inputAssemblyCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+  // the viewport and scissor get set every frame in recordCommands, so a resize doesn't
+  // mean a new pipeline
+  pipelineBuilder.dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+  // build the rasterizer
+  pipelineBuilder.rasterizer = vkinit::rasterizationStateCreateInfo(VK_POLYGON_MODE_FILL);
+
+  // no multisampling
+  pipelineBuilder.multisampling = vkinit::multisampleStateCreateInfo();
+  // no blending
+  pipelineBuilder.colorBlendAttachment = vkinit::colorBlendAttachmentState();
+  // nearest thing wins, like you'd expect
+  pipelineBuilder.depthStencil =
+      vkinit::depthStencilCreateInfo(true, true, VK_COMPARE_OP_LESS_OR_EQUAL);
+
+  // attach the layout
+  pipelineBuilder.pipelineLayout = pipelineLayout;
+  pipelineBuilder.pipelineCache  = pipelineCache;
+
+  renderPipeline = pipelineBuilder.buildPipeline(device, renderPass);
+
+  // now the mesh pipeline, which reads real vertices and object matrices
+  VkShaderModule meshVertShader;
+  if (!loadShaderModule(VertexFormat<GpuVertex>::vertexShader, &meshVertShader)) {
+    throw std::runtime_error("Failed to build the mesh vertex shader module!");
+  }
+
+  // room for the camera matrix, pushed once per pass
+  VkPushConstantRange pushConstant{};
+  pushConstant.offset     = 0;
+  pushConstant.size       = sizeof(MeshPushConstants);
+  pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+  VkPipelineLayoutCreateInfo meshLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+  meshLayoutInfo.pushConstantRangeCount     = 1;
+  meshLayoutInfo.pPushConstantRanges        = &pushConstant;
+  meshLayoutInfo.setLayoutCount             = 1;
+  meshLayoutInfo.pSetLayouts                = &objectSetLayout;
+
+  vkCreatePipelineLayout(device, &meshLayoutInfo, nullptr, &meshPipelineLayout);
+
+  // same fragment shader, the vertex colors come through the same way
+  pipelineBuilder.shaderStages.clear();
+  pipelineBuilder.shaderStages.push_back(
+      vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, meshVertShader));
+  pipelineBuilder.shaderStages.push_back(
+      vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, fragShader));
+
+  // hook the vertex format up to the pipeline
+  VertexInputDescription vertexDescription = describeVertex<GpuVertex>(vertexStreams);
+
+  pipelineBuilder.vertexInputInfo.vertexBindingDescriptionCount =
+      static_cast<uint32_t>(vertexDescription.bindings.size());
+  pipelineBuilder.vertexInputInfo.pVertexBindingDescriptions =
+      vertexDescription.bindings.data();
+  pipelineBuilder.vertexInputInfo.vertexAttributeDescriptionCount =
+      static_cast<uint32_t>(vertexDescription.attributes.size());
+  pipelineBuilder.vertexInputInfo.pVertexAttributeDescriptions =
+      vertexDescription.attributes.data();
+
+  pipelineBuilder.pipelineLayout = meshPipelineLayout;
+
+  meshPipeline = pipelineBuilder.buildPipeline(device, renderPass);
+
+  // destroy the shader modules, as we don't need them once the pipeline is created
+  vkDestroyShaderModule(device, fragShader, nullptr);
+  vkDestroyShaderModule(device, vertShader, nullptr);
+  vkDestroyShaderModule(device, meshVertShader, nullptr);
+
+  mainDeletionQueue.pushFunction(
+      [=]() { vkDestroyPipeline(device, renderPipeline, nullptr); });
+  mainDeletionQueue.pushFunction(
+      [=]() { vkDestroyPipelineLayout(device, pipelineLayout, nullptr); });
+  mainDeletionQueue.pushFunction(
+      [=]() { vkDestroyPipeline(device, meshPipeline, nullptr); });
+  mainDeletionQueue.pushFunction(
+      [=]() { vkDestroyPipelineLayout(device, meshPipelineLayout, nullptr); });
+}
+
+// Set up the compute pipelines: culling, and building the depth pyramid it tests against
+void VulkanEngine::createComputePipelines() {
+  // without these there's nothing to build the pipelines from
+  VkShaderModule cullShader;
+  if (!loadShaderModule("shaders/cull.comp.spv", &cullShader)) {
+    throw std::runtime_error("Failed to build the cull shader module!");
+  }
+
+  VkShaderModule reduceShader;
+  if (!loadShaderModule("shaders/depth_reduce.comp.spv", &reduceShader)) {
+    throw std::runtime_error("Failed to build the depth reduce shader module!");
+  }
+
+  VkPushConstantRange pushConstant{};
+  pushConstant.offset     = 0;
+  pushConstant.size       = sizeof(CullConstants);
+  pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo layoutInfo = vkinit::pipelineLayoutCreateInfo();
+  layoutInfo.pushConstantRangeCount     = 1;
+  layoutInfo.pPushConstantRanges        = &pushConstant;
+  layoutInfo.setLayoutCount             = 1;
+  layoutInfo.pSetLayouts                = &cullSetLayout;
+
+  vkCreatePipelineLayout(device, &layoutInfo, nullptr, &cullPipelineLayout);
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.pNext = nullptr;
+
+  pipelineInfo.stage =
+      vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, cullShader);
+  pipelineInfo.layout = cullPipelineLayout;
+
+  if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr,
+                               &cullPipeline) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the cull pipeline!");
+  }
+
+  depthPyramid.init(device, allocator, pipelineCache, reduceShader);
+
+  vkDestroyShaderModule(device, cullShader, nullptr);
+  vkDestroyShaderModule(device, reduceShader, nullptr);
 
-    // add it to the infos vector
-    queueCreateInfos.push_back(queueCreateInfo);
+  mainDeletionQueue.pushFunction([=]() {
+    depthPyramid.cleanup();
+    vkDestroyPipeline(device, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+  });
+}
+
+// Make the object buffer's set layout, and a pool for every frame's sets
+void VulkanEngine::createDescriptors() {
+  // the mesh shaders look up their instance's object, then its data
+  VkDescriptorSetLayoutBinding objectBindings[2] = {
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_VERTEX_BIT, 0),
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_VERTEX_BIT, 1)};
+
+  VkDescriptorSetLayoutCreateInfo setInfo{};
+  setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  setInfo.pNext = nullptr;
+
+  setInfo.flags        = 0;
+  setInfo.bindingCount = 2;
+  setInfo.pBindings    = objectBindings;
+
+  if (vkCreateDescriptorSetLayout(device, &setInfo, nullptr, &objectSetLayout) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the object descriptor set layout!");
   }
-  // END QUEUE CREATION
 
-  // DEVICE CREATION
-  // make a struct to hold all the device info
-  VkDeviceCreateInfo deviceInfo{};
-  deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  deviceInfo.pNext = nullptr;
+  // the cull pass reads the cull buffer, depth pyramid and levels of detail (and the
+  // objects, meshlets and clusters for meshlet culling), and writes the draws' instance
+  // counts and the instances, then the compacted draws and their counts
+  VkDescriptorSetLayoutBinding cullBindings[10] = {
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 0),
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 1),
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 2),
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 3),
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 4),
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 5),
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 6),
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 7),
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 8),
+      vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_COMPUTE_BIT, 9)};
+
+  setInfo.bindingCount = 10;
+  setInfo.pBindings    = cullBindings;
+
+  if (vkCreateDescriptorSetLayout(device, &setInfo, nullptr, &cullSetLayout) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the cull descriptor set layout!");
+  }
 
-  // give it the queue info we just put together
-  deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-  deviceInfo.pQueueCreateInfos    = queueCreateInfos.data();
-  deviceInfo.queueCreateInfoCount = 1;
+  // plenty of room, the pool only gets made once
+  const uint32_t storageDescriptors = MAX_STORAGE_DESCRIPTORS * MAX_FRAMES_IN_FLIGHT;
+  const uint32_t samplerDescriptors = MAX_SAMPLER_DESCRIPTORS * MAX_FRAMES_IN_FLIGHT;
+  std::vector<VkDescriptorPoolSize> poolSizes = {
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, storageDescriptors},
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, samplerDescriptors}};
 
-  // tell the device we're not using any special features
-  VkPhysicalDeviceFeatures emptyFeatures{};
-  deviceInfo.pEnabledFeatures = &emptyFeatures;
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.pNext = nullptr;
 
-  // tell the device what device extensions we're using
-  deviceInfo.enabledExtensionCount =
-      static_cast<uint32_t>(requiredDeviceExtensions.size());
-  deviceInfo.ppEnabledExtensionNames = requiredDeviceExtensions.data();
+  poolInfo.flags         = 0;
+  poolInfo.maxSets       = storageDescriptors;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes    = poolSizes.data();
 
-  // tell the device whether or not we're using validation layers.
-  if (enableValidationLayers) {
-    deviceInfo.enabledLayerCount   = static_cast<uint32_t>(validationLayers.size());
-    deviceInfo.ppEnabledLayerNames = validationLayers.data();
-  } else {
-    deviceInfo.enabledLayerCount = 0;
+  if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the descriptor pool!");
   }
 
-  // actually create the device!
-  if (vkCreateDevice(chosenGPU, &deviceInfo, nullptr, &device) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to create logical device!");
+  // destroying the pool frees every set that came out of it
+  mainDeletionQueue.pushFunction([=]() {
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, objectSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+  });
+}
+
+// Put together the draw list
+void VulkanEngine::initScene() {
+  // the test triangle, laid out in a grid so the copies don't all sit on top of each
+  // other
+  RenderObject triangle{};
+  triangle.pipeline       = meshPipeline;
+  triangle.mesh           = &meshes["triangle"];
+  triangle.pipelineLayout = meshPipelineLayout;
+
+  const unsigned int gridWidth = 100;
+  renderObjects.clear();
+  for (unsigned int i = 0; i < sceneDrawCount; ++i) {
+    triangle.transform =
+        glm::translate(glm::vec3((float)(i % gridWidth), 0.f, (float)(i / gridWidth)));
+    renderObjects.push_back(triangle);
   }
 
-  // END DEVICE CREATION
+  // and whatever got loaded off disk, at the origin. Streamed meshes aren't there yet,
+  // so their objects start out on the placeholder, and every object sharing a path
+  // shares its asset.
+  std::unordered_map<std::string, uint32_t> assetIndices;
+  for (const std::string &path : meshPaths) {
+    RenderObject object{};
+    object.pipeline       = meshPipeline;
+    object.pipelineLayout = meshPipelineLayout;
+    object.transform      = glm::mat4(1.f);
+
+    if (streamMeshes) {
+      auto found = assetIndices.try_emplace(path, streamedAssets.size());
+      if (found.second) {
+        StreamedAsset &asset = streamedAssets.emplace_back();
+        asset.path           = path;
+        asset.mesh           = &meshes[path];
+      }
+      streamedAssets[found.first->second].objects.push_back(
+          static_cast<uint32_t>(renderObjects.size()));
+      object.mesh = &meshes["placeholder"];
+    } else {
+      auto mesh = meshes.find(path);
+      if (mesh == meshes.end()) {
+        continue;
+      }
+      object.mesh = &mesh->second;
+    }
+    renderObjects.push_back(object);
+  }
 
-  // attach the queues to their handles
-  vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
-  vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-  vkGetDeviceQueue(device, indices.computeFamily.value(), 0, &computeQueue);
+  createDrawBatches();
+
+  std::vector<Aabb> bounds(renderObjects.size());
+  for (size_t i = 0; i < renderObjects.size(); ++i) {
+    bounds[i] = getObjectBounds(renderObjects[i]);
+  }
+  sceneBvh.build(bounds);
 }
-//------------------------------------------------------------------------
 
-// SWAPCHAIN CREATION FUNCTIONS
-//-----------------------------------------------------------------------
-// See if the GPU has minimum support for our swapchain
-VulkanEngine::SwapChainSupportDetails
-VulkanEngine::querySwapChainSupport(VkPhysicalDevice GPU) {
+void VulkanEngine::createDrawBatches() {
+  drawBatches.clear();
+  objectBatches.resize(renderObjects.size());
 
-  SwapChainSupportDetails details;
-  // Get the surface capabilities of our device
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(GPU, displaySurface, &details.capabilities);
+  // batches go in the order their first object comes up in the draw list
+  std::map<std::pair<VkPipeline, const Mesh *>, uint32_t> batchIndices;
+  for (uint32_t i = 0; i < renderObjects.size(); ++i) {
+    const RenderObject &object = renderObjects[i];
 
-  // Get the supported surface formats
-  uint32_t formatCount;
-  vkGetPhysicalDeviceSurfaceFormatsKHR(GPU, displaySurface, &formatCount, nullptr);
+    uint32_t batch = static_cast<uint32_t>(drawBatches.size());
+    if (object.mesh != nullptr) {
+      auto found = batchIndices.try_emplace({object.pipeline, object.mesh}, batch);
+      batch      = found.first->second;
+    }
+    if (batch == drawBatches.size()) {
+      drawBatches.push_back({i, 0, 0, NO_DRAW, 1, 0});
+    }
 
-  if (formatCount != 0) {
-    details.formats.resize(formatCount);
-    vkGetPhysicalDeviceSurfaceFormatsKHR(GPU, displaySurface, &formatCount,
-                                         details.formats.data());
+    objectBatches[i] = batch;
+    ++drawBatches[batch].objectCount;
   }
 
-  // Get the supported present modes
-  uint32_t presentModeCount;
-  vkGetPhysicalDeviceSurfacePresentModesKHR(GPU, displaySurface, &presentModeCount,
-                                            nullptr);
+  // Every batch gets a slot in the instance buffer for each of its objects at every
+  // level, and batches drawn by meshlet get that many for every meshlet of every level.
+  // Meshlets only happen when the cull pass is there to throw them out, otherwise
+  // they're just more draws.
+  const bool meshlets    = indirectDraws && frustumCulling && meshletCulling;
+  uint64_t instanceCount = 0;
+  for (DrawBatch &batch : drawBatches) {
+    const Mesh *mesh = renderObjects[batch.firstObject].mesh;
+    if (mesh != nullptr && meshLods) {
+      batch.lodCount = static_cast<uint32_t>(mesh->lods.size());
+    }
+    if (mesh != nullptr && meshlets) {
+      const MeshLod &lastLod = mesh->lods[batch.lodCount - 1];
+      batch.meshletCount     = lastLod.firstMeshlet + lastLod.meshletCount;
+    }
 
-  if (presentModeCount != 0) {
-    details.presentModes.resize(presentModeCount);
-    vkGetPhysicalDeviceSurfacePresentModesKHR(GPU, displaySurface, &presentModeCount,
-                                              details.presentModes.data());
+    uint32_t drawCount  = batch.meshletCount > 0 ? batch.meshletCount : batch.lodCount;
+    batch.firstInstance = static_cast<uint32_t>(instanceCount);
+    instanceCount += uint64_t(batch.objectCount) * drawCount;
+    if (instanceCount > UINT32_MAX) {
+      throw std::runtime_error("Too many instances, try without meshlets!");
+    }
   }
-  return details;
-}
+  instanceCapacity = static_cast<uint32_t>(instanceCount);
+
+  // and the ones with meshes get a draw in their index size's run of the indirect buffer
+  uint32_t drawCount = 0;
+  for (uint32_t group = 0; group < INDEX_TYPE_COUNT; ++group) {
+    VkIndexType indexType  = group == 0 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    groupDrawStarts[group] = drawCount;
+
+    for (DrawBatch &batch : drawBatches) {
+      const Mesh *mesh = renderObjects[batch.firstObject].mesh;
+      if (mesh != nullptr && mesh->indexType == indexType) {
+        batch.drawIndex = drawCount;
+        drawCount += batch.meshletCount > 0 ? batch.meshletCount : batch.lodCount;
+      }
+    }
+    groupDrawCounts[group] = drawCount - groupDrawStarts[group];
+  }
+  indirectDrawCount = drawCount;
+
+  // and the meshlet batches' objects get a cull thread for each of their meshlets
+  cullClusters.clear();
+  for (uint32_t i = 0; i < renderObjects.size(); ++i) {
+    const DrawBatch &batch = drawBatches[objectBatches[i]];
+    if (batch.meshletCount == 0) {
+      continue;
+    }
 
-// Choose the surface color output format. Basically, pick a colorspace.
-VkSurfaceFormatKHR VulkanEngine::chooseSwapSurfaceFormat(
-    const std::vector<VkSurfaceFormatKHR> &availableFormats) {
-  for (const auto &availableFormat : availableFormats) {
-    if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB &&
-        availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-      return availableFormat;
+    const Mesh &mesh = *renderObjects[i].mesh;
+    for (uint32_t l = 0; l < batch.lodCount; ++l) {
+      const MeshLod &lod = mesh.lods[l];
+      for (uint32_t m = lod.firstMeshlet; m < lod.firstMeshlet + lod.meshletCount; ++m) {
+        cullClusters.push_back({i, mesh.firstMeshlet + m, batch.drawIndex + m, l});
+      }
     }
   }
+}
 
-  return availableFormats[0];
+Aabb VulkanEngine::getObjectBounds(const RenderObject &object) const {
+  if (object.mesh == nullptr) {
+    return Aabb{};
+  }
+  return transformAabb(Aabb{object.mesh->boundsMin, object.mesh->boundsMax},
+                       object.transform);
 }
 
-// Choose the vsync/present mode. see obsidian note "Vulkan present modes" for
-// details.
-VkPresentModeKHR VulkanEngine::chooseSwapPresentMode(
-    const std::vector<VkPresentModeKHR> &availablePresentModes) {
+void VulkanEngine::setObjectTransform(size_t index, const glm::mat4 &transform) {
+  renderObjects[index].transform = transform;
+  sceneBvh.update(static_cast<uint32_t>(index), getObjectBounds(renderObjects[index]));
+}
 
-  // triple buffer if we have it
-  for (const auto &availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      return availablePresentMode;
-    }
+std::optional<uint32_t> VulkanEngine::pickObject(int x, int y) {
+  // The pixel's ray, from the near plane out to the far one. viewProj is already the
+  // next frame's camera, so go by the one the click actually landed on.
+  glm::mat4 inverseViewProj = glm::inverse(displayedViewProj);
+
+  float ndcX          = (x + 0.5f) / swapChainExtent.width * 2.f - 1.f;
+  float ndcY          = (y + 0.5f) / swapChainExtent.height * 2.f - 1.f;
+  glm::vec4 nearPoint = inverseViewProj * glm::vec4(ndcX, ndcY, 0.f, 1.f);
+  glm::vec4 farPoint  = inverseViewProj * glm::vec4(ndcX, ndcY, 1.f, 1.f);
+  glm::vec3 origin    = glm::vec3(nearPoint) / nearPoint.w;
+  glm::vec3 ray       = glm::vec3(farPoint) / farPoint.w - origin;
+
+  sceneBvh.refit();
+  std::optional<BvhHit> hit =
+      sceneBvh.pick(origin, glm::normalize(ray), glm::length(ray));
+  if (!hit) {
+    return std::nullopt;
   }
-  // otherwise standard vsync
-  return VK_PRESENT_MODE_FIFO_KHR;
+  return hit->object;
 }
 
-// Set the resolution of the swapchain images, in pixels
-VkExtent2D VulkanEngine::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) {
+void VulkanEngine::createDrawBuffers() {
+  // never zero sized, vulkan doesn't allow empty buffers
+  drawCapacity = std::max<uint32_t>(static_cast<uint32_t>(renderObjects.size()), 1);
 
-  if (capabilities.currentExtent.width != UINT32_MAX) {
-    return capabilities.currentExtent;
-  } else {
-    int width, height;
-    SDL_GetWindowSize(window, &width, &height);
+  for (auto &frame : bufferFrames) {
+    // The sets get made once, and pointed at whichever buffers the frame has. The cull
+    // set's depth pyramid gets filled in by createDepthPyramid.
+    VkDescriptorSetLayout setLayouts[2] = {objectSetLayout, cullSetLayout};
+    VkDescriptorSet sets[2];
 
-    VkExtent2D actualExtent = {static_cast<uint32_t>(width),
-                               static_cast<uint32_t>(height)};
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.pNext = nullptr;
 
-    // clamp the size to between the surface's specified max and min
-    actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width,
-                                    capabilities.maxImageExtent.width);
+    allocInfo.descriptorPool     = descriptorPool;
+    allocInfo.descriptorSetCount = 2;
+    allocInfo.pSetLayouts        = setLayouts;
 
-    actualExtent.height =
-        std::clamp(actualExtent.height, capabilities.minImageExtent.height,
-                   capabilities.maxImageExtent.height);
-    return actualExtent;
+    if (vkAllocateDescriptorSets(device, &allocInfo, sets) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate the frame's descriptor sets!");
+    }
+    frame.objectDescriptor = sets[0];
+    frame.cullDescriptor   = sets[1];
+
+    frame.instanceCapacity = std::max(instanceCapacity, 1u);
+    frame.commandCapacity  = std::max(indirectDrawCount, 1u);
+    frame.clusterCapacity  = std::max(static_cast<uint32_t>(cullClusters.size()), 1u);
+    createFrameBuffers(frame);
   }
+
+  // whichever buffers the frames have by the end
+  mainDeletionQueue.pushFunction([=]() {
+    for (auto &frame : bufferFrames) {
+      destroyFrameBuffers(frame);
+    }
+  });
 }
 
-// Build the swapchain
-void VulkanEngine::createSwapChain() {
+void VulkanEngine::createFrameBuffers(FrameData &frame) {
+  const VkDeviceSize objectSize   = drawCapacity * sizeof(ObjectData);
+  const VkDeviceSize cullSize     = drawCapacity * sizeof(CullObject);
+  const VkDeviceSize instanceSize = frame.instanceCapacity * sizeof(uint32_t);
+  const VkDeviceSize indirectSize =
+      frame.commandCapacity * sizeof(VkDrawIndexedIndirectCommand);
+  const VkDeviceSize clusterSize   = frame.clusterCapacity * sizeof(CullCluster);
+  const VkDeviceSize drawCountSize = INDEX_TYPE_COUNT * sizeof(uint32_t);
+
+  // written by the cpu every frame, so they live somewhere it can see
+  frame.objectBuffer = createBuffer(objectSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                    VMA_MEMORY_USAGE_CPU_TO_GPU);
+  frame.cullBuffer   = createBuffer(cullSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                    VMA_MEMORY_USAGE_CPU_TO_GPU);
+  frame.batchBuffer  = createBuffer(indirectSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                    VMA_MEMORY_USAGE_CPU_TO_GPU);
+  // and the clusters whenever the scene changes, which is rare enough not to bother
+  // staging them
+  frame.clusterBuffer = createBuffer(clusterSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                     VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+  // and they stay mapped for as long as they exist
+  void *mapped;
+  vmaMapMemory(allocator, frame.objectBuffer.allocation, &mapped);
+  frame.objects = static_cast<ObjectData *>(mapped);
+  vmaMapMemory(allocator, frame.cullBuffer.allocation, &mapped);
+  frame.cullObjects = static_cast<CullObject *>(mapped);
+  vmaMapMemory(allocator, frame.batchBuffer.allocation, &mapped);
+  frame.batchCommands = static_cast<VkDrawIndexedIndirectCommand *>(mapped);
+  vmaMapMemory(allocator, frame.clusterBuffer.allocation, &mapped);
+  frame.clusters = static_cast<CullCluster *>(mapped);
+
+  // the instances come from the cull pass with indirect draws, and the cpu otherwise
+  frame.instanceBuffer = createBuffer(
+      instanceSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      indirectDraws ? VMA_MEMORY_USAGE_GPU_ONLY : VMA_MEMORY_USAGE_CPU_TO_GPU);
+  frame.instances = nullptr;
+  if (!indirectDraws) {
+    vmaMapMemory(allocator, frame.instanceBuffer.allocation, &mapped);
+    frame.instances = static_cast<uint32_t *>(mapped);
+  }
 
-  swapChainSupport = querySwapChainSupport(chosenGPU);
-  // minimum amount of images the swapchain needs to function, +1 to avoid
-  // driver hangups
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+  // the draws only ever get touched by the gpu
+  frame.indirectBuffer  = createBuffer(indirectSize,
+                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                           VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                           VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                       VMA_MEMORY_USAGE_GPU_ONLY);
+  frame.compactedBuffer = createBuffer(indirectSize,
+                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                           VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                       VMA_MEMORY_USAGE_GPU_ONLY);
+  frame.drawCountBuffer = createBuffer(drawCountSize,
+                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                           VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                           VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                       VMA_MEMORY_USAGE_GPU_ONLY);
+
+  if (!cullClusters.empty()) {
+    memcpy(frame.clusters, cullClusters.data(),
+           cullClusters.size() * sizeof(CullCluster));
+  }
+  frame.sceneVersion = sceneVersion;
+
+  // point the frame's sets at its buffers
+  VkDescriptorBufferInfo objectInfo{frame.objectBuffer.memBuffer, 0, objectSize};
+  VkDescriptorBufferInfo instanceInfo{frame.instanceBuffer.memBuffer, 0, instanceSize};
+  VkDescriptorBufferInfo cullInfo{frame.cullBuffer.memBuffer, 0, cullSize};
+  VkDescriptorBufferInfo indirectInfo{frame.indirectBuffer.memBuffer, 0, indirectSize};
+  VkDescriptorBufferInfo meshletInfo{meshPool.meshletBuffer.memBuffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo clusterInfo{frame.clusterBuffer.memBuffer, 0, clusterSize};
+  VkDescriptorBufferInfo lodInfo{meshPool.lodBuffer.memBuffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo compactedInfo{frame.compactedBuffer.memBuffer, 0, indirectSize};
+  VkDescriptorBufferInfo drawCountInfo{frame.drawCountBuffer.memBuffer, 0, drawCountSize};
+
+  VkWriteDescriptorSet writes[11] = {
+      vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    frame.objectDescriptor, &objectInfo, 0),
+      vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    frame.objectDescriptor, &instanceInfo, 1),
+      vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    frame.cullDescriptor, &cullInfo, 0),
+      vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    frame.cullDescriptor, &indirectInfo, 1),
+      vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    frame.cullDescriptor, &instanceInfo, 2),
+      vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    frame.cullDescriptor, &objectInfo, 4),
+      vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    frame.cullDescriptor, &meshletInfo, 5),
+      vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    frame.cullDescriptor, &clusterInfo, 6),
+      vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    frame.cullDescriptor, &lodInfo, 7),
+      vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    frame.cullDescriptor, &compactedInfo, 8),
+      vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    frame.cullDescriptor, &drawCountInfo, 9)};
+  vkUpdateDescriptorSets(device, 11, writes, 0, nullptr);
+}
 
-  // if there is a max # of images, and we've exceeded it, set it to the max instead
-  if (swapChainSupport.capabilities.maxImageCount > 0 &&
-      imageCount > swapChainSupport.capabilities.maxImageCount) {
+void VulkanEngine::destroyFrameBuffers(FrameData &frame) {
+  for (const AllocatedBuffer &buffer :
+       {frame.objectBuffer, frame.cullBuffer, frame.batchBuffer, frame.clusterBuffer}) {
+    vmaUnmapMemory(allocator, buffer.allocation);
+    vmaDestroyBuffer(allocator, buffer.memBuffer, buffer.allocation);
+  }
+  if (frame.instances != nullptr) {
+    vmaUnmapMemory(allocator, frame.instanceBuffer.allocation);
+  }
+  for (const AllocatedBuffer &buffer : {frame.instanceBuffer, frame.indirectBuffer,
+                                        frame.compactedBuffer, frame.drawCountBuffer}) {
+    vmaDestroyBuffer(allocator, buffer.memBuffer, buffer.allocation);
+  }
+}
 
-    imageCount = swapChainSupport.capabilities.maxImageCount;
+void VulkanEngine::updateFrameBuffers(FrameData &frame) {
+  if (frame.sceneVersion == sceneVersion) {
+    return;
   }
 
-  // get the basic specs of our swapchain
-  VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-  VkPresentModeKHR presentMode     = chooseSwapPresentMode(swapChainSupport.presentModes);
-  VkExtent2D extent                = chooseSwapExtent(swapChainSupport.capabilities);
+  // Only ever grow, and by half again at least, so a scene that's still streaming in
+  // doesn't remake them every time something arrives. The objects themselves never
+  // change, just what they draw.
+  const uint32_t clusterCount = static_cast<uint32_t>(cullClusters.size());
+  if (instanceCapacity <= frame.instanceCapacity &&
+      indirectDrawCount <= frame.commandCapacity &&
+      clusterCount <= frame.clusterCapacity) {
+    if (clusterCount > 0) {
+      memcpy(frame.clusters, cullClusters.data(), clusterCount * sizeof(CullCluster));
+    }
+    frame.sceneVersion = sceneVersion;
+    return;
+  }
 
-  // fill in the struct for swapchain creation
-  VkSwapchainCreateInfoKHR createInfo{};
-  createInfo.sType           = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-  createInfo.surface         = displaySurface;
-  createInfo.minImageCount   = imageCount;
-  createInfo.imageFormat     = surfaceFormat.format;
-  createInfo.imageColorSpace = surfaceFormat.colorSpace;
-  createInfo.imageExtent     = extent;
+  auto grow = [](uint32_t capacity, uint32_t needed) {
+    return needed <= capacity ? capacity : std::max(needed, capacity + capacity / 2);
+  };
+  frame.instanceCapacity = grow(frame.instanceCapacity, instanceCapacity);
+  frame.commandCapacity  = grow(frame.commandCapacity, indirectDrawCount);
+  frame.clusterCapacity  = grow(frame.clusterCapacity, clusterCount);
 
-  // this is always 1 unless you're doing stereoscopic 3D
-  createInfo.imageArrayLayers = 1;
+  // the fence says nothing's using the old ones any more
+  destroyFrameBuffers(frame);
+  createFrameBuffers(frame);
+}
 
-  // tell vulkan we're rendering these images directly
-  createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+void VulkanEngine::createDepthPyramid() {
+  std::set<uint32_t> families = {queueFamilyIndices.graphicsFamily.value(),
+                                 queueFamilyIndices.computeFamily.value()};
+  depthPyramid.create(swapChainExtent, depthImageView,
+                      std::vector<uint32_t>(families.begin(), families.end()));
+  swapChainDeletionQueue.pushFunction([=]() { depthPyramid.destroy(); });
 
-  QueueFamilyIndices indices    = findQueueFamilies(chosenGPU);
-  uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(),
-                                   indices.presentFamily.value()};
+  // Culling samples it in GENERAL from the very first frame, occlusion or not, so it
+  // gets put there up front with a throwaway command buffer
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.pNext            = nullptr;
+  poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
-  // determines whether or not image sharing is sloppy or exclusive
-  if (indices.graphicsFamily != indices.presentFamily) {
-    createInfo.imageSharingMode      = VK_SHARING_MODE_CONCURRENT;
-    createInfo.queueFamilyIndexCount = 2;
-    createInfo.pQueueFamilyIndices   = queueFamilyIndices;
-  } else {
-    createInfo.imageSharingMode      = VK_SHARING_MODE_EXCLUSIVE;
-    createInfo.queueFamilyIndexCount = 0;       // optional
-    createInfo.pQueueFamilyIndices   = nullptr; // optional
+  VkCommandPool pool;
+  if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create the depth pyramid command pool!");
   }
 
-  // don't do anything special to the image
-  createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
-  // ignore the alpha channel for blending
-  createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+  VkCommandBufferAllocateInfo commandBufferInfo{};
+  commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  commandBufferInfo.pNext = nullptr;
 
-  createInfo.presentMode = presentMode;
-  // ignore the color of pixels that are obscured
-  createInfo.clipped = VK_TRUE;
-  // this is for recreating a swapchain when needed, as we need the "old" version to do
-  // that.
-  createInfo.oldSwapchain = VK_NULL_HANDLE;
-  // almost there!
+  commandBufferInfo.commandPool        = pool;
+  commandBufferInfo.commandBufferCount = 1;
+  commandBufferInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 
-  if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to create swapchain!");
+  VkCommandBuffer cmd;
+  if (vkAllocateCommandBuffers(device, &commandBufferInfo, &cmd) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate the depth pyramid command buffer!");
   }
 
-  // now we have to retrieve the swapchain images!
-  // first, query the actual number of images (not the minimum, which we defined at the
-  // beginning of the function)
-  vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
-  // then, we resize the vector to fit the actual number of images
-  swapChainImages.resize(imageCount);
-  // then, do the grad student shuffle!
-  vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.pNext = nullptr;
 
-  // store the format and extent for later
-  swapChainImageFormat = surfaceFormat.format;
-  swapChainExtent      = extent;
+  beginInfo.pInheritanceInfo = nullptr;
+  beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-  // add the swapchain to the deletion queue
-  mainDeletionQueue.pushFunction(
-      [=]() { vkDestroySwapchainKHR(device, swapChain, nullptr); });
+  if (vkBeginCommandBuffer(cmd, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to start recording the depth pyramid layout!");
+  }
+  depthPyramid.recordInitialLayout(cmd);
+  if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to end the depth pyramid command buffer!");
+  }
+
+  VkSubmitInfo submit{};
+  submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit.pNext = nullptr;
+
+  submit.commandBufferCount = 1;
+  submit.pCommandBuffers    = &cmd;
+
+  // only happens at startup and on resize, so just wait for it
+  if (vkQueueSubmit(graphicsQueue, 1, &submit, VK_NULL_HANDLE) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to submit the depth pyramid layout!");
+  }
+  vkQueueWaitIdle(graphicsQueue);
+  vkDestroyCommandPool(device, pool, nullptr);
+
+  VkDescriptorImageInfo pyramidInfo{};
+  pyramidInfo.sampler     = depthPyramid.getSampler();
+  pyramidInfo.imageView   = depthPyramid.getView();
+  pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+  for (auto &frame : bufferFrames) {
+    VkWriteDescriptorSet pyramidWrite =
+        vkinit::writeDescriptorImage(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                     frame.cullDescriptor, &pyramidInfo, 3);
+    vkUpdateDescriptorSets(device, 1, &pyramidWrite, 0, nullptr);
+  }
 }
 
-// Wipe out the swapchain and its associated objects so we can rebuild it
-void VulkanEngine::cleanupSwapChain() { mainDeletionQueue.flush(); }
+// PIPELINE CACHE
+// What we put in front of the driver's cache data on disk. The driver checks its own
+// header too, but some drivers are happier handing back garbage than rejecting it, and
+// its header doesn't know about driver updates.
+struct PipelineCacheFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint32_t driverVersion;
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  uint64_t dataSize;
+  uint64_t dataHash;
+};
+
+constexpr uint32_t PIPELINE_CACHE_MAGIC   = 0x43505456; // "VTPC"
+constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+// Create the pipeline cache, seeded from disk if the saved one matches this device
+void VulkanEngine::createPipelineCache() {
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(chosenGPU, &deviceProperties);
+
+  std::vector<char> fileData;
+  const char *initialData = nullptr;
+  size_t initialDataSize  = 0;
+
+  if (readFile(pipelineCachePath, fileData)) {
+    PipelineCacheFileHeader header{};
+    const char *data = nullptr;
+    size_t dataSize  = 0;
+    if (fileData.size() >= sizeof(header)) {
+      memcpy(&header, fileData.data(), sizeof(header));
+      data     = fileData.data() + sizeof(header);
+      dataSize = fileData.size() - sizeof(header);
+    }
 
-// Rebuild the swapchain. Called when the window is resized or minimized.
-void VulkanEngine::recreateSwapChain() {
-  SDL_Event e;
-  vkDeviceWaitIdle(device);
+    // A broken file gets told apart from one that's fine but for another device, so a
+    // real cache invalidation doesn't get lost in the noise. The rest of the header
+    // only means anything once the version matches.
+    const char *problem = nullptr;
+    if (data == nullptr || header.magic != PIPELINE_CACHE_MAGIC) {
+      problem = "is corrupt";
+    } else if (header.version != PIPELINE_CACHE_VERSION) {
+      problem = "was written by a different version of the engine";
+    } else if (header.dataSize != dataSize ||
+               header.dataHash != hashBytes(data, dataSize)) {
+      problem = "is corrupt";
+    } else if (header.vendorID != deviceProperties.vendorID ||
+               header.deviceID != deviceProperties.deviceID ||
+               header.driverVersion != deviceProperties.driverVersion ||
+               memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID,
+                      VK_UUID_SIZE) != 0) {
+      problem = "is from a different device or driver";
+    }
 
-  // first set the new resolution of the window, so the swapchain doesn't get confused
-  int width, height;
+    if (problem == nullptr) {
+      initialData     = data;
+      initialDataSize = dataSize;
+      std::cout << "loaded " << dataSize << " bytes of pipeline cache from "
+                << pipelineCachePath << std::endl;
+    } else {
+      std::cout << "pipeline cache at " << pipelineCachePath << " " << problem
+                << ", starting fresh." << std::endl;
+    }
+  }
 
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(chosenGPU, displaySurface,
-                                            &swapChainSupport.capabilities);
+  VkPipelineCacheCreateInfo cacheInfo{};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.pNext = nullptr;
 
-  if (swapChainSupport.capabilities.currentExtent.width == 0 ||
-      swapChainSupport.capabilities.currentExtent.height == 0) {
-    // We have to make the window non-resizable so that it doesn't eat 10 pixels off each
-    // axis during un-minimization. Don't ask me why, I don't know.
-    SDL_SetWindowResizable(window, SDL_FALSE);
+  cacheInfo.initialDataSize = initialDataSize;
+  cacheInfo.pInitialData    = initialData;
+
+  if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create pipeline cache!");
   }
+}
 
-  while (swapChainSupport.capabilities.currentExtent.width == 0 ||
-         swapChainSupport.capabilities.currentExtent.height == 0) {
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(chosenGPU, displaySurface,
-                                              &swapChainSupport.capabilities);
-    SDL_WaitEvent(&e);
+// Write the pipeline cache to disk, so the next run can skip compiling
+void VulkanEngine::savePipelineCache() {
+  size_t dataSize = 0;
+  if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS) {
+    return;
+  }
+
+  std::vector<char> fileData(sizeof(PipelineCacheFileHeader) + dataSize);
+  char *data = fileData.data() + sizeof(PipelineCacheFileHeader);
+  if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data) != VK_SUCCESS) {
+    return;
+  }
+
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(chosenGPU, &deviceProperties);
+
+  PipelineCacheFileHeader header{};
+  header.magic         = PIPELINE_CACHE_MAGIC;
+  header.version       = PIPELINE_CACHE_VERSION;
+  header.vendorID      = deviceProperties.vendorID;
+  header.deviceID      = deviceProperties.deviceID;
+  header.driverVersion = deviceProperties.driverVersion;
+  memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+  header.dataSize = dataSize;
+  header.dataHash = hashBytes(data, dataSize);
+
+  memcpy(fileData.data(), &header, sizeof(header));
+
+  // write to the side and swap it in, so a crash mid-write can't leave half a cache
+  if (!writeFileAtomic(pipelineCachePath, fileData.data(),
+                       sizeof(PipelineCacheFileHeader) + dataSize)) {
+    std::cerr << "Couldn't save the pipeline cache to " << pipelineCachePath << std::endl;
+  }
+}
+
+//-----------------------------------------------------------------------
+
+// BUFFER STUFF
+//-----------------------------------------------------------------------
+// initialize the memory manager
+void VulkanEngine::createMemAllocator() {
+  VmaAllocatorCreateInfo allocatorInfo{};
+  allocatorInfo.physicalDevice = chosenGPU;
+  allocatorInfo.device         = device;
+  allocatorInfo.instance       = instance;
+  vmaCreateAllocator(&allocatorInfo, &allocator);
+}
+
+AllocatedBuffer VulkanEngine::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                                           VmaMemoryUsage memoryUsage) {
+  // uploads land from the transfer queue, and compute may read it too. Sharing it
+  // between the families costs next to nothing and saves passing ownership around.
+  std::set<uint32_t> families = {queueFamilyIndices.graphicsFamily.value(),
+                                 queueFamilyIndices.computeFamily.value(),
+                                 queueFamilyIndices.transferFamily.value()};
+  std::vector<uint32_t> familyList(families.begin(), families.end());
+
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.pNext = nullptr;
+
+  bufferInfo.size  = size;
+  bufferInfo.usage = usage;
+  if (familyList.size() > 1) {
+    bufferInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(familyList.size());
+    bufferInfo.pQueueFamilyIndices   = familyList.data();
+  } else {
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   }
 
-  windowExtent.width =
-      static_cast<uint32_t>(swapChainSupport.capabilities.currentExtent.width);
-  windowExtent.height =
-      static_cast<uint32_t>(swapChainSupport.capabilities.currentExtent.height);
+  VmaAllocationCreateInfo allocInfo{};
+  allocInfo.usage = memoryUsage;
 
-  // std::cout << "window has been resized to " << windowX << " wide and " << windowY << "
-  // tall\n";
+  AllocatedBuffer newBuffer;
+  if (vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &newBuffer.memBuffer,
+                      &newBuffer.allocation, nullptr) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create buffer!");
+  }
+  return newBuffer;
+}
 
-  cleanupSwapChain();
+void VulkanEngine::createMeshPool(uint32_t vertexCapacity, VkDeviceSize indexCapacity,
+                                  uint32_t meshletCapacity, uint32_t lodCapacity) {
+  VertexStreamLayout<GpuVertex> layout(vertexStreams);
+
+  meshPool.vertexCapacity  = vertexCapacity;
+  meshPool.indexCapacity   = indexCapacity;
+  meshPool.meshletCapacity = meshletCapacity;
+  meshPool.lodCapacity     = lodCapacity;
+  meshPool.clear();
+
+  for (uint32_t stream = 0; stream < MAX_VERTEX_STREAMS; ++stream) {
+    meshPool.streamStrides[stream] = layout.stride[stream];
+    meshPool.streamBuffers[stream] = {};
+    if (layout.stride[stream] == 0) {
+      continue;
+    }
 
-  createSwapChain();
-  createImageViews();
-  createRenderPass();
-  createPipelines();
-  createFramebuffers();
-  initCommands();
-  createSyncStructures();
+    meshPool.streamBuffers[stream] = createBuffer(
+        VkDeviceSize(vertexCapacity) * layout.stride[stream],
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
 
-  SDL_SetWindowResizable(window, SDL_TRUE);
+    AllocatedBuffer streamBuffer = meshPool.streamBuffers[stream];
+    mainDeletionQueue.pushFunction([=]() {
+      vmaDestroyBuffer(allocator, streamBuffer.memBuffer, streamBuffer.allocation);
+    });
+  }
+
+  meshPool.indexBuffer = createBuffer(
+      indexCapacity, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+
+  // never empty, the cull pass's descriptors need something to point at
+  meshPool.meshletBuffer = createBuffer(
+      std::max(meshletCapacity, 1u) * sizeof(Meshlet),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+  meshPool.lodBuffer = createBuffer(
+      std::max(lodCapacity, 1u) * sizeof(MeshLod),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+
+  AllocatedBuffer indexBuffer   = meshPool.indexBuffer;
+  AllocatedBuffer meshletBuffer = meshPool.meshletBuffer;
+  AllocatedBuffer lodBuffer     = meshPool.lodBuffer;
+  mainDeletionQueue.pushFunction([=]() {
+    vmaDestroyBuffer(allocator, indexBuffer.memBuffer, indexBuffer.allocation);
+    vmaDestroyBuffer(allocator, meshletBuffer.memBuffer, meshletBuffer.allocation);
+    vmaDestroyBuffer(allocator, lodBuffer.memBuffer, lodBuffer.allocation);
+  });
 }
-//-----------------------------------------------------------------------
 
-// PIPELINE SETUP FUNCTIONS
-//-----------------------------------------------------------------------
-// Tell the vulkan context how to look at the images we make
-void VulkanEngine::createImageViews() {
-  // make the imageviews list as big as the actual swapchain
-  swapChainImageViews.resize(swapChainImages.size());
+void VulkanEngine::loadMeshes() {
+  Mesh &triangleMesh = meshes["triangle"];
+  triangleMesh.vertices.resize(3);
+  triangleMesh.indices = {0, 1, 2};
 
-  for (size_t i = 0; i < swapChainImages.size(); ++i) {
-    VkImageViewCreateInfo createInfo{};
-    createInfo.sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    createInfo.image    = swapChainImages[i];
-    createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    createInfo.format   = swapChainImageFormat;
+  triangleMesh.vertices[0].position = {1.f, 1.f, 0.f};
+  triangleMesh.vertices[1].position = {-1.f, 1.f, 0.f};
+  triangleMesh.vertices[2].position = {0.f, -1.f, 0.f};
 
-    // this allows you to swizzle all the colors around if you want. These settings make
-    // it do nothing.
-    createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-    createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-    createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-    createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+  triangleMesh.vertices[0].color = {1.f, 0.f, 0.f};
+  triangleMesh.vertices[1].color = {0.f, 1.f, 0.f};
+  triangleMesh.vertices[2].color = {0.f, 0.f, 1.f};
 
-    // describe the image's purpose and specs
-    createInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-    createInfo.subresourceRange.baseMipLevel   = 0;
-    createInfo.subresourceRange.levelCount     = 1;
-    createInfo.subresourceRange.baseArrayLayer = 0;
-    createInfo.subresourceRange.layerCount     = 1;
+  for (auto &vertex : triangleMesh.vertices) {
+    vertex.normal = {0.f, 0.f, 1.f};
+  }
 
-    // make the image view for real
-    if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) !=
-        VK_SUCCESS) {
-      throw std::runtime_error("Failed to create image views!");
+  // a grey box for streamed meshes' objects to draw until they're in, a face at a time
+  // with each face's corners going counter-clockwise seen from outside
+  Mesh &placeholderMesh = meshes["placeholder"];
+  for (int face = 0; face < 6; ++face) {
+    int axis   = face / 2;
+    float side = face % 2 == 0 ? 1.f : -1.f;
+
+    glm::vec3 normal(0.f), u(0.f), v(0.f);
+    normal[axis]      = side;
+    u[(axis + 1) % 3] = side;
+    v[(axis + 2) % 3] = 1.f;
+
+    const float corners[4][2] = {{-1.f, -1.f}, {1.f, -1.f}, {1.f, 1.f}, {-1.f, 1.f}};
+
+    uint32_t base = static_cast<uint32_t>(placeholderMesh.vertices.size());
+    for (const auto &corner : corners) {
+      Vertex vertex;
+      vertex.position = (normal + u * corner[0] + v * corner[1]) * 0.5f;
+      vertex.normal   = normal;
+      vertex.color    = glm::vec3(0.5f);
+      placeholderMesh.vertices.push_back(vertex);
+    }
+    for (uint32_t corner : {0, 1, 2, 0, 2, 3}) {
+      placeholderMesh.indices.push_back(base + corner);
     }
-    mainDeletionQueue.pushFunction(
-        [=]() { vkDestroyImageView(device, swapChainImageViews[i], nullptr); });
   }
-}
 
-// Create a render pass
-void VulkanEngine::createRenderPass() {
-  // an attachment is basically a render target
-  VkAttachmentDescription colorAttachment{};
-  colorAttachment.format  = swapChainImageFormat;
-  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  // Everything gets loaded before anything's uploaded, so the mesh pool can be made just
+  // big enough. Baked files stay mapped until then. Streamed meshes come later, into
+  // room set aside for them.
+  std::vector<Mesh *> loadedMeshes = {&triangleMesh, &placeholderMesh};
+  std::deque<BakedMesh> bakedFiles;
+  std::vector<Mesh *> bakedMeshes;
 
-  // clear the framebuffer to black before drawing a new frame
-  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  // store the rendered shit in memory so it can... be rendered
-  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  for (const std::string &path : meshPaths) {
+    if (streamMeshes || meshes.count(path) != 0) {
+      continue;
+    }
 
-  // not using stencils, so we don't give a shit about the load and store
-  colorAttachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    std::string objPath = path;
+    if (isBakedMeshPath(path)) {
+      auto start = std::chrono::steady_clock::now();
+
+      BakedMesh &baked = bakedFiles.emplace_back();
+      if (baked.open(path, vertexStreams)) {
+        Mesh &mesh = meshes[path];
+        baked.describe(mesh);
+        bakedMeshes.push_back(&mesh);
+
+        std::chrono::duration<double, std::milli> loadTime =
+            std::chrono::steady_clock::now() - start;
+        std::cout << "loaded " << path << ": " << mesh.vertexCount << " vertices, "
+                  << mesh.indexCount / 3 << " triangles in " << loadTime.count()
+                  << " ms" << std::endl;
+        continue;
+      }
 
-  // we don't care what the previous layout of the image was
-  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  // we're using the image to be presented
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+      bakedFiles.pop_back();
+      objPath = objPathFor(path);
+      std::cerr << "Couldn't load baked mesh " << path
+                << ", it might need baking again. Trying " << objPath << " instead"
+                << std::endl;
+    }
 
-  VkAttachmentReference colorAttachmentRef{};
-  colorAttachmentRef.attachment = 0;
-  colorAttachmentRef.layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    Mesh objMesh;
+    if (!loadObjMesh(objPath, objMesh)) {
+      continue;
+    }
 
-  VkSubpassDescription subpass{};
-  // you can also bind this to compute. Very interesting...
-  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-  // The index of the attachment in this array is directly referenced from the fragment
-  // shader with the layout(location = 0) out vec4 outColor directive!
-  subpass.colorAttachmentCount = 1;
-  subpass.pColorAttachments    = &colorAttachmentRef;
+    Mesh &mesh = meshes[path];
+    mesh       = std::move(objMesh);
+    loadedMeshes.push_back(&mesh);
+  }
 
-  VkRenderPassCreateInfo renderPassInfo{};
-  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-  // connect the color attachment to the render pass
-  renderPassInfo.attachmentCount = 1;
-  renderPassInfo.pAttachments    = &colorAttachment;
-  // connect the subpass to the render pass
-  renderPassInfo.subpassCount = 1;
-  renderPassInfo.pSubpasses   = &subpass;
+  // leave room for every index to need padding out to 4 bytes
+  uint64_t vertexTotal  = 0;
+  uint64_t indexTotal   = 0;
+  uint64_t meshletTotal = 0;
+  uint64_t lodTotal     = 0;
+  for (Mesh *mesh : loadedMeshes) {
+    if (mesh->meshlets.empty()) {
+      buildMeshlets(*mesh);
+    }
+    meshletTotal += mesh->meshlets.size();
+    lodTotal += mesh->lods.size();
+    VkDeviceSize indexSize = indexTypeFor(mesh->vertices.size()) == VK_INDEX_TYPE_UINT16
+                                 ? sizeof(uint16_t)
+                                 : sizeof(uint32_t);
+    vertexTotal += mesh->vertices.size();
+    indexTotal += mesh->indices.size() * indexSize + sizeof(uint32_t);
+  }
+  for (BakedMesh &baked : bakedFiles) {
+    vertexTotal += baked.getHeader().vertexCount;
+    indexTotal += baked.getHeader().indexDataSize + sizeof(uint32_t);
+    meshletTotal += baked.getHeader().meshletCount;
+    lodTotal += baked.getHeader().lodCount;
+  }
 
-  if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to create render pass!");
+  if (streamMeshes && !meshPaths.empty()) {
+    vertexTotal += STREAMING_POOL_VERTICES;
+    indexTotal += STREAMING_POOL_INDEX_BYTES;
+    meshletTotal += STREAMING_POOL_MESHLETS;
+    lodTotal += STREAMING_POOL_LODS;
   }
 
-  mainDeletionQueue.pushFunction(
-      [=]() { vkDestroyRenderPass(device, renderPass, nullptr); });
+  if (vertexTotal > UINT32_MAX || meshletTotal > UINT32_MAX) {
+    throw std::runtime_error("Too many vertices or meshlets for the mesh pool!");
+  }
+  createMeshPool(static_cast<uint32_t>(vertexTotal), indexTotal,
+                 static_cast<uint32_t>(meshletTotal), static_cast<uint32_t>(lodTotal));
+
+  for (Mesh *mesh : loadedMeshes) {
+    uploadMesh(*mesh);
+  }
+
+  // baked meshes go straight from the mapped file into the staging ring
+  for (size_t i = 0; i < bakedFiles.size(); ++i) {
+    MeshUploadData data;
+    bakedFiles[i].describeUpload(data);
+    if (!uploadMeshData(*bakedMeshes[i], data)) {
+      throw std::runtime_error("Mesh pool is full!");
+    }
+  }
+
+  // everything went out in as few submits as the staging ring allowed, and this is the
+  // only wait. Nothing can draw until it's landed anyway.
+  uploader.waitIdle();
 }
 
-// Create framebuffers to put data into
-void VulkanEngine::createFramebuffers() {
-  // make as many framebuffers as there are images
-  VkFramebufferCreateInfo fbInfo{};
-  fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-  fbInfo.pNext = nullptr;
+void VulkanEngine::initStreaming() {
+  streamer.init(STREAMING_THREAD_COUNT,
+                [this](const StreamRequest &request, StreamedMesh &result) {
+                  loadStreamedMesh(request, result);
+                });
+  mainDeletionQueue.pushFunction([=]() { streamer.cleanup(); });
+}
 
-  fbInfo.renderPass      = renderPass;
-  fbInfo.attachmentCount = 1;
-  fbInfo.width           = windowExtent.width;
-  fbInfo.height          = windowExtent.height;
-  fbInfo.layers          = 1;
+void VulkanEngine::updateStreaming() {
+  // room the gpu's done with can go to whatever streams in next
+  while (!retiredMeshes.empty() && retiredMeshes.front().first <= frameNumber) {
+    meshPool.free(retiredMeshes.front().second);
+    retiredMeshes.pop_front();
+  }
 
-  const uint32_t swapChainImageCount = swapChainImages.size();
-  swapChainFramebuffers.resize(swapChainImageCount);
+  bool sceneChanged = false;
 
-  for (int i = 0; i < swapChainImageCount; ++i) {
-    fbInfo.pAttachments = &swapChainImageViews[i];
-    if (vkCreateFramebuffer(device, &fbInfo, nullptr, &swapChainFramebuffers[i]) !=
-        VK_SUCCESS) {
-      throw std::runtime_error("Failed to create framebuffer!");
+  // meshes whose uploads have landed can finally be drawn
+  const uint64_t completedUploads = uploader.pollCompleted();
+  for (StreamedAsset &asset : streamedAssets) {
+    if (asset.state == StreamState::Uploading && asset.uploadTicket <= completedUploads) {
+      asset.state = StreamState::Resident;
+      setAssetMesh(asset, asset.mesh);
+      sceneChanged = true;
+    }
+  }
+
+  // view is just a translation by camPos, so that's where the eye is
+  const glm::vec3 eye           = -camPos;
+  const float streamOutDistance = streamDistance * STREAM_OUT_FACTOR;
+
+  // ask for what's come in range, and drop what's gone out of it
+  for (uint32_t id = 0; id < streamedAssets.size(); ++id) {
+    StreamedAsset &asset = streamedAssets[id];
+    if (asset.state == StreamState::Failed) {
+      continue;
     }
 
-    mainDeletionQueue.pushFunction(
-        [=]() { vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr); });
+    // from the nearest its objects' bounding spheres get, which are just points until
+    // the mesh has been seen once
+    asset.distance = INFINITY;
+    for (uint32_t object : asset.objects) {
+      glm::vec4 sphere = transformSphere(asset.sphere, renderObjects[object].transform);
+      float distance   = glm::length(glm::vec3(sphere) - eye) - sphere.w;
+      if (distance < asset.distance) {
+        asset.distance        = distance;
+        asset.nearestPosition = glm::vec3(sphere);
+      }
+    }
+
+    if (asset.state == StreamState::Unloaded && asset.distance < streamDistance) {
+      streamer.request(id, asset.path, asset.nearestPosition);
+      asset.state = StreamState::Loading;
+    } else if (asset.distance > streamOutDistance) {
+      // ones being loaded right now get dropped when they come back instead, and ones
+      // still uploading once they've landed
+      if (asset.state == StreamState::Loading && streamer.cancel(id)) {
+        asset.state = StreamState::Unloaded;
+      } else if (asset.state == StreamState::Resident) {
+        evictAsset(asset);
+        sceneChanged = true;
+      }
+    }
   }
-}
-// Make semaphores and fences for each frame in the swapchain
-void VulkanEngine::createSyncStructures() {
-  // resize the semaphore vectors to the amount of concurrent frames possible
+  streamer.prioritize(eye);
+
+  // take in what the streaming threads have finished, as much as fits in the budget
+  VkDeviceSize uploadedBytes = 0;
+  while (uploadedBytes < STREAMING_UPLOAD_BUDGET) {
+    std::unique_ptr<StreamedMesh> streamed =
+        stalledMesh ? std::move(stalledMesh) : streamer.poll();
+    if (!streamed) {
+      break;
+    }
 
-  // grug fill in tiny semaphore struct
-  VkSemaphoreCreateInfo semaphoreInfo{};
-  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  semaphoreInfo.pNext = nullptr;
-  semaphoreInfo.flags = 0;
+    StreamedAsset &asset = streamedAssets[streamed->id];
+    if (!streamed->loaded) {
+      std::cerr << "Couldn't stream in " << asset.path << std::endl;
+      asset.state = StreamState::Failed;
+      continue;
+    }
+    asset.sphere = streamed->mesh.boundingSphere();
 
-  VkFenceCreateInfo fenceInfo{};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  // turn the fence on by default so rendering can actually start.
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    if (asset.distance > streamOutDistance) {
+      asset.state = StreamState::Unloaded;
+      continue;
+    }
 
-  // make fences and semaphores for each frame in the buffer
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-    vkCreateFence(device, &fenceInfo, nullptr, &bufferFrames[i].renderFence);
-    // make semaphores for image availability and render status, and make fences for
-    // cpu-gpu sync.
+    Mesh &mesh = streamed->mesh;
+    if (!uploadMeshData(mesh, streamed->upload)) {
+      // Make room by streaming out the farthest mesh that's farther than this one. If
+      // there's nothing like that, and nothing waiting to be freed either, it's never
+      // going to fit.
+      StreamedAsset *farthest = nullptr;
+      for (StreamedAsset &other : streamedAssets) {
+        if (other.state == StreamState::Resident && other.distance > asset.distance &&
+            (farthest == nullptr || other.distance > farthest->distance)) {
+          farthest = &other;
+        }
+      }
+      if (farthest != nullptr) {
+        evictAsset(*farthest);
+        sceneChanged = true;
+      }
 
-    vkCreateSemaphore(device, &semaphoreInfo, nullptr, &bufferFrames[i].presentSemaphore);
-    vkCreateSemaphore(device, &semaphoreInfo, nullptr, &bufferFrames[i].renderSemaphore);
+      if (farthest == nullptr && retiredMeshes.empty()) {
+        std::cerr << "The mesh pool is full, couldn't stream in " << asset.path
+                  << std::endl;
+        asset.state = StreamState::Failed;
+        continue;
+      }
+      stalledMesh = std::move(streamed);
+      break;
+    }
 
-    mainDeletionQueue.pushFunction(
-        [=]() { vkDestroyFence(device, bufferFrames[i].renderFence, nullptr); });
+    for (uint32_t stream = 0; stream < MAX_VERTEX_STREAMS; ++stream) {
+      uploadedBytes += mesh.vertexCount * meshPool.streamStrides[stream];
+    }
+    uploadedBytes += streamed->upload.indexSize;
+
+    std::cout << "streamed in " << asset.path << " (" << mesh.indexCount / 3
+              << " triangles) after " << streamed->loadTime << " ms" << std::endl;
+
+    // Its objects switch over once the upload's landed. The gpu copy is all that gets
+    // drawn, so the vertices and indices can go, but drawing and culling still read
+    // the levels and meshlets.
+    asset.state        = StreamState::Uploading;
+    asset.uploadTicket = uploader.getUploadTicket();
+    *asset.mesh        = std::move(mesh);
+    asset.mesh->vertices.clear();
+    asset.mesh->vertices.shrink_to_fit();
+    asset.mesh->indices.clear();
+    asset.mesh->indices.shrink_to_fit();
+  }
 
-    mainDeletionQueue.pushFunction(
-        [=]() { vkDestroySemaphore(device, bufferFrames[i].presentSemaphore, nullptr); });
+  // get this frame's uploads going now, not whenever the staging ring fills up
+  uploader.submit();
 
-    mainDeletionQueue.pushFunction(
-        [=]() { vkDestroySemaphore(device, bufferFrames[i].renderSemaphore, nullptr); });
+  if (sceneChanged) {
+    createDrawBatches();
+    ++sceneVersion;
   }
 }
 
-// Set up the graphics pipeline(s)
-void VulkanEngine::createPipelines() {
-  VkShaderModule fragShader;
-  if (!loadShaderModule("shaders/shader.frag.spv", &fragShader)) {
-    std::cerr << "Error when building the fragment shader module!" << std::endl;
-  } else {
-    std::cerr << "No problems building the fragment shader!" << std::endl;
+void VulkanEngine::loadStreamedMesh(const StreamRequest &request, StreamedMesh &result) {
+  // baked meshes upload straight out of the mapped file, which the result keeps open
+  std::string objPath = request.path;
+  if (isBakedMeshPath(request.path)) {
+    if (result.baked.open(request.path, vertexStreams)) {
+      result.baked.describe(result.mesh);
+      result.baked.describeUpload(result.upload);
+      result.loaded = true;
+      return;
+    }
+
+    objPath = objPathFor(request.path);
+    std::cerr << "Couldn't load baked mesh " << request.path << ", trying " << objPath
+              << " instead" << std::endl;
   }
 
-  VkShaderModule vertShader;
-  if (!loadShaderModule("shaders/shader.vert.spv", &vertShader)) {
-    std::cerr << "Error when building the vertex shader module!" << std::endl;
-  } else {
-    std::cerr << "No problems building the vertex shader!" << std::endl;
+  if (!loadObjMesh(objPath, result.mesh)) {
+    return;
   }
+  packMeshData(result.mesh, vertexStreams, result.upload);
+  result.loaded = true;
+}
 
-  // create the pipeline layout in its default config
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+void VulkanEngine::setAssetMesh(const StreamedAsset &asset, Mesh *mesh) {
+  for (uint32_t object : asset.objects) {
+    renderObjects[object].mesh = mesh;
+    sceneBvh.update(object, getObjectBounds(renderObjects[object]));
+  }
+}
 
-  vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
+void VulkanEngine::evictAsset(StreamedAsset &asset) {
+  setAssetMesh(asset, &meshes["placeholder"]);
 
-  // now make the pipeline
+  // the frames in flight might still be drawing it, so its room has to wait them out
+  retiredMeshes.emplace_back(frameNumber + MAX_FRAMES_IN_FLIGHT, std::move(*asset.mesh));
+  *asset.mesh = Mesh{};
+  asset.state = StreamState::Unloaded;
+}
 
-  PipelineBuilder pipelineBuilder;
+bool VulkanEngine::loadObjMesh(const std::string &path, Mesh &mesh) {
+  auto start = std::chrono::steady_clock::now();
 
-  // tell the pipeline about our shader stages
-  pipelineBuilder.shaderStages.push_back(
-      vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, vertShader));
-  pipelineBuilder.shaderStages.push_back(
-      vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, fragShader));
+  if (!mesh.loadFromObj(path.c_str(), &jobs)) {
+    return false;
+  }
 
-  // tell the pipeline about vertex buffers and shit
-  pipelineBuilder.vertexInputInfo = vkinit::vertexInputStateCreateInfo();
-  // tell the pipeline how to put verts together
-  pipelineBuilder.inputAssembly =
-      vkinit::inputAssemblyCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+  std::chrono::duration<double, std::milli> loadTime =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "loaded " << path << ": " << mesh.vertices.size() << " vertices, "
+            << mesh.indices.size() / 3 << " triangles in " << loadTime.count() << " ms"
+            << std::endl;
 
-  // build the viewport
-  pipelineBuilder.viewport.x        = 0.0f;
-  pipelineBuilder.viewport.y        = 0.0f;
-  pipelineBuilder.viewport.width    = (float)windowExtent.width;
-  pipelineBuilder.viewport.height   = (float)windowExtent.height;
-  pipelineBuilder.viewport.minDepth = 0.0f;
-  pipelineBuilder.viewport.maxDepth = 0.0f;
+  if (optimizeMeshes) {
+    size_t vertexCount = mesh.vertices.size();
 
-  // build the scissor (this one does nothing)
-  pipelineBuilder.scissor.offset = {0, 0};
-  pipelineBuilder.scissor.extent = windowExtent;
+    VertexCacheStats before = analyzeVertexCache(mesh.indices, vertexCount);
+    optimizeMesh(mesh, optimizeMeshOverdraw);
+    VertexCacheStats after = analyzeVertexCache(mesh.indices, vertexCount);
 
-  // build the rasterizer
-  pipelineBuilder.rasterizer = vkinit::rasterizationStateCreateInfo(VK_POLYGON_MODE_FILL);
+    std::cout << "  optimized: ACMR " << before.acmr << " -> " << after.acmr
+              << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+  }
 
-  // no multisampling
-  pipelineBuilder.multisampling = vkinit::multisampleStateCreateInfo();
-  // no blending
-  pipelineBuilder.colorBlendAttachment = vkinit::colorBlendAttachmentState();
+  if (meshLods) {
+    auto lodStart = std::chrono::steady_clock::now();
+    generateLods(mesh);
 
-  // attach the layout
-  pipelineBuilder.pipelineLayout = pipelineLayout;
+    std::chrono::duration<double, std::milli> lodTime =
+        std::chrono::steady_clock::now() - lodStart;
+    std::cout << "  " << mesh.lods.size() << " levels of detail in " << lodTime.count()
+              << " ms:";
+    for (const MeshLod &lod : mesh.lods) {
+      std::cout << " " << lod.indexCount / 3 << " (" << lod.error << ")";
+    }
+    std::cout << std::endl;
+
+    // big enough for a level, but nothing could be collapsed (borders everywhere, or
+    // too far off), so it gets drawn in full however far away it is
+    if (mesh.lods.size() == 1 &&
+        mesh.indices.size() / 3 * LOD_REDUCTION >= LOD_MIN_TRIANGLES) {
+      std::cerr << path << " got no levels of detail, it'll always be drawn in full"
+                << std::endl;
+    }
+  }
 
-  renderPipeline = pipelineBuilder.buildPipeline(device, renderPass);
+  // after the optimizer, whose order is what keeps each meshlet's triangles together
+  buildMeshlets(mesh);
+  if (!mesh.meshlets.empty()) {
+    std::cout << "  " << mesh.meshlets.size() << " meshlets, "
+              << mesh.indices.size() / 3.f / mesh.meshlets.size()
+              << " triangles each on average" << std::endl;
+  }
+  return true;
+}
 
-  // destroy the shader modules, as we don't need them once the pipeline is created
-  vkDestroyShaderModule(device, fragShader, nullptr);
-  vkDestroyShaderModule(device, vertShader, nullptr);
+bool VulkanEngine::bakeObjMesh(const std::string &objPath, const std::string &bakedPath) {
+  // baking happens instead of init(), so the parse needs the job system started for it
+  jobs.init(getJobWorkerCount());
+  Mesh mesh;
+  bool loaded = loadObjMesh(objPath, mesh);
+  jobs.cleanup();
 
-  mainDeletionQueue.pushFunction(
-      [=]() { vkDestroyPipeline(device, renderPipeline, nullptr); });
-  mainDeletionQueue.pushFunction(
-      [=]() { vkDestroyPipelineLayout(device, pipelineLayout, nullptr); });
+  if (!loaded) {
+    std::cerr << "Couldn't load " << objPath << std::endl;
+    return false;
+  }
+
+  if (!bakeMesh(mesh, vertexStreams, bakedPath)) {
+    std::cerr << "Couldn't write " << bakedPath << std::endl;
+    return false;
+  }
+
+  std::cout << "baked " << objPath << " into " << bakedPath << std::endl;
+  return true;
 }
 
-//-----------------------------------------------------------------------
+void VulkanEngine::uploadMesh(Mesh &mesh) {
+  // the data gets copied into the staging ring right away, so none of this has to live
+  // past the call
+  MeshUploadData data;
+  packMeshData(mesh, vertexStreams, data);
+  if (!uploadMeshData(mesh, data)) {
+    throw std::runtime_error("Mesh pool is full!");
+  }
+}
 
-// BUFFER STUFF
-//-----------------------------------------------------------------------
-// initialize the memory manager
-void VulkanEngine::createMemAllocator() {
-  VmaAllocatorCreateInfo allocatorInfo{};
-  allocatorInfo.physicalDevice = chosenGPU;
-  allocatorInfo.device         = device;
-  allocatorInfo.instance       = instance;
-  vmaCreateAllocator(&allocatorInfo, &allocator);
+bool VulkanEngine::uploadMeshData(Mesh &mesh, const MeshUploadData &data) {
+  if (!meshPool.allocate(mesh)) {
+    return false;
+  }
+
+  // each stream goes into its own buffer, at the same vertex
+  const uint8_t *vertexBytes = static_cast<const uint8_t *>(data.vertexData);
+  for (uint32_t stream = 0; stream < MAX_VERTEX_STREAMS; ++stream) {
+    VkDeviceSize stride = meshPool.streamStrides[stream];
+    if (stride == 0 || mesh.vertexCount == 0) {
+      continue;
+    }
+    uploader.uploadBuffer(meshPool.streamBuffers[stream].memBuffer,
+                          mesh.firstVertex * stride,
+                          vertexBytes + data.streamOffsets[stream],
+                          mesh.vertexCount * stride);
+  }
+
+  if (data.indexSize == 0) {
+    return true;
+  }
+
+  VkDeviceSize indexStride = mesh.indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4;
+  uploader.uploadBuffer(meshPool.indexBuffer.memBuffer, mesh.firstIndex * indexStride,
+                        data.indexData, data.indexSize);
+
+  uploader.uploadBuffer(meshPool.lodBuffer.memBuffer, mesh.firstLod * sizeof(MeshLod),
+                        mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+
+  if (mesh.meshlets.empty()) {
+    return true;
+  }
+
+  std::vector<Meshlet> meshlets = packMeshlets(mesh);
+  uploader.uploadBuffer(meshPool.meshletBuffer.memBuffer,
+                        mesh.firstMeshlet * sizeof(Meshlet), meshlets.data(),
+                        meshlets.size() * sizeof(Meshlet));
+  return true;
 }
 
 FrameData &VulkanEngine::getCurrentFrame() {
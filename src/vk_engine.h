@@ -1,8 +1,21 @@
 #pragma once
+#include "depth_pyramid.h"
+#include "frustum_culler.h"
+#include "gpu_profiler.h"
 #include "mesh.h"
+#include "mesh_bake.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "mesh_streamer.h"
+#include "meshlet_builder.h"
+#include "parallel_recorder.h"
 #include "pipeline_builder.h"
+#include "scene_bvh.h"
 #include "vk_initializers.h"
 #include "vk_types.h"
+#include "vk_upload.h"
+
+#include <unordered_map>
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -24,6 +37,157 @@ struct DeletionQueue {
   }
 };
 
+constexpr unsigned int MAX_FRAMES_IN_FLIGHT = 2;
+// indirect draws are split by index size, since only one can be bound at a time
+constexpr uint32_t INDEX_TYPE_COUNT = 2;
+// descriptors of each type the descriptor pool has room for, per frame in flight
+constexpr uint32_t MAX_STORAGE_DESCRIPTORS = 16;
+constexpr uint32_t MAX_SAMPLER_DESCRIPTORS = 16;
+// how many objects each cull workgroup tests, matching cull.comp
+constexpr uint32_t CULL_GROUP_SIZE = 64;
+
+// How much room the mesh pool gets for streamed meshes, since there's no knowing how big
+// they'll be up front: vertices, index bytes, meshlets and levels of detail
+constexpr uint32_t STREAMING_POOL_VERTICES        = 1 << 22;
+constexpr VkDeviceSize STREAMING_POOL_INDEX_BYTES = VkDeviceSize(64) << 20;
+constexpr uint32_t STREAMING_POOL_MESHLETS        = 1 << 18;
+constexpr uint32_t STREAMING_POOL_LODS            = 1 << 14;
+// roughly how many bytes of streamed meshes get uploaded each frame, at most. One mesh
+// always goes, however big it is.
+constexpr VkDeviceSize STREAMING_UPLOAD_BUDGET = VkDeviceSize(16) << 20;
+// meshes stream back out once they're this much farther than streamDistance, so one
+// right on the edge doesn't go in and out every frame
+constexpr float STREAM_OUT_FACTOR = 1.5f;
+
+// the draw index of batches that don't draw through the mesh pool
+constexpr uint32_t NO_DRAW = UINT32_MAX;
+
+// Objects with the same pipeline and mesh, drawn together as instances of one draw.
+// Objects without a mesh get a batch each.
+struct DrawBatch {
+  // the first object in it, which the pipeline and mesh come from
+  uint32_t firstObject;
+  uint32_t objectCount;
+  // where its instances start in the instance buffer, one slot per object
+  uint32_t firstInstance;
+  // its first command in the indirect buffer, or NO_DRAW
+  uint32_t drawIndex;
+  // Whole objects draw with a command per level of detail starting at drawIndex, and
+  // level l's instances start objectCount * l slots after firstInstance. 1 for objects
+  // without a mesh.
+  uint32_t lodCount;
+  // With meshlets, it's a command per meshlet of every level instead, with the
+  // instances laid out the same way. 0 when it draws whole objects.
+  uint32_t meshletCount;
+};
+
+// A batch's visible objects at one level of detail, when drawing without indirect
+// draws. Everything the draw call needs gets looked up when it's made, so recording it
+// never goes back to the scene, which the next frame's update might be changing.
+struct VisibleDraw {
+  VkPipeline pipeline;
+  VkPipelineLayout pipelineLayout;
+  // whether it's a mesh out of the pool, drawing count indices from first. Otherwise
+  // it's count vertices from first, straight out of the shader.
+  bool indexed;
+  VkIndexType indexType;
+  uint32_t count;
+  uint32_t first;
+  int32_t vertexOffset;
+  uint32_t firstInstance;
+  uint32_t instanceCount;
+};
+
+// What the cull pass knows about each object, matching cull.comp
+struct CullObject {
+  // world space bounding sphere, radius in w
+  glm::vec4 sphere;
+  // the indirect command of its batch, which it's added to as an instance if visible.
+  // NO_DRAW for objects that don't draw through the mesh pool, or draw by meshlet.
+  uint32_t drawIndex;
+  // how much the transform scales things up, at most, for meshlet radii and lod errors
+  float scale;
+  // its mesh's levels of detail, in the mesh pool's lod buffer
+  uint32_t firstLod;
+  uint32_t lodCount;
+};
+
+// One of an object's meshlets, which the cull pass tests on its own and adds to the
+// meshlet's indirect command if it's visible. Matches cull.comp.
+struct CullCluster {
+  uint32_t object;
+  // in the mesh pool's meshlet buffer
+  uint32_t meshlet;
+  uint32_t drawIndex;
+  // the level it's part of, which it only draws for when the object picks that level
+  uint32_t lod;
+};
+
+// what cull.comp checks for, in CullConstants::flags
+constexpr uint32_t CULL_FRUSTUM   = 1;
+constexpr uint32_t CULL_OCCLUSION = 2;
+// meshlets whose normal cone faces away from the camera
+constexpr uint32_t CULL_CONE = 4;
+// Not culling at all: the second dispatch, with a thread per draw, packing the draws
+// that got any instances together and counting them for vkCmdDrawIndexedIndirectCount
+constexpr uint32_t CULL_COMPACT = 8;
+
+// the cull pass's push constants, matching cull.comp
+struct CullConstants {
+  glm::mat4 view;
+  // the frustum's side planes, as x/z normals for left and right and y/z for top and
+  // bottom. They're symmetric, so that's all of them.
+  glm::vec4 frustum;
+  // the projection's x and y scales
+  float P00;
+  float P11;
+  float zNear;
+  float zFar;
+  // what size the depth buffer the pyramid came from was
+  glm::vec2 depthSize;
+  uint32_t objectCount;
+  uint32_t flags;
+  // how many meshlet threads come after the object ones
+  uint32_t clusterCount;
+  // VulkanEngine::lodScale
+  float lodScale;
+  // for compacting, how many draws there are, and where the 32 bit index ones start
+  uint32_t drawCount;
+  uint32_t wideDrawStart;
+};
+
+// where a streamed mesh is at
+enum class StreamState {
+  // not in memory, and not asked for
+  Unloaded,
+  // waiting for a streaming thread, or being loaded by one
+  Loading,
+  // in the mesh pool, waiting for its upload to land
+  Uploading,
+  // drawn by its objects
+  Resident,
+  // couldn't be loaded, so it's never asked for again
+  Failed,
+};
+
+// A mesh that gets streamed in when the camera comes near any of its objects, and back
+// out when it leaves. Its objects draw the placeholder mesh until it's resident.
+struct StreamedAsset {
+  std::string path;
+  // where it goes once it's loaded, in VulkanEngine::meshes
+  Mesh *mesh;
+  // the render objects that draw it
+  std::vector<uint32_t> objects;
+  StreamState state{StreamState::Unloaded};
+  // the upload submit it's waiting on, while Uploading
+  uint64_t uploadTicket{0};
+  // its model space bounding sphere, radius in w, once it's been loaded at least once
+  glm::vec4 sphere{0.f};
+  // how far its nearest object was from the camera as of the last update, and where
+  float distance{INFINITY};
+  glm::vec3 nearestPosition{0.f};
+};
+
 // Struct for holding objects for each frame in the swapchain
 struct FrameData {
   VkSemaphore renderSemaphore, presentSemaphore;
@@ -31,9 +195,82 @@ struct FrameData {
 
   VkCommandPool graphicsCommandPool, computeCommandPool;
   VkCommandBuffer graphicsCommandBuffer, computeCommandBuffer;
+
+  // signalled when this frame's compute work is done, for graphics to wait on
+  VkSemaphore computeSemaphore;
+  // signalled when this frame has rebuilt the depth pyramid, for next frame's culling
+  VkSemaphore depthPyramidSemaphore;
+
+  // gpu timestamps for this frame's scopes
+  VkQueryPool timestampPool;
+
+  // Every object's data and what culling needs to know about it, rewritten by the cpu
+  // each frame
+  AllocatedBuffer objectBuffer;
+  AllocatedBuffer cullBuffer;
+  // where those are mapped
+  ObjectData *objects;
+  CullObject *cullObjects;
+
+  // Which object every instance draws. A batch's instances sit together, starting at
+  // its firstInstance. Filled in by the cull pass with indirect draws, and by the cpu
+  // otherwise, where it's mapped to instances.
+  AllocatedBuffer instanceBuffer;
+  uint32_t *instances;
+
+  // Every batch's indirect draw, with no instances yet. It gets copied over the indirect
+  // buffer before culling, and the cull pass counts the visible instances up.
+  AllocatedBuffer batchBuffer;
+  VkDrawIndexedIndirectCommand *batchCommands;
+  AllocatedBuffer indirectBuffer;
+  // With VK_KHR_draw_indirect_count, the draws that got any instances, packed together
+  // at the start of their index size's run, and how many there are in each run. Always
+  // made, since the cull pass binds them either way.
+  AllocatedBuffer compactedBuffer;
+  AllocatedBuffer drawCountBuffer;
+
+  // This frame's copy of VulkanEngine::cullClusters, written whenever the scene changes
+  AllocatedBuffer clusterBuffer;
+  CullCluster *clusters;
+
+  // how many instances, indirect draws and clusters the buffers have room for
+  uint32_t instanceCapacity;
+  uint32_t commandCapacity;
+  uint32_t clusterCapacity;
+  // the VulkanEngine::sceneVersion the buffers were last brought up to date with
+  uint64_t sceneVersion;
+
+  // points the mesh shaders at objectBuffer and instanceBuffer
+  VkDescriptorSet objectDescriptor;
+  // and the cull pass at everything it reads and writes
+  VkDescriptorSet cullDescriptor;
+
+  // What the frame's update left for its recording: the camera, the draw list, and
+  // the indirect draw layout it was written with. Recording reads these rather than
+  // the engine's, since the next frame's update is changing those at the same time.
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::mat4 viewProj;
+  float lodScale;
+  uint32_t groupDrawStarts[INDEX_TYPE_COUNT];
+  uint32_t groupDrawCounts[INDEX_TYPE_COUNT];
+  uint32_t indirectDrawCount;
+  uint32_t clusterCount;
+  // without indirect draws, what got through culling
+  std::vector<VisibleDraw> visibleDraws;
 };
 
-constexpr unsigned int MAX_FRAMES_IN_FLIGHT = 2;
+// A chunk of work for the compute queue. Every frame, the passes get recorded into the
+// frame's compute buffer and submitted before the graphics work, which only waits on
+// them at the stages that actually read their results. Anything a pass shares with
+// graphics has to be VK_SHARING_MODE_CONCURRENT, or transfer queue ownership itself,
+// since the two can be different queue families.
+struct ComputePass {
+  const char *name;
+  std::function<void(VkCommandBuffer cmd)> record;
+  // the graphics stages that consume what this pass writes
+  VkPipelineStageFlags consumerStages;
+};
 
 class VulkanEngine {
 public:
@@ -44,6 +281,7 @@ public:
   VkQueue computeQueue;
   VkQueue presentQueue;
   VkQueue graphicsQueue;
+  VkQueue transferQueue;
 
   VkPhysicalDevice chosenGPU;
   VkPhysicalDeviceFeatures GPUFeatures;
@@ -58,25 +296,178 @@ public:
   VkFormat swapChainImageFormat;
   VkExtent2D swapChainExtent;
 
+  // one depth buffer, shared by every framebuffer
+  VkFormat depthFormat{VK_FORMAT_UNDEFINED};
+  AllocatedImage depthImage;
+  VkImageView depthImageView;
+
   VkRenderPass renderPass;
 
   VkPipelineLayout pipelineLayout;
   VkPipeline renderPipeline;
 
+  // draws meshes out of the mesh pool, with the camera in push constants and object
+  // matrices in a storage buffer
+  VkPipelineLayout meshPipelineLayout;
+  VkPipeline meshPipeline;
+
+  // the mesh shaders' set 0: the object buffer
+  VkDescriptorSetLayout objectSetLayout;
+  VkDescriptorPool descriptorPool;
+
+  // turns the cull buffer into indirect draws, on the compute queue
+  VkDescriptorSetLayout cullSetLayout;
+  VkPipelineLayout cullPipelineLayout;
+  VkPipeline cullPipeline;
+
+  // compiled pipelines, kept on disk between runs
+  VkPipelineCache pipelineCache;
+  std::string pipelineCachePath{"pipeline_cache.bin"};
+
   VmaAllocator allocator;
 
+  // gets mesh data (and anything else) from the cpu into gpu-only memory
+  UploadQueue uploader;
+
+  // every mesh that's been loaded, by name
+  std::unordered_map<std::string, Mesh> meshes;
+  // and where their vertices and indices actually live
+  MeshPool meshPool;
+  // .obj or baked .tmesh files to put in the scene
+  std::vector<std::string> meshPaths;
+  // Load meshPaths in the background once the camera comes within streamDistance of
+  // them, drawing a placeholder until they're in, instead of all of them up front.
+  // Always off when headless.
+  bool streamMeshes{true};
+  float streamDistance{100.f};
+  // loads the streamed meshes, and what it's loading them for
+  MeshStreamer streamer;
+  std::vector<StreamedAsset> streamedAssets;
+  // a load that's come back but didn't fit this frame's budget, or the mesh pool yet
+  std::unique_ptr<StreamedMesh> stalledMesh;
+  // meshes that have been streamed out, and the frame their room can be reused from,
+  // once every frame that might still draw them is done
+  std::deque<std::pair<unsigned int, Mesh>> retiredMeshes;
+  // bumped whenever streaming changes what any object draws
+  uint64_t sceneVersion{0};
+  // reorder loaded meshes for the vertex cache, and optionally for less overdraw too
+  bool optimizeMeshes{true};
+  bool optimizeMeshOverdraw{false};
+  // Positions in a stream of their own, so position-only passes fetch just those. The
+  // mesh pipeline reads both streams, so it's the same work for it either way.
+  VertexStreams vertexStreams{VertexStreams::Split};
+
+  // the camera for the frame being updated, which the frame keeps a copy of
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::mat4 viewProj;
+  // the camera of the last frame submitted, which is the one on screen
+  glm::mat4 displayedViewProj{1.f};
+  float zNear{0.1f};
+  float zFar{200.f};
+
+  // compute work that runs on the compute queue ahead of each frame, in order
+  std::vector<ComputePass> computePasses;
+
+  // everything that gets drawn in the main pass, in order
+  std::vector<RenderObject> renderObjects;
+  // how many copies of the test triangle the scene starts with
+  unsigned int sceneDrawCount{1};
+
+  // Runs culling, draw recording and .obj parsing across every core. The main thread
+  // is one of its threads.
+  JobSystem jobs;
+  // extra threads the job system runs. 0 picks one less than the number of cores.
+  unsigned int jobThreadCount{0};
+  // jobThreadCount, or what 0 picks
+  uint32_t getJobWorkerCount() const;
+
+  // records the draw list across the job system's threads
+  ParallelRecorder recorder;
+  // with fewer draws than this, handing them out to threads costs more than it saves
+  size_t parallelRecordThreshold{256};
+
+  // Draw the whole scene with an indirect draw per index size, instead of recording a
+  // draw call per batch. Turned off if the device can't pick objects by firstInstance
+  // in indirect draws.
+  bool indirectDraws{true};
+  // what the device can do with indirect draws
+  bool multiDrawIndirectSupported{false};
+  bool drawIndirectCountSupported{false};
+  PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount{nullptr};
+  // how many objects the per-frame buffers have room for
+  uint32_t drawCapacity{0};
+  // and how many instances the batches need
+  uint32_t instanceCapacity{0};
+  // Split meshes into their meshlets with indirect draws, so the cull pass can throw
+  // out the parts of an object that are off screen, hidden, or facing away
+  bool meshletCulling{true};
+  // Simplify loaded meshes into levels of detail, and draw each object at the coarsest
+  // one that's off by at most lodErrorThreshold pixels
+  bool meshLods{true};
+  float lodErrorThreshold{1.f};
+  // Turns a level's model space error into lodErrorThreshold sized pixels at a distance
+  // of 1, for the frame being updated. Follows the projection and the window's height.
+  float lodScale{1.f};
+
+  // the draw list grouped into instanced draws, and which batch every object is in
+  std::vector<DrawBatch> drawBatches;
+  std::vector<uint32_t> objectBatches;
+  // every meshlet of every object in a meshlet batch, which only changes when streaming
+  // does, so the frames only copy it over then
+  std::vector<CullCluster> cullClusters;
+  // The indirect buffer holds the draws of the batches with 16 bit indices, then the 32
+  // bit ones. Where each run starts, and how long it is.
+  uint32_t groupDrawStarts[INDEX_TYPE_COUNT]{};
+  uint32_t groupDrawCounts[INDEX_TYPE_COUNT]{};
+  // both runs together
+  uint32_t indirectDrawCount{0};
+
+  // What the cull pass throws out before the indirect draws see it. Occlusion culling
+  // tests against last frame's depth pyramid, so something that's just come out from
+  // behind something else shows up a frame late. Without indirect draws, frustum culling
+  // happens on the cpu instead.
+  bool frustumCulling{true};
+  bool occlusionCulling{true};
+  // last frame's depth, reduced down for occlusion culling
+  DepthPyramid depthPyramid;
+  // Cull draws recorded one by one through the scene bvh, instead of testing every
+  // object's sphere with the flat culler
+  bool bvhCulling{true};
+  // every object's world space box, for culling and picking
+  SceneBvh sceneBvh;
+  // culls the draw list when it gets recorded draw by draw
+  FrustumCuller culler;
+  // the render objects the frame being updated draws without indirect draws
+  std::vector<uint32_t> visibleObjects;
+  // and how many of each batch's objects are visible at each level, MESH_MAX_LODS
+  // counts to a batch
+  std::vector<uint32_t> lodInstanceCounts;
+  // whether the pyramid holds a real frame yet, i.e. not right after it was (re)made
+  bool depthPyramidReady{false};
+  // the semaphore the last pyramid build signalled, which the next cull pass waits on
+  VkSemaphore pendingPyramidSemaphore{VK_NULL_HANDLE};
+
+  // offscreen render targets, used in place of the swapchain images when headless
+  std::vector<AllocatedImage> offscreenImages;
+
   // indices of the queue families, which send out commands from their respective queues
   // each queue family can only submit one type of command, so we need multiple queues.
   struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
     std::optional<uint32_t> computeFamily;
+    // optional. Falls back to the graphics family when there's no transfer-only one.
+    std::optional<uint32_t> transferFamily;
     bool isComplete() {
       return graphicsFamily.has_value() && presentFamily.has_value() &&
              computeFamily.has_value();
     }
   };
 
+  // the families the logical device was made with
+  QueueFamilyIndices queueFamilyIndices;
+
   // details on how the swapchain is supported by the surface
   struct SwapChainSupportDetails {
     VkSurfaceCapabilitiesKHR capabilities;
@@ -90,15 +481,47 @@ public:
   // necessary device extension list
   const std::vector<const char *> requiredDeviceExtensions = {
       VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  // extensions that get turned on when the device has them
+  const std::vector<const char *> optionalDeviceExtensions = {
+      VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME};
 
   bool isInitialized{false};
 
+  // render without a window or swapchain. Set before calling init().
+  bool headless{false};
+  // how many frames run() renders before returning when headless
+  unsigned int headlessFrameCount{1000};
+
+  // the frame being recorded and submitted, while the next one gets updated
   unsigned int frameNumber{0};
+  // Whether frameNumber's update has already happened, alongside the last frame's
+  // recording. It hasn't for the very first frame, or after the swapchain's been remade.
+  bool frameUpdated{false};
   unsigned int selectedShader{0};
 
   FrameData bufferFrames[MAX_FRAMES_IN_FLIGHT];
 
   DeletionQueue mainDeletionQueue;
+  // everything that depends on the swapchain's images or size, and so gets rebuilt when
+  // the window changes
+  DeletionQueue swapChainDeletionQueue;
+
+  // times regions of each frame on the gpu
+  GpuProfiler gpuProfiler;
+  // print the gpu timings every this many frames. 0 turns it off.
+  unsigned int profileInterval{0};
+  // if set, the periodic timings also get appended to this csv file
+  std::string profileCsvPath;
+
+  // where F12 (or quitting, with traceOnExit) writes the cpu zone trace
+  std::string tracePath{"cpu_trace.json"};
+  bool traceOnExit{false};
+
+  // force a specific GPU, either by its index or part of its name. Falls back to the
+  // VULKAN_ENGINE_GPU environment variable when empty.
+  std::string preferredGPU;
+  // swap out the default device ranking. Return a higher score for better devices.
+  std::function<int64_t(VkPhysicalDevice)> deviceScorer;
 
   // default window size.
   VkExtent2D windowExtent{800, 600};
@@ -110,12 +533,25 @@ public:
 
   // boot up the engine
   void init();
-  // draw things to the screen
+  // Draw things to the screen: record and submit this frame, while updating the next
   void draw();
   // run the main loop
   void run();
+  // render headlessFrameCount frames back to back and print the timings
+  void runHeadless();
+  // dump the gpu timings if profileInterval says it's time
+  void reportProfiling();
   // shut off the engine
   void cleanup();
+  // Load an .obj and write it out as a baked mesh for vertexStreams. Doesn't need the
+  // engine to be initialized.
+  bool bakeObjMesh(const std::string &objPath, const std::string &bakedPath);
+
+  // Move an object. Its box in the scene bvh gets refit before it's next culled or
+  // picked.
+  void setObjectTransform(size_t index, const glm::mat4 &transform);
+  // the nearest object under a pixel of the window, going by its bounding box
+  std::optional<uint32_t> pickObject(int x, int y);
 
 private:
   void initVulkan();
@@ -123,12 +559,16 @@ private:
   // The functions here are ordered mostly in terms of when they're used in the chain
 
   std::vector<const char *> getRequiredExtensions();
+  std::vector<const char *> getRequiredDeviceExtensions();
   void createInstance();
 
   void createSurface();
   // GPU selection functions
   void pickPhysicalDevice();
   bool isDeviceSuitable(VkPhysicalDevice GPU);
+  int64_t rateDevice(VkPhysicalDevice GPU);
+  bool deviceMatches(const std::string &forcedGPU, uint32_t index,
+                     const char *deviceName);
   QueueFamilyIndices findQueueFamilies(VkPhysicalDevice GPU);
 
   // Logical device creation
@@ -144,6 +584,11 @@ private:
   VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities);
 
   void createImageViews();
+  // the depth buffer, which is as big as the swapchain
+  void createDepthResources();
+
+  // Headless replacement for the swapchain
+  void createOffscreenImages();
 
   // Command queue/buffer setup
   void initGraphicsCommands();
@@ -154,11 +599,69 @@ private:
   void createRenderPass();
   void createFramebuffers();
   void createSyncStructures();
+  void createQueryPools();
 
   // Load shaders from SPIR-V into renderer modules
   bool loadShaderModule(const char *filePath, VkShaderModule *outShaderModule);
 
+  // the object buffer's set layout and the pool its sets come from
+  void createDescriptors();
   void createPipelines();
+  // the cull pipeline and the depth pyramid's
+  void createComputePipelines();
+  // fill the draw list, and build the scene bvh over it
+  void initScene();
+  // group the draw list into batches, and lay their draws out in the indirect buffer
+  void createDrawBatches();
+  // an object's world space box, empty if it has no mesh
+  Aabb getObjectBounds(const RenderObject &object) const;
+  // make every frame's object and indirect buffers, sized for the draw list
+  void createDrawBuffers();
+  // make (or remake) one frame's buffers, point its descriptors at them, and copy the
+  // clusters over
+  void createFrameBuffers(FrameData &frame);
+  void destroyFrameBuffers(FrameData &frame);
+  // Bring a frame's buffers up to date with the scene, growing them if they're too
+  // small. Its fence has to have been waited on.
+  void updateFrameBuffers(FrameData &frame);
+  // (re)make the depth pyramid for the current depth buffer, and point culling at it
+  void createDepthPyramid();
+
+  // Load the pipeline cache from the last run, if it came from this exact device/driver
+  void createPipelineCache();
+  void savePipelineCache();
+
+  // The update stage: wait for the gpu to be done with the frame's slot, take in
+  // streaming, and do all of the frame's cpu work, leaving what its recording needs in
+  // the slot. Runs on the main thread, alongside the last frame's recording.
+  void updateFrame(FrameData &frame);
+  // Record the compute passes and submit them. Returns the stages graphics has to wait
+  // at, or 0 if there was nothing to submit.
+  VkPipelineStageFlags submitCompute();
+
+  // Record everything a frame draws into its command buffer. Only reads the current
+  // frame's slot, so it can run on any thread while the next frame updates.
+  void recordCommands(VkCommandBuffer graphBuffer, uint32_t swapChainImageIndex);
+  // work out the camera matrices for the frame being updated
+  void updateCamera();
+  // Fill in the frame's object data, and what the cull pass needs if indirect draws
+  // are on. Otherwise cull on the cpu, and fill in its instances and visibleDraws.
+  void writeDrawCommands(FrameData &frame);
+  // the level of detail an object gets drawn at this frame, out of its first lodCount
+  uint32_t selectLod(const RenderObject &object, uint32_t lodCount) const;
+  // Record culling the draw list into this frame's indirect buffer
+  void recordCulling(VkCommandBuffer cmd);
+  // whether frames end by building the depth pyramid for occlusion culling
+  bool buildsDepthPyramid() const { return indirectDraws && occlusionCulling; }
+  // set the viewport and scissor to cover the window
+  void setViewportAndScissor(VkCommandBuffer cmd);
+  // bind the mesh pool's vertex streams
+  void bindMeshPoolVertices(VkCommandBuffer cmd);
+  // Record the whole draw list as indirect draws
+  void recordIndirectDraws(VkCommandBuffer cmd);
+  // Record draws [begin, end) of the current frame's visibleDraws. Has to be callable
+  // from any thread.
+  void recordDraws(VkCommandBuffer cmd, size_t begin, size_t end);
 
   // Returns the associated struct for the current frame, based on MAX_FRAMES_IN_FLIGHT
   FrameData &getCurrentFrame();
@@ -169,9 +672,37 @@ private:
 
   void createMemAllocator();
 
-  // Not currently used
+  // Make a buffer that every queue family we use can get at
+  AllocatedBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                               VmaMemoryUsage memoryUsage);
+
+  // Make the mesh pool's buffers, with room for this many vertices, index bytes,
+  // meshlets and levels of detail
+  void createMeshPool(uint32_t vertexCapacity, VkDeviceSize indexCapacity,
+                      uint32_t meshletCapacity, uint32_t lodCapacity);
+  // Load every mesh and send them all to the gpu in one go. When streaming, that's just
+  // the built in ones, and the pool gets room for streamed ones on top.
   void loadMeshes();
+  // start the streaming threads. initScene sets up the assets they load.
+  void initStreaming();
+  // Take in finished loads, swap meshes whose uploads have landed in for their
+  // placeholders, and ask for or drop meshes by how far the camera is from them. Runs at
+  // the start of a frame, once its fence has been waited on.
+  void updateStreaming();
+  // turn a request into a packed mesh, on a streaming thread
+  void loadStreamedMesh(const StreamRequest &request, StreamedMesh &result);
+  // point every one of an asset's objects at mesh
+  void setAssetMesh(const StreamedAsset &asset, Mesh *mesh);
+  // send an asset's mesh back to placeholder, freeing its room once it's safe to
+  void evictAsset(StreamedAsset &asset);
+  // load an .obj and optimize it if that's turned on, printing how it went
+  bool loadObjMesh(const std::string &path, Mesh &mesh);
+  // Pack the mesh's vertices and indices for the gpu and queue them for upload
   void uploadMesh(Mesh &mesh);
+  // Find the mesh room in the pool and queue already packed data for upload. The mesh's
+  // counts and index type have to be filled in already, like packMeshData does. Returns
+  // false, uploading nothing, if the pool's out of room.
+  bool uploadMeshData(Mesh &mesh, const MeshUploadData &data);
 
   // HERE BE DEBUG DRAGONS
   //----------------------------------------------------------------
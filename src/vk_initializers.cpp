@@ -118,4 +118,114 @@ VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo() {
   info.pPushConstantRanges    = nullptr;
   return info;
 }
+
+// describe a plain 2D image with a single mip level and layer
+VkImageCreateInfo imageCreateInfo(VkFormat format, VkImageUsageFlags usageFlags,
+                                  VkExtent3D extent) {
+  VkImageCreateInfo info{};
+  info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  info.pNext = nullptr;
+
+  info.imageType = VK_IMAGE_TYPE_2D;
+  info.format    = format;
+  info.extent    = extent;
+
+  info.mipLevels   = 1;
+  info.arrayLayers = 1;
+  info.samples     = VK_SAMPLE_COUNT_1_BIT;
+  // optimal tiling lets the gpu lay the pixels out however it likes
+  info.tiling        = VK_IMAGE_TILING_OPTIMAL;
+  info.usage         = usageFlags;
+  info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  return info;
+}
+
+// view a whole single-level image, or the first level of a mipmapped one
+VkImageViewCreateInfo imageViewCreateInfo(VkFormat format, VkImage image,
+                                          VkImageAspectFlags aspectFlags) {
+  VkImageViewCreateInfo info{};
+  info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  info.pNext = nullptr;
+
+  info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  info.image    = image;
+  info.format   = format;
+
+  info.subresourceRange.aspectMask     = aspectFlags;
+  info.subresourceRange.baseMipLevel   = 0;
+  info.subresourceRange.levelCount     = 1;
+  info.subresourceRange.baseArrayLayer = 0;
+  info.subresourceRange.layerCount     = 1;
+
+  return info;
+}
+
+// how a pipeline tests and writes depth. No stencil, no depth bounds.
+VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo(bool depthTest,
+                                                             bool depthWrite,
+                                                             VkCompareOp compareOp) {
+  VkPipelineDepthStencilStateCreateInfo info{};
+  info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  info.pNext = nullptr;
+
+  info.depthTestEnable       = depthTest ? VK_TRUE : VK_FALSE;
+  info.depthWriteEnable      = depthWrite ? VK_TRUE : VK_FALSE;
+  info.depthCompareOp        = depthTest ? compareOp : VK_COMPARE_OP_ALWAYS;
+  info.depthBoundsTestEnable = VK_FALSE;
+  info.minDepthBounds        = 0.0f;
+  info.maxDepthBounds        = 1.0f;
+  info.stencilTestEnable     = VK_FALSE;
+
+  return info;
+}
+
+// one binding of a single descriptor in a set layout
+VkDescriptorSetLayoutBinding descriptorSetLayoutBinding(VkDescriptorType type,
+                                                        VkShaderStageFlags stageFlags,
+                                                        uint32_t binding) {
+  VkDescriptorSetLayoutBinding setBinding{};
+  setBinding.binding            = binding;
+  setBinding.descriptorCount    = 1;
+  setBinding.descriptorType     = type;
+  setBinding.pImmutableSamplers = nullptr;
+  setBinding.stageFlags         = stageFlags;
+
+  return setBinding;
+}
+
+// point a buffer binding of a descriptor set at a buffer
+VkWriteDescriptorSet writeDescriptorBuffer(VkDescriptorType type, VkDescriptorSet dstSet,
+                                           const VkDescriptorBufferInfo *bufferInfo,
+                                           uint32_t binding) {
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.pNext = nullptr;
+
+  write.dstBinding      = binding;
+  write.dstSet          = dstSet;
+  write.descriptorCount = 1;
+  write.descriptorType  = type;
+  write.pBufferInfo     = bufferInfo;
+
+  return write;
+}
+
+// point an image binding of a descriptor set at an image
+VkWriteDescriptorSet writeDescriptorImage(VkDescriptorType type, VkDescriptorSet dstSet,
+                                          const VkDescriptorImageInfo *imageInfo,
+                                          uint32_t binding) {
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.pNext = nullptr;
+
+  write.dstBinding      = binding;
+  write.dstSet          = dstSet;
+  write.descriptorCount = 1;
+  write.descriptorType  = type;
+  write.pImageInfo      = imageInfo;
+
+  return write;
+}
 } // namespace vkinit
\ No newline at end of file
@@ -19,4 +19,26 @@ VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo();
 VkPipelineColorBlendAttachmentState colorBlendAttachmentState();
 
 VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo();
+
+VkImageCreateInfo imageCreateInfo(VkFormat format, VkImageUsageFlags usageFlags,
+                                  VkExtent3D extent);
+
+VkImageViewCreateInfo imageViewCreateInfo(VkFormat format, VkImage image,
+                                          VkImageAspectFlags aspectFlags);
+
+VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo(bool depthTest,
+                                                             bool depthWrite,
+                                                             VkCompareOp compareOp);
+
+VkDescriptorSetLayoutBinding descriptorSetLayoutBinding(VkDescriptorType type,
+                                                        VkShaderStageFlags stageFlags,
+                                                        uint32_t binding);
+
+VkWriteDescriptorSet writeDescriptorBuffer(VkDescriptorType type, VkDescriptorSet dstSet,
+                                           const VkDescriptorBufferInfo *bufferInfo,
+                                           uint32_t binding);
+
+VkWriteDescriptorSet writeDescriptorImage(VkDescriptorType type, VkDescriptorSet dstSet,
+                                          const VkDescriptorImageInfo *imageInfo,
+                                          uint32_t binding);
 } // namespace vkinit
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "vk_mem_alloc.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
@@ -15,6 +16,7 @@
 #include <optional>
 #include <set>
 #include <stdexcept>
+#include <string>
 #include <vector>
 #include <vulkan/vulkan.h>
 
@@ -23,3 +25,9 @@ struct AllocatedBuffer {
   VkBuffer memBuffer;
   VmaAllocation allocation;
 };
+
+// same as above, but for images
+struct AllocatedImage {
+  VkImage memImage;
+  VmaAllocation allocation;
+};
@@ -0,0 +1,225 @@
+#include "vk_upload.h"
+
+// copies out of the ring are kept to this alignment, which keeps every driver happy
+constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+// Make the staging ring and the batches' command buffers and fences
+void UploadQueue::init(VkDevice device, VmaAllocator allocator, uint32_t queueFamily,
+                       VkQueue queue, VkDeviceSize ringSize) {
+  this->device    = device;
+  this->allocator = allocator;
+  this->queue     = queue;
+  this->ringSize  = ringSize;
+
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.pNext = nullptr;
+
+  bufferInfo.size        = ringSize;
+  bufferInfo.usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  // cpu-visible, and mapped for its whole life so staging is just a memcpy
+  VmaAllocationCreateInfo allocInfo{};
+  allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+  allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+  VmaAllocationInfo mappedInfo{};
+  if (vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &ring.memBuffer,
+                      &ring.allocation, &mappedInfo) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create staging ring buffer!");
+  }
+  ringData = static_cast<uint8_t *>(mappedInfo.pMappedData);
+
+  // every batch gets a pool of its own, so resetting one never touches the others
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.pNext            = nullptr;
+  poolInfo.queueFamilyIndex = queueFamily;
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.pNext = nullptr;
+  fenceInfo.flags = 0;
+
+  for (auto &batch : batches) {
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &batch.pool) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create upload command pool!");
+    }
+
+    VkCommandBufferAllocateInfo commandBufferInfo{};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferInfo.pNext = nullptr;
+
+    commandBufferInfo.commandPool        = batch.pool;
+    commandBufferInfo.commandBufferCount = 1;
+    commandBufferInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+    if (vkAllocateCommandBuffers(device, &commandBufferInfo, &batch.cmd) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate upload command buffer!");
+    }
+
+    if (vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create upload fence!");
+    }
+
+    batch.ringEnd   = 0;
+    batch.recording = false;
+  }
+}
+
+void UploadQueue::cleanup() {
+  waitIdle();
+
+  for (auto &batch : batches) {
+    vkDestroyFence(device, batch.fence, nullptr);
+    vkDestroyCommandPool(device, batch.pool, nullptr);
+  }
+  vmaDestroyBuffer(allocator, ring.memBuffer, ring.allocation);
+}
+
+void UploadQueue::uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void *data,
+                               VkDeviceSize size) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+  // anything bigger than half the ring goes through in pieces, so one huge upload can
+  // still stream while earlier pieces are being copied
+  const VkDeviceSize maxChunk = ringSize / 2;
+
+  while (size > 0) {
+    VkDeviceSize chunkSize = std::min(size, maxChunk);
+    VkDeviceSize offset    = allocate(chunkSize);
+
+    memcpy(ringData + offset % ringSize, bytes, chunkSize);
+
+    Batch &batch = currentBatch();
+
+    VkBufferCopy copy{};
+    copy.srcOffset = offset % ringSize;
+    copy.dstOffset = dstOffset;
+    copy.size      = chunkSize;
+    vkCmdCopyBuffer(batch.cmd, ring.memBuffer, dst, 1, &copy);
+
+    batch.ringEnd = head;
+    bytesUploaded += chunkSize;
+
+    bytes += chunkSize;
+    dstOffset += chunkSize;
+    size -= chunkSize;
+  }
+}
+
+bool UploadQueue::submit() {
+  Batch &batch = batches[submittedBatches % UPLOAD_BATCH_COUNT];
+  if (!batch.recording) {
+    return false;
+  }
+
+  if (vkEndCommandBuffer(batch.cmd) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to end the upload command buffer!");
+  }
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext = nullptr;
+
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers    = &batch.cmd;
+
+  if (vkQueueSubmit(queue, 1, &submitInfo, batch.fence) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to submit uploads!");
+  }
+
+  batch.recording = false;
+  ++submittedBatches;
+  return true;
+}
+
+void UploadQueue::waitIdle() {
+  submit();
+  while (retiredBatches < submittedBatches) {
+    retireOldest(true);
+  }
+}
+
+uint64_t UploadQueue::getUploadTicket() const {
+  // the batch being recorded goes out with the next submit
+  const Batch &batch = batches[submittedBatches % UPLOAD_BATCH_COUNT];
+  return batch.recording ? submittedBatches + 1 : submittedBatches;
+}
+
+uint64_t UploadQueue::pollCompleted() {
+  while (retiredBatches < submittedBatches && retireOldest(false)) {
+  }
+  return retiredBatches;
+}
+
+VkDeviceSize UploadQueue::allocate(VkDeviceSize size) {
+  // hand back whatever the gpu has already finished with, without waiting
+  while (retiredBatches < submittedBatches && retireOldest(false)) {
+  }
+
+  while (true) {
+    VkDeviceSize offset = (head + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+    // copies can't wrap around the end of the ring, so skip to the start if it would
+    if (offset % ringSize + size > ringSize) {
+      offset += ringSize - offset % ringSize;
+    }
+
+    if (offset + size - tail <= ringSize) {
+      head = offset + size;
+      return offset;
+    }
+
+    // no room, so something has to finish first. If nothing's been sent yet, the
+    // batch we're recording is what's hogging the ring.
+    if (retiredBatches == submittedBatches) {
+      submit();
+    }
+    retireOldest(true);
+  }
+}
+
+UploadQueue::Batch &UploadQueue::currentBatch() {
+  Batch &batch = batches[submittedBatches % UPLOAD_BATCH_COUNT];
+  if (batch.recording) {
+    return batch;
+  }
+
+  // every batch is busy, wait for the one we're about to reuse
+  if (submittedBatches - retiredBatches == UPLOAD_BATCH_COUNT) {
+    retireOldest(true);
+  }
+
+  vkResetCommandPool(device, batch.pool, 0);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.pNext = nullptr;
+
+  beginInfo.pInheritanceInfo = nullptr;
+  beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  if (vkBeginCommandBuffer(batch.cmd, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to start recording uploads!");
+  }
+
+  batch.recording = true;
+  return batch;
+}
+
+bool UploadQueue::retireOldest(bool block) {
+  Batch &batch = batches[retiredBatches % UPLOAD_BATCH_COUNT];
+
+  if (block) {
+    vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+  } else if (vkGetFenceStatus(device, batch.fence) != VK_SUCCESS) {
+    return false;
+  }
+
+  vkResetFences(device, 1, &batch.fence);
+  tail = batch.ringEnd;
+  ++retiredBatches;
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+#include "vk_types.h"
+
+// how much staging memory uploads get to share unless told otherwise
+constexpr VkDeviceSize DEFAULT_STAGING_RING_SIZE = 64 * 1024 * 1024;
+// how many submitted batches can be waiting on the transfer queue at once
+constexpr uint32_t UPLOAD_BATCH_COUNT = 4;
+
+// Streams data into gpu-only buffers through a single persistently mapped staging ring.
+// Copies pile up in one command buffer and go out together in a single submit, and the
+// ring space they used is handed back once that submit's fence has signalled, so there's
+// no per-upload staging buffer and no waiting on the queue after every copy.
+// Not thread safe, everything has to come from the same thread.
+class UploadQueue {
+public:
+  void init(VkDevice device, VmaAllocator allocator, uint32_t queueFamily, VkQueue queue,
+            VkDeviceSize ringSize = DEFAULT_STAGING_RING_SIZE);
+  void cleanup();
+
+  // Stage size bytes to be copied into dst at dstOffset. The copy itself happens on the
+  // gpu some time after the next submit(), so dst can't be used until then.
+  void uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void *data,
+                    VkDeviceSize size);
+
+  // send every copy recorded so far off to the queue. Returns false if there weren't any.
+  bool submit();
+  // submit, then block until every upload has landed
+  void waitIdle();
+
+  // The submit everything uploaded so far goes out in, counting from 1. The uploads have
+  // all landed once pollCompleted() gets to it.
+  uint64_t getUploadTicket() const;
+  // how many submits the gpu has finished, retiring whatever's done without waiting
+  uint64_t pollCompleted();
+
+  // how many bytes have gone through the ring in total, for stats
+  uint64_t getBytesUploaded() { return bytesUploaded; }
+
+private:
+  // one command buffer's worth of copies, and the ring space they're reading from
+  struct Batch {
+    VkCommandPool pool;
+    VkCommandBuffer cmd;
+    VkFence fence;
+    // where this batch's last allocation ends in the ring
+    VkDeviceSize ringEnd;
+    bool recording;
+  };
+
+  // find room for size bytes in the ring, returning its (unwrapped) offset
+  VkDeviceSize allocate(VkDeviceSize size);
+  // the batch copies are being recorded into, started if it isn't already
+  Batch &currentBatch();
+  // Hand the oldest submitted batch's ring space back. Only waits on its fence if block
+  // is set, otherwise returns false when it's still running.
+  bool retireOldest(bool block);
+
+  VkDevice device;
+  VmaAllocator allocator;
+  VkQueue queue;
+
+  AllocatedBuffer ring;
+  uint8_t *ringData;
+  VkDeviceSize ringSize;
+  // Offsets that only ever go up, so wrapping around is just a modulo. Everything in
+  // [tail, head) is still waiting to be copied by the gpu.
+  VkDeviceSize head{0};
+  VkDeviceSize tail{0};
+
+  Batch batches[UPLOAD_BATCH_COUNT];
+  // batches ever submitted and ever retired. The one being recorded is submitted % count.
+  uint64_t submittedBatches{0};
+  uint64_t retiredBatches{0};
+
+  uint64_t bytesUploaded{0};
+};
\ No newline at end of file